@@ -0,0 +1,78 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <time.h>
+
+#include <cstdint>
+
+namespace mjlib {
+namespace base {
+
+/// Reports the current time as integer microseconds since the epoch,
+/// the same representation used by ConvertPtimeToEpochMicroseconds,
+/// without constructing any boost::posix_time objects.
+class EpochClock {
+ public:
+  enum Source {
+    /// CLOCK_REALTIME, equivalent to microsec_clock::universal_time().
+    kRealtime,
+
+    /// CLOCK_REALTIME_COARSE.  This is much cheaper to read, but only
+    /// advances once per kernel tick, typically 1-4ms.
+    kRealtimeCoarse,
+
+    /// CLOCK_MONOTONIC, offset to the epoch once at construction.
+    /// Values never go backwards, but do not follow adjustments to
+    /// the system clock made after construction.
+    kMonotonic,
+  };
+
+  EpochClock(Source source = kRealtime) : source_(source) {
+    if (source_ == kMonotonic) {
+      offset_us_ = Read(CLOCK_REALTIME) - Read(CLOCK_MONOTONIC);
+    }
+  }
+
+  int64_t now_us() const {
+    switch (source_) {
+      case kRealtime: {
+        return Read(CLOCK_REALTIME);
+      }
+      case kRealtimeCoarse: {
+        return Read(CLOCK_REALTIME_COARSE);
+      }
+      case kMonotonic: {
+        return Read(CLOCK_MONOTONIC) + offset_us_;
+      }
+    }
+    return Read(CLOCK_REALTIME);
+  }
+
+  Source source() const { return source_; }
+
+ private:
+  static int64_t Read(clockid_t clock_id) {
+    struct timespec ts = {};
+    ::clock_gettime(clock_id, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+  }
+
+  const Source source_;
+  int64_t offset_us_ = 0;
+};
+
+}
+}
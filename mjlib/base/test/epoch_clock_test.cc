@@ -0,0 +1,45 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mjlib/base/epoch_clock.h"
+
+#include <cstdlib>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/time_conversions.h"
+
+namespace base = mjlib::base;
+
+BOOST_AUTO_TEST_CASE(EpochClockSources) {
+  const int64_t reference = base::ConvertPtimeToEpochMicroseconds(
+      boost::posix_time::microsec_clock::universal_time());
+
+  for (auto source : { base::EpochClock::kRealtime,
+                       base::EpochClock::kRealtimeCoarse,
+                       base::EpochClock::kMonotonic }) {
+    base::EpochClock dut{source};
+    BOOST_TEST(dut.source() == source);
+
+    const auto first = dut.now_us();
+    // All sources should agree with the system time to within a
+    // generous margin.
+    BOOST_TEST(std::abs(first - reference) < 1000000);
+
+    const auto second = dut.now_us();
+    BOOST_TEST(second >= first);
+  }
+}
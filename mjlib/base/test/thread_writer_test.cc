@@ -14,6 +14,8 @@
 
 #include "mjlib/base/thread_writer.h"
 
+#include <sys/stat.h>
+
 #include <sstream>
 
 #include <boost/filesystem.hpp>
@@ -46,3 +48,35 @@ BOOST_AUTO_TEST_CASE(BasicThreadWriterTest) {
   ostr << inf.rdbuf();
   BOOST_TEST(ostr.str() == "testmore");
 }
+
+BOOST_AUTO_TEST_CASE(ThreadWriterPreallocateSync) {
+  // Neither preallocation nor write-behind should change the
+  // contents or apparent size of the file.
+  mjlib::base::TemporaryFile temp;
+  std::string expected;
+  {
+    ThreadWriter::Options options;
+    options.preallocate_size = 1 << 20;
+    options.sync_size = 16;
+    ThreadWriter dut{temp.native(), options};
+    for (int i = 0; i < 100; i++) {
+      auto buf = std::make_unique<ThreadWriter::OStream>();
+      const std::string data = "data" + std::to_string(i);
+      buf->write(data);
+      expected += data;
+      dut.Write(std::move(buf));
+    }
+  }
+
+  BOOST_TEST(fs::file_size(temp.native()) == expected.size());
+
+  // The unused reservation is released once the writer is closed.
+  struct stat info = {};
+  BOOST_TEST_REQUIRE(::stat(temp.native().c_str(), &info) == 0);
+  BOOST_TEST(info.st_blocks * 512 < (1 << 19));
+
+  std::ifstream inf(temp.native());
+  std::ostringstream ostr;
+  ostr << inf.rdbuf();
+  BOOST_TEST(ostr.str() == expected);
+}
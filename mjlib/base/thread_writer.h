@@ -16,6 +16,7 @@
 
 #include <fcntl.h>
 #include <signal.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <atomic>
@@ -77,6 +78,19 @@ class ThreadWriter : boost::noncopyable {
     double flush_timeout_s = 1.0;
     Reclaimer* reclaimer = nullptr;
 
+    /// If non-zero, keep at least this many bytes of disk space
+    /// reserved beyond the current write position using
+    /// fallocate(FALLOC_FL_KEEP_SIZE).  The apparent size of the file
+    /// is unchanged, so a crashed log has no trailing garbage.  Any
+    /// unused reservation is released when the writer is destroyed.
+    int64_t preallocate_size = 0;
+
+    /// If non-zero, each time this many bytes have been written, start
+    /// write-back of them with sync_file_range, and wait for the
+    /// previous range to complete.  This keeps dirty data bounded so
+    /// that durability does not require large fsync stalls.
+    int64_t sync_size = 0;
+
     Options() {}
   };
 
@@ -216,6 +230,7 @@ class ThreadWriter : boost::noncopyable {
         if (done_) {
           RunWork();
           HandleFlush();
+          ReleasePreallocation();
           break;
         }
         if (flush_) {
@@ -296,6 +311,9 @@ class ThreadWriter : boost::noncopyable {
 
     WriteFront();
 
+    MaybePreallocate();
+    MaybeSyncRange();
+
     // At block boundaries, let the OS know that we don't plan on
     // using this data anytime soon so as to not fill up the page
     // cache.
@@ -315,6 +333,67 @@ class ThreadWriter : boost::noncopyable {
     }
   }
 
+  void MaybePreallocate() {
+#ifdef __linux__
+    if (options_.preallocate_size <= 0) { return; }
+
+    // Only extend once we have consumed half of the reservation, so
+    // as to make few calls.
+    if ((preallocated_ - child_offset_) > options_.preallocate_size / 2) {
+      return;
+    }
+
+    const int64_t target = child_offset_ + options_.preallocate_size;
+    // Failure here, for instance from a file system without support,
+    // just means we get no benefit.
+    ::fallocate(fileno(fd_), FALLOC_FL_KEEP_SIZE,
+                preallocated_, target - preallocated_);
+    preallocated_ = target;
+#endif
+  }
+
+  void ReleasePreallocation() {
+#ifdef __linux__
+    if (preallocated_ <= child_offset_) { return; }
+
+    // Truncating to the current size discards the blocks reserved
+    // beyond the end of the file, which would otherwise remain
+    // allocated after it is closed.
+    const int fd = fileno(fd_);
+    struct stat info = {};
+    if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+      if (::ftruncate(fd, info.st_size) != 0) {
+        // As with fallocate, failure just means the space is not
+        // released.
+      }
+    }
+    preallocated_ = child_offset_;
+#endif
+  }
+
+  void MaybeSyncRange() {
+#ifdef __linux__
+    if (options_.sync_size <= 0) { return; }
+    if ((child_offset_ - synced_) < options_.sync_size) { return; }
+
+    // The data has to be in the kernel before it can be written back.
+    ::fflush(fd_);
+
+    const int fd = fileno(fd_);
+    ::sync_file_range(fd, synced_, child_offset_ - synced_,
+                      SYNC_FILE_RANGE_WRITE);
+    if (synced_ > previous_synced_) {
+      // This should normally have completed long ago.
+      ::sync_file_range(fd, previous_synced_, synced_ - previous_synced_,
+                        SYNC_FILE_RANGE_WAIT_BEFORE |
+                        SYNC_FILE_RANGE_WRITE |
+                        SYNC_FILE_RANGE_WAIT_AFTER);
+    }
+    previous_synced_ = synced_;
+    synced_ = child_offset_;
+#endif
+  }
+
   void WriteAll() {
     BOOST_ASSERT(std::this_thread::get_id() == parent_id_);
     while (!data_.empty()) {
@@ -364,6 +443,9 @@ class ThreadWriter : boost::noncopyable {
   // Only accessed from child thread.
   int64_t child_offset_ = 0;
   int64_t last_fadvise_ = 0;
+  int64_t preallocated_ = 0;
+  int64_t synced_ = 0;
+  int64_t previous_synced_ = 0;
   char buf_[65536] = {};
 
   // All threads.
@@ -45,6 +45,13 @@ class DebugDeadlineService {
     return current_time_;
   }
 
+  /// @return the earliest time at which a pending timer expires, or
+  /// not_a_date_time if there are none.
+  boost::posix_time::ptime next_expiration() const {
+    if (queue_.empty()) { return {}; }
+    return queue_.begin()->first;
+  }
+
   void SetTime(boost::posix_time::ptime new_time) {
     current_time_ = new_time;
 
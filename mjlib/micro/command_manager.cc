@@ -18,7 +18,7 @@
 #include "mjlib/base/tokenizer.h"
 
 #include "mjlib/micro/async_read.h"
-#include "mjlib/micro/pool_map.h"
+#include "mjlib/micro/pool_hash_map.h"
 
 namespace mjlib {
 namespace micro {
@@ -150,7 +150,7 @@ class CommandManager::Impl {
   AsyncExclusive<AsyncWriteStream>* const write_stream_;
   const Options options_;
 
-  using Registry = PoolMap<std::string_view, Item>;
+  using Registry = PoolHashMap<std::string_view, Item>;
   Registry registry_;
   bool write_outstanding_ = false;
 
@@ -28,7 +28,7 @@
 #include "mjlib/telemetry/format.h"
 
 #include "mjlib/micro/flash.h"
-#include "mjlib/micro/pool_map.h"
+#include "mjlib/micro/pool_hash_map.h"
 
 /// @file
 ///
@@ -108,7 +108,7 @@ class PersistentConfig::Impl {
     bool enumerate = true;
   };
 
-  using ElementMap = PoolMap<std::string_view, Element>;
+  using ElementMap = PoolHashMap<std::string_view, Element>;
 
   void Enumerate(const std::string_view& maybe_field,
                  const CommandManager::Response& response) {
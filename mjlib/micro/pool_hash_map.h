@@ -0,0 +1,148 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+#include "mjlib/base/assert.h"
+
+#include "pool_ptr.h"
+
+namespace mjlib {
+namespace micro {
+
+/// A drop-in replacement for PoolMap with constant time lookup.
+///
+/// Like PoolMap, all memory is allocated from a Pool at construction,
+/// elements are stored contiguously in insertion order and may be
+/// accessed by index, and their addresses never change.  In addition,
+/// an open addressing table of indices, at most half full, is used to
+/// find keys without comparing against every element.
+template <typename Key, typename Value,
+          class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>>
+class PoolHashMap {
+ public:
+  using Node = std::pair<Key, Value>;
+
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = Node;
+
+  using iterator = Node*;
+  using const_iterator = const Node*;
+
+  PoolHashMap(Pool* pool, size_t max_elements)
+      : max_size_(max_elements),
+        table_size_(TableSize(max_elements)) {
+    MJ_ASSERT(max_elements < kEmpty);
+
+    data_ = static_cast<Node*>(pool->Allocate(sizeof(Node) * max_elements,
+                                              alignof(Node)));
+    for (size_t i = 0; i < max_elements; i++) {
+      ::new (data_ + i) Node{};
+    }
+
+    table_ = static_cast<uint16_t*>(
+        pool->Allocate(sizeof(uint16_t) * table_size_, alignof(uint16_t)));
+    for (size_t i = 0; i < table_size_; i++) {
+      table_[i] = kEmpty;
+    }
+  }
+
+  ~PoolHashMap() {
+    for (size_t i = 0; i < max_size_; i++) {
+      (&data_[i])->~Node();
+    }
+  }
+
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  Node& operator[](size_t i) {
+    return data_[i];
+  }
+
+  const Node& operator[](size_t i) const {
+    return data_[i];
+  }
+
+  std::pair<iterator, bool> insert(const value_type& value) {
+    const size_t slot = FindSlot(value.first);
+    if (table_[slot] != kEmpty) {
+      return std::make_pair(data_ + table_[slot], false);
+    }
+
+    MJ_ASSERT(size_ < max_size_);
+    table_[slot] = static_cast<uint16_t>(size_);
+    Node* const result = data_ + size_;
+    size_++;
+    *result = value;
+    return std::make_pair(result, true);
+  }
+
+  iterator find(const Key& key) {
+    const size_t slot = FindSlot(key);
+    return table_[slot] == kEmpty ? end() : (data_ + table_[slot]);
+  }
+
+  const_iterator find(const Key& key) const {
+    const size_t slot = FindSlot(key);
+    return table_[slot] == kEmpty ? end() : (data_ + table_[slot]);
+  }
+
+  bool contains(const Key& key) const {
+    return table_[FindSlot(key)] != kEmpty;
+  }
+
+ private:
+  static constexpr uint16_t kEmpty = 0xffff;
+
+  static size_t TableSize(size_t max_elements) {
+    size_t result = 1;
+    while (result < 2 * max_elements) { result <<= 1; }
+    return result;
+  }
+
+  // Return the slot which holds @p key, or the empty slot where it
+  // would be inserted.  Since the table is never more than half
+  // full, one always exists.
+  size_t FindSlot(const Key& key) const {
+    const size_t mask = table_size_ - 1;
+    KeyEqual equal;
+    size_t slot = Hash()(key) & mask;
+    while (table_[slot] != kEmpty && !equal(data_[table_[slot]].first, key)) {
+      slot = (slot + 1) & mask;
+    }
+    return slot;
+  }
+
+  Node* data_;
+  uint16_t* table_;
+  size_t size_ = 0;
+  const size_t max_size_;
+  const size_t table_size_;
+};
+
+}
+}
@@ -14,6 +14,9 @@
 
 #include "mjlib/micro/telemetry_manager.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 
 #include "mjlib/base/buffer_stream.h"
@@ -22,7 +25,8 @@
 
 #include "mjlib/telemetry/format.h"
 
-#include "mjlib/micro/pool_map.h"
+#include "mjlib/micro/pool_array.h"
+#include "mjlib/micro/pool_hash_map.h"
 
 namespace mjlib {
 namespace micro {
@@ -32,8 +36,50 @@ namespace {
 // emitted per-update.
 constexpr int kMinRateMs = 10;
 
-// TODO(jpieper): Expose this as a constructor time option.
-constexpr size_t kMaxElements = 16;
+/// Computes a 32 bit FNV-1a hash of everything written to it.
+class HashWriteStream : public base::WriteStream {
+ public:
+  void write(const std::string_view& data) override {
+    for (const char c : data) {
+      hash_ = (hash_ ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+  }
+
+  uint32_t hash() const { return hash_; }
+
+ private:
+  uint32_t hash_ = 2166136261u;
+};
+
+/// Writes into a fixed buffer, noting rather than asserting if it
+/// would overflow.
+class BoundedWriteStream : public base::WriteStream {
+ public:
+  BoundedWriteStream(const base::string_span& buffer) : buffer_(buffer) {}
+
+  void write(const std::string_view& data) override {
+    if (overflow_ ||
+        static_cast<std::ptrdiff_t>(offset_ + data.size()) > buffer_.size()) {
+      overflow_ = true;
+      return;
+    }
+    std::copy(data.begin(), data.end(), buffer_.data() + offset_);
+    offset_ += data.size();
+  }
+
+  void reset(size_t offset) {
+    offset_ = offset;
+    overflow_ = false;
+  }
+
+  size_t offset() const { return offset_; }
+  bool overflow() const { return overflow_; }
+
+ private:
+  const base::string_span buffer_;
+  size_t offset_ = 0;
+  bool overflow_ = false;
+};
 }
 
 class TelemetryManager::Impl {
@@ -41,20 +87,36 @@ class TelemetryManager::Impl {
   struct Element {
     std::string_view name;
     int rate = 0;
-    int next = 1;
     bool to_send = false;
+
+    // When rate > 1, the element is in the schedule heap at this
+    // position, and is next due at this time.
+    int heap_index = -1;
+    uint32_t due = 0;
+
     bool text = false;
+
+    // If non-zero, emissions whose serialized form is unchanged from
+    // the previous one are skipped, except that at most this many
+    // periods will pass without one.
+    int refresh = 0;
+    int unchanged = 0;
+    bool hash_valid = false;
+    uint32_t last_hash = 0;
+
     SerializableHandlerBase* base = nullptr;
   };
 
-  using ElementPool = PoolMap<std::string_view, Element>;
+  using ElementPool = PoolHashMap<std::string_view, Element>;
 
   Impl(Pool* pool, CommandManager* command_manager,
        AsyncExclusive<AsyncWriteStream>* write_stream,
-       mjlib::base::string_span output_buffer)
+       mjlib::base::string_span output_buffer,
+       const Options& options)
       : pool_(pool),
         write_stream_(write_stream),
-        elements_(pool, kMaxElements),
+        elements_(pool, options.max_elements),
+        schedule_(pool, options.max_elements),
         output_buffer_(output_buffer) {
     command_manager->Register("tel", [this](auto&& name, auto&& response) {
         this->Command(name, response);
@@ -75,6 +137,8 @@ class TelemetryManager::Impl {
       Rate(tokenizer.remaining(), response);
     } else if (cmd == "fmt") {
       Format(tokenizer.remaining(), response);
+    } else if (cmd == "delta") {
+      Delta(tokenizer.remaining(), response);
     } else if (cmd == "stop") {
       Stop(response);
     } else if (cmd == "text") {
@@ -89,28 +153,104 @@ class TelemetryManager::Impl {
     // as ready to update.  If we're not locked, then try to start
     // sending it out now.
     if (element_it->second.rate == 1) {
-      element_it->second.to_send = true;
+      SetToSend(&element_it->second);
       MaybeStartSend();
     }
   }
 
   void PollMillisecond() {
-    // Iterate over all of our elements, updating their next counters.
-    for (auto& item_pair : elements_) {
-      auto& element = item_pair.second;
-      if (element.rate > 1 && element.next > 0) {
-        element.next--;
-        if (element.next == 0) {
-          element.to_send = true;
-          element.next = element.rate;
-        }
-      }
+    now_++;
+
+    // Only the elements which are due need be touched.
+    while (schedule_size_ > 0 &&
+           static_cast<int32_t>(schedule_[0]->due - now_) <= 0) {
+      auto* const element = schedule_[0];
+      SetToSend(element);
+      element->due += element->rate;
+      SiftDown(0);
     }
     MaybeStartSend();
   }
 
+  // The schedule is a binary min-heap of the periodic elements,
+  // ordered by their due time.
+
+  static bool Before(const Element* lhs, const Element* rhs) {
+    return static_cast<int32_t>(lhs->due - rhs->due) < 0;
+  }
+
+  void Place(size_t index, Element* element) {
+    schedule_[index] = element;
+    element->heap_index = static_cast<int>(index);
+  }
+
+  void SiftUp(size_t index) {
+    auto* const element = schedule_[index];
+    while (index > 0) {
+      const size_t parent = (index - 1) / 2;
+      if (!Before(element, schedule_[parent])) { break; }
+      Place(index, schedule_[parent]);
+      index = parent;
+    }
+    Place(index, element);
+  }
+
+  void SiftDown(size_t index) {
+    auto* const element = schedule_[index];
+    while (true) {
+      size_t child = 2 * index + 1;
+      if (child >= schedule_size_) { break; }
+      if ((child + 1) < schedule_size_ &&
+          Before(schedule_[child + 1], schedule_[child])) {
+        child++;
+      }
+      if (!Before(schedule_[child], element)) { break; }
+      Place(index, schedule_[child]);
+      index = child;
+    }
+    Place(index, element);
+  }
+
+  void Unschedule(Element* element) {
+    if (element->heap_index < 0) { return; }
+
+    const size_t index = element->heap_index;
+    element->heap_index = -1;
+    schedule_size_--;
+    if (index == schedule_size_) { return; }
+
+    // Fill the hole with the last entry, which may need to move in
+    // either direction.
+    auto* const moved = schedule_[schedule_size_];
+    Place(index, moved);
+    SiftUp(index);
+    SiftDown(moved->heap_index);
+  }
+
+  void Schedule(Element* element) {
+    Unschedule(element);
+    element->due = now_ + element->rate;
+    const size_t index = schedule_size_++;
+    schedule_[index] = element;
+    SiftUp(index);
+  }
+
+  void SetToSend(Element* element) {
+    if (element->to_send) { return; }
+    element->to_send = true;
+    pending_++;
+  }
+
+  void ClearToSend(Element* element) {
+    if (!element->to_send) { return; }
+    element->to_send = false;
+    pending_--;
+  }
+
   void MaybeStartSend() {
-    if (outstanding_write_) { return; }
+    // The scan below is linear in the number of elements, so it is
+    // only made when something is waiting.
+    if (outstanding_write_ || pending_ == 0) { return; }
 
     // Look to see if something is good to send.
     //
@@ -121,11 +261,15 @@ class TelemetryManager::Impl {
       auto& element = elements_[to_check].second;
 
       if (element.to_send) {
-        element.to_send = false;
+        ClearToSend(&element);
+        if (element.refresh != 0 && Unchanged(&element, Hash(&element))) {
+          continue;
+        }
+
         outstanding_write_ = true;
 
         write_stream_->AsyncStart(
-            [this, eptr = &element]
+            [this, to_check]
             (AsyncWriteStream* stream, VoidCallback release) {
               this->write_release_ = release;
               ErrorCallback actual_release = [this](error_code) {
@@ -137,7 +281,7 @@ class TelemetryManager::Impl {
                 copy();
               };
               CommandManager::Response response{stream, actual_release};
-              this->EmitData(eptr, response);
+              this->EmitBatch(to_check, response);
             });
         last_sent_ = to_check;
         return;
@@ -145,6 +289,39 @@ class TelemetryManager::Impl {
     }
   }
 
+  static uint32_t Hash(const std::string_view& data) {
+    HashWriteStream hash_stream;
+    hash_stream.write(data);
+    return hash_stream.hash();
+  }
+
+  static uint32_t Hash(Element* element) {
+    HashWriteStream hash_stream;
+    element->base->WriteBinary(hash_stream);
+    return hash_stream.hash();
+  }
+
+  // @return true, counting a skipped period, if a serialized form
+  // hashing to @p hash may be suppressed as unchanged from the one
+  // last sent.
+  bool Unchanged(Element* element, uint32_t hash) {
+    if (!element->hash_valid || hash != element->last_hash ||
+        (element->unchanged + 1) >= element->refresh) {
+      return false;
+    }
+    element->unchanged++;
+    return true;
+  }
+
+  // Record that a serialized form hashing to @p hash was sent.  This
+  // must be the form actually written, as the element may have
+  // changed since the send was decided.
+  void Sent(Element* element, uint32_t hash) {
+    element->hash_valid = true;
+    element->last_hash = hash;
+    element->unchanged = 0;
+  }
+
   void Get(const std::string_view& name,
            const CommandManager::Response& response) {
     const auto it = elements_.find(name);
@@ -156,6 +333,62 @@ class TelemetryManager::Impl {
     EmitData(&it->second, response);
   }
 
+  // Emit the element at @p first, along with every other binary
+  // element which is due and fits in the output buffer, as a single
+  // write.  Each keeps its own framing, so the result is identical to
+  // that of separate writes.
+  void EmitBatch(size_t first, const CommandManager::Response& response) {
+    auto& first_element = elements_[first].second;
+    if (first_element.text) {
+      if (first_element.refresh != 0) {
+        Sent(&first_element, Hash(&first_element));
+      }
+      Enumerate(&first_element, response);
+      return;
+    }
+
+    BoundedWriteStream ostream{output_buffer_};
+    std::string_view payload;
+    const bool fit = AppendRecord(
+        &ostream, "emit ", &first_element, WriteData, &payload);
+    MJ_ASSERT(fit);
+    if (first_element.refresh != 0) {
+      Sent(&first_element, Hash(payload));
+    }
+
+    for (size_t i = 1; i < elements_.size(); i++) {
+      const size_t to_check = (first + i) % elements_.size();
+      auto& element = elements_[to_check].second;
+      if (!element.to_send || element.text) { continue; }
+
+      // This will go out with the next write if it does not fit.
+      const size_t start = ostream.offset();
+      if (!AppendRecord(&ostream, "emit ", &element, WriteData, &payload)) {
+        break;
+      }
+
+      ClearToSend(&element);
+      if (element.refresh != 0) {
+        const uint32_t hash = Hash(payload);
+        if (Unchanged(&element, hash)) {
+          ostream.reset(start);
+          continue;
+        }
+        Sent(&element, hash);
+      }
+      last_sent_ = to_check;
+    }
+
+    AsyncWrite(
+        *response.stream,
+        std::string_view(output_buffer_.data(), ostream.offset()),
+        response.callback);
+  }
+
+  static void WriteData(Element* element, base::WriteStream* stream) {
+    element->base->WriteBinary(*stream);
+  }
+
   void Enumerate(Element* element,
                  const CommandManager::Response& response) {
     current_response_ = response;
@@ -175,13 +408,7 @@ class TelemetryManager::Impl {
     if (element->text) {
       Enumerate(element, response);
     } else {
-      Emit(
-          "emit ",
-          element,
-          [](Element* element, base::WriteStream* stream) {
-            element->base->WriteBinary(*stream);
-          },
-          response);
+      Emit("emit ", element, WriteData, response);
     }
   }
 
@@ -191,26 +418,53 @@ class TelemetryManager::Impl {
             Element* element,
             WorkFunction work,
             const CommandManager::Response& response) {
-    base::BufferWriteStream ostream{output_buffer_};
-    ostream.write(prefix);
-    ostream.write(element->name);
-    ostream.write("\r\n");
+    BoundedWriteStream ostream{output_buffer_};
+    const bool fit = AppendRecord(&ostream, prefix, element, work);
+    MJ_ASSERT(fit);
 
-    char* const size_position = output_buffer_.data() + ostream.offset();
-    ostream.skip(sizeof(uint32_t));
+    AsyncWrite(
+        *response.stream,
+        std::string_view(output_buffer_.data(), ostream.offset()),
+        response.callback);
+  }
 
-    work(element, &ostream);
+  // Append one framed record to @p ostream.  If @p payload is
+  // non-null, it is set to the serialized data within the record.
+  //
+  // @return false, leaving the stream unchanged, if it did not fit
+  bool AppendRecord(BoundedWriteStream* ostream,
+                    const std::string_view& prefix,
+                    Element* element,
+                    WorkFunction work,
+                    std::string_view* payload = nullptr) {
+    const size_t start = ostream->offset();
+    ostream->write(prefix);
+    ostream->write(element->name);
+    ostream->write("\r\n");
+
+    const size_t size_offset = ostream->offset();
+    ostream->write(std::string_view("\0\0\0\0", sizeof(uint32_t)));
+
+    work(element, ostream);
+
+    if (ostream->overflow()) {
+      ostream->reset(start);
+      return false;
+    }
 
-    base::BufferWriteStream size_stream({size_position, sizeof(uint32_t)});
+    base::BufferWriteStream size_stream(
+        {output_buffer_.data() + size_offset, sizeof(uint32_t)});
     mjlib::telemetry::WriteStream tstream(size_stream);
     tstream.Write(static_cast<uint32_t>(
-                      ostream.offset() + output_buffer_.data() -
-                      (size_position + sizeof(uint32_t))));
+                      ostream->offset() - (size_offset + sizeof(uint32_t))));
 
-    AsyncWrite(
-        *response.stream,
-        std::string_view(output_buffer_.data(), ostream.offset()),
-        response.callback);
+    if (payload) {
+      const size_t payload_offset = size_offset + sizeof(uint32_t);
+      *payload = std::string_view(output_buffer_.data() + payload_offset,
+                                  ostream->offset() - payload_offset);
+    }
+
+    return true;
   }
 
   void List(const CommandManager::Response& response) {
@@ -290,13 +544,14 @@ class TelemetryManager::Impl {
     std::copy(rate_str.begin(), rate_str.end(), buffer);
     long rate = strtol(buffer, nullptr, 0);
     element.rate = rate;
-    if (rate == 0) {
-      element.next = 1;
+    if (rate <= 0) {
+      element.rate = 0;
+      Unschedule(&element);
     } else if (rate < kMinRateMs) {
       element.rate = 1;
-      element.next = 1;
+      Unschedule(&element);
     } else {
-      element.next = rate;
+      Schedule(&element);
     }
 
     WriteOK(response);
@@ -325,13 +580,41 @@ class TelemetryManager::Impl {
     WriteOK(response);
   }
 
+  void Delta(const std::string_view& command,
+             const CommandManager::Response& response) {
+    base::Tokenizer tokenizer(command, " ");
+    auto name = tokenizer.next();
+    auto refresh_str = tokenizer.next();
+
+    const auto element_it = elements_.find(name);
+    if (element_it == elements_.end()) {
+      WriteMessage("ERR unknown name\r\n", response);
+      return;
+    }
+
+    auto& element = element_it->second;
+
+    char buffer[24] = {};
+    MJ_ASSERT(refresh_str.size() < (sizeof(buffer) - 1));
+    std::copy(refresh_str.begin(), refresh_str.end(), buffer);
+    const long refresh = strtol(buffer, nullptr, 0);
+    element.refresh = refresh < 0 ? 0 : refresh;
+    element.unchanged = 0;
+    element.hash_valid = false;
+
+    WriteOK(response);
+  }
+
   void Stop(const CommandManager::Response& response) {
     for (auto& item_pair : elements_) {
       auto& element = item_pair.second;
 
       element.to_send = false;
       element.rate = 0;
+      element.heap_index = -1;
     }
+    schedule_size_ = 0;
+    pending_ = 0;
 
     WriteOK(response);
   }
@@ -362,7 +645,10 @@ class TelemetryManager::Impl {
   Pool* const pool_;
   AsyncExclusive<AsyncWriteStream>* const write_stream_;
 
-  PoolMap<std::string_view, Element> elements_;
+  PoolHashMap<std::string_view, Element> elements_;
+  PoolArray<Element*> schedule_;
+  size_t schedule_size_ = 0;
+  uint32_t now_ = 0;
 
   CommandManager::Response current_response_;
   mjlib::base::string_span output_buffer_;
@@ -370,6 +656,8 @@ class TelemetryManager::Impl {
   detail::EnumerateArchive::Context enumerate_context_;
 
   bool outstanding_write_ = false;
+  // The number of elements with to_send set.
+  size_t pending_ = 0;
   VoidCallback write_release_;
   size_t last_sent_ = 0;
 };
@@ -377,8 +665,10 @@ class TelemetryManager::Impl {
 TelemetryManager::TelemetryManager(
     Pool* pool, CommandManager* command_manager,
     AsyncExclusive<AsyncWriteStream>* write_stream,
-    mjlib::base::string_span output_buffer)
-    : impl_(pool, pool, command_manager, write_stream, output_buffer) {}
+    mjlib::base::string_span output_buffer,
+    const Options& options)
+    : impl_(pool, pool, command_manager, write_stream, output_buffer,
+            options) {}
 
 TelemetryManager::~TelemetryManager() {}
 
@@ -29,10 +29,18 @@ namespace micro {
 /// serializable structures.
 class TelemetryManager {
  public:
+  struct Options {
+    /// The maximum number of structures which may be registered.
+    size_t max_elements = 16;
+
+    Options() {}
+  };
+
   TelemetryManager(Pool*,
                    CommandManager*,
                    AsyncExclusive<AsyncWriteStream>* write_stream,
-                   mjlib::base::string_span output_buffer);
+                   mjlib::base::string_span output_buffer,
+                   const Options& = Options());
   ~TelemetryManager();
 
   /// Associate the serializable with the given name.
@@ -49,7 +57,9 @@ class TelemetryManager {
     return RegisterDetail(name, concrete.get());
   }
 
-  /// This should be invoked every millisecond.
+  /// This should be invoked every millisecond.  When nothing is due
+  /// to be sent, its cost does not depend upon the number of
+  /// registered elements.
   void PollMillisecond();
 
  private:
@@ -0,0 +1,100 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/micro/pool_hash_map.h"
+
+#include <string>
+#include <string_view>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjlib::micro;
+
+BOOST_AUTO_TEST_CASE(BasicPoolHashMap) {
+  SizedPool pool;
+  PoolHashMap<int, double> dut(&pool, 16);
+
+  BOOST_TEST(dut.size() == 0);
+  BOOST_TEST(dut.contains(1) == false);
+
+  {
+    const auto result = dut.insert({3, 6.0});
+    BOOST_TEST(dut.size() == 1);
+    BOOST_TEST(result.second == true);
+    BOOST_TEST(result.first->first == 3);
+    BOOST_TEST(result.first->second == 6.0);
+    BOOST_TEST(result.first != dut.end());
+    BOOST_TEST(dut[0].first == 3);
+    BOOST_TEST(dut[0].second == 6.0);
+  }
+
+  {
+    const auto result = dut.insert({3, 7.0});
+    BOOST_TEST(dut.size() == 1);
+    BOOST_TEST(result.second == false);
+    BOOST_TEST(result.first->first == 3);
+    BOOST_TEST(result.first->second == 6.0);
+  }
+
+  {
+    const auto it = dut.find(3);
+    BOOST_TEST(it != dut.end());
+    BOOST_TEST(it->first == 3);
+    BOOST_TEST(it->second == 6.0);
+  }
+
+  {
+    const auto it = dut.find(1);
+    BOOST_TEST(it == dut.end());
+  }
+
+  {
+    const auto result = dut.insert({10, 1.0});
+    BOOST_TEST(dut.size() == 2);
+    BOOST_TEST(result.second == true);
+
+    BOOST_TEST(dut.contains(3) == true);
+    BOOST_TEST(dut.contains(10) == true);
+    BOOST_TEST(dut.contains(11) == false);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(PoolHashMapFull) {
+  SizedPool pool;
+
+  constexpr int kCount = 50;
+  std::string names[kCount];
+  for (int i = 0; i < kCount; i++) {
+    names[i] = "name" + std::to_string(i);
+  }
+
+  PoolHashMap<std::string_view, int> dut(&pool, kCount);
+  for (int i = 0; i < kCount; i++) {
+    const auto result = dut.insert({names[i], i});
+    BOOST_TEST(result.second == true);
+  }
+  BOOST_TEST(dut.size() == kCount);
+
+  // Elements remain in insertion order, and at stable addresses.
+  for (int i = 0; i < kCount; i++) {
+    BOOST_TEST(dut[i].first == names[i]);
+    const auto it = dut.find(names[i]);
+    BOOST_TEST_REQUIRE(it != dut.end());
+    BOOST_TEST(it == &dut[i]);
+    BOOST_TEST(it->second == i);
+  }
+
+  BOOST_TEST(dut.contains("name50") == false);
+  BOOST_TEST(dut.insert({names[7], 0}).first == &dut[7]);
+}
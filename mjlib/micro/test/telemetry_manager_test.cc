@@ -14,6 +14,8 @@
 
 #include "mjlib/micro/telemetry_manager.h"
 
+#include <string>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/test/auto_unit_test.hpp>
 
@@ -84,6 +86,88 @@ BOOST_FIXTURE_TEST_CASE(TelemetryManagerRate, Fixture) {
   ExpectResponse("");
 }
 
+BOOST_FIXTURE_TEST_CASE(TelemetryManagerDelta, Fixture) {
+  Command("tel delta unknown 5\n");
+  ExpectResponse("ERR unknown name\r\n");
+
+  Command("tel rate my_data 10\n");
+  ExpectResponse("OK\r\n");
+  Command("tel delta my_data 5\n");
+  ExpectResponse("OK\r\n");
+
+  auto poll = [&](int count) {
+    for (int i = 0; i < count; i++) {
+      dut.PollMillisecond();
+      event_queue.Poll();
+    }
+  };
+
+  // The first emission is always sent.
+  poll(10);
+  ExpectResponse(str("emit my_data\r\n\x04\x00\x00\x00\x00\x00\x00\x00"));
+
+  // Unchanged data is suppressed until the refresh period.
+  poll(40);
+  ExpectResponse("");
+  poll(10);
+  ExpectResponse(str("emit my_data\r\n\x04\x00\x00\x00\x00\x00\x00\x00"));
+
+  // A change is sent on the next period.
+  my_data.value = 3;
+  poll(10);
+  ExpectResponse(str("emit my_data\r\n\x04\x00\x00\x00\x03\x00\x00\x00"));
+  poll(10);
+  ExpectResponse("");
+
+  // An explicit get is never suppressed.
+  Command("tel get my_data\n");
+  ExpectResponse(str("emit my_data\r\n\x04\x00\x00\x00\x03\x00\x00\x00"));
+
+  // And disabling delta mode resumes every emission.
+  Command("tel delta my_data 0\n");
+  ExpectResponse("OK\r\n");
+  poll(20);
+  ExpectResponse(
+      str("emit my_data\r\n\x04\x00\x00\x00\x03\x00\x00\x00"
+          "emit my_data\r\n\x04\x00\x00\x00\x03\x00\x00\x00"));
+}
+
+BOOST_FIXTURE_TEST_CASE(TelemetryManagerDeltaDeferred, Fixture) {
+  Command("tel rate my_data 10\n");
+  ExpectResponse("OK\r\n");
+  Command("tel delta my_data 5\n");
+  ExpectResponse("OK\r\n");
+
+  auto poll = [&](int count) {
+    for (int i = 0; i < count; i++) {
+      dut.PollMillisecond();
+      event_queue.Poll();
+    }
+  };
+
+  poll(10);
+  ExpectResponse(str("emit my_data\r\n\x04\x00\x00\x00\x00\x00\x00\x00"));
+
+  // Hold the stream, so that the next send is decided while the
+  // value is 3, but not written until it has changed back.
+  VoidCallback release;
+  write_stream.AsyncStart([&](AsyncWriteStream*, VoidCallback callback) {
+      release = callback;
+    });
+  my_data.value = 3;
+  poll(10);
+  ExpectResponse("");
+  my_data.value = 0;
+  release();
+  event_queue.Poll();
+  ExpectResponse(str("emit my_data\r\n\x04\x00\x00\x00\x00\x00\x00\x00"));
+
+  // What was written was 0, so a change to 3 must still be sent.
+  my_data.value = 3;
+  poll(10);
+  ExpectResponse(str("emit my_data\r\n\x04\x00\x00\x00\x03\x00\x00\x00"));
+}
+
 BOOST_FIXTURE_TEST_CASE(TelemetryManagerFmt, Fixture) {
   Command("tel fmt my_data 1\n");
   ExpectResponse("OK\r\n");
@@ -129,6 +213,26 @@ std::map<std::string, int> CountReceipts(std::string data) {
 }
 }
 
+BOOST_FIXTURE_TEST_CASE(TelemetryManagerBatch, Fixture) {
+  Command("tel rate my_data 20\n");
+  ExpectResponse("OK\r\n");
+  Command("tel rate other_data 20\n");
+  ExpectResponse("OK\r\n");
+
+  for (int i = 0; i < 19; i++) {
+    dut.PollMillisecond();
+    event_queue.Poll();
+  }
+  ExpectResponse("");
+
+  // Both are due in the same tick, and should go out together.
+  dut.PollMillisecond();
+  event_queue.Poll();
+  ExpectResponse(
+      str("emit other_data\r\n\x02\x00\x00\x00\x00\x00"
+          "emit my_data\r\n\x04\x00\x00\x00\x00\x00\x00\x00"));
+}
+
 BOOST_FIXTURE_TEST_CASE(TelemetryManagerOverloadTest, Fixture) {
   // When reads are serviced intermittently, we want to make sure that
   // all channels get equal chance to have their data emitted.
@@ -164,7 +268,78 @@ BOOST_FIXTURE_TEST_CASE(TelemetryManagerOverloadTest, Fixture) {
     auto counts = CountReceipts(reader.data_.str());
     reader.data_.str("");
 
-    BOOST_TEST(counts["my_data"] == 3);
-    BOOST_TEST(counts["other_data"] == 3);
+    BOOST_TEST(counts["my_data"] == 4);
+    BOOST_TEST(counts["other_data"] == 4);
+  }
+}
+
+namespace {
+struct ManyFixture : test::CommandManagerFixture {
+  static constexpr int kCount = 40;
+
+  char output_buffer[2048] = {};
+  TelemetryManager dut{&pool, &command_manager, &write_stream, output_buffer,
+                       []() {
+                         TelemetryManager::Options options;
+                         options.max_elements = kCount;
+                         return options;
+                       }()};
+
+  std::string names[kCount];
+  test::MyData data[kCount];
+
+  ManyFixture() {
+    for (int i = 0; i < kCount; i++) {
+      names[i] = "d" + std::to_string(i);
+      dut.Register(names[i], &data[i]);
+    }
+  }
+
+  void Poll(int count) {
+    for (int i = 0; i < count; i++) {
+      dut.PollMillisecond();
+      event_queue.Poll();
+    }
+  }
+};
+}
+
+BOOST_FIXTURE_TEST_CASE(TelemetryManagerManyRates, ManyFixture) {
+  for (int i = 0; i < kCount; i++) {
+    Command("tel rate " + names[i] + " " + std::to_string(10 + i) + "\n");
+    ExpectResponse("OK\r\n");
+  }
+
+  Poll(1000);
+
+  {
+    auto counts = CountReceipts(reader.data_.str());
+    reader.data_.str("");
+    for (int i = 0; i < kCount; i++) {
+      BOOST_TEST_CONTEXT(names[i]) {
+        BOOST_TEST(counts[names[i]] == 1000 / (10 + i));
+      }
+    }
+  }
+
+  // Stopping every other channel should leave the rest undisturbed.
+  for (int i = 0; i < kCount; i += 2) {
+    Command("tel rate " + names[i] + " 0\n");
+    ExpectResponse("OK\r\n");
+  }
+
+  Poll(2000);
+
+  {
+    auto counts = CountReceipts(reader.data_.str());
+    reader.data_.str("");
+    for (int i = 0; i < kCount; i++) {
+      BOOST_TEST_CONTEXT(names[i]) {
+        const int rate = 10 + i;
+        const int expected =
+            (i % 2) == 0 ? 0 : ((3000 / rate) - (1000 / rate));
+        BOOST_TEST(counts[names[i]] == expected);
+      }
+    }
   }
 }
@@ -145,6 +145,10 @@ class BinarySchemaParser::Impl {
       case FT::kFixedArray: {
         result->array_size = stream.ReadVaruint().value();
         result->children.push_back(ReadType(result, stream.base(), name));
+        if (result->children.back()->maybe_fixed_size >= 0) {
+          result->maybe_fixed_size =
+              result->array_size * result->children.back()->maybe_fixed_size;
+        }
         break;
       }
       case FT::kArray:
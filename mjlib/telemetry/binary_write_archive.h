@@ -20,6 +20,7 @@
 
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 
+#include "mjlib/base/assert.h"
 #include "mjlib/base/bytes.h"
 #include "mjlib/base/fast_stream.h"
 #include "mjlib/base/priority_tag.h"
@@ -32,40 +33,48 @@ namespace mjlib {
 namespace telemetry {
 
 /// Emit a binary data serialization from a serializable C++ object.
-class BinaryWriteArchive : public base::VisitArchive<BinaryWriteArchive> {
+///
+/// The 'Sink' is anything accepted by BasicWriteStream.  The default,
+/// BinaryWriteArchive, writes to a virtual base::WriteStream, while
+/// BufferBinaryWriteArchive writes to a pre-sized contiguous buffer
+/// with no virtual calls.  See AppendBinary below.
+template <typename Sink>
+class BasicBinaryWriteArchive
+    : public base::VisitArchive<BasicBinaryWriteArchive<Sink>> {
  public:
-  BinaryWriteArchive(base::WriteStream& stream) : stream_(stream) {}
+  using Base = base::VisitArchive<BasicBinaryWriteArchive<Sink>>;
+
+  BasicBinaryWriteArchive(Sink& stream) : stream_(stream) {}
 
   template <typename Serializable>
   static std::string Write(const Serializable* serializable) {
     base::FastOStringStream ostr;
-    BinaryWriteArchive(ostr).Accept(serializable);
+    BasicBinaryWriteArchive<base::WriteStream>(ostr).Accept(serializable);
     return ostr.str();
   }
 
   template <typename Serializable>
-  BinaryWriteArchive& Accept(const Serializable* serializable) {
-    base::VisitArchive<BinaryWriteArchive>::Accept(
-        const_cast<Serializable*>(serializable));
+  BasicBinaryWriteArchive& Accept(const Serializable* serializable) {
+    Base::Accept(const_cast<Serializable*>(serializable));
     return *this;
   }
 
   template <typename ValueType>
-  BinaryWriteArchive& Value(const ValueType& value) {
+  BasicBinaryWriteArchive& Value(const ValueType& value) {
     base::ReferenceNameValuePair nvp(const_cast<ValueType*>(&value), "");
-    VisitArchive<BinaryWriteArchive>::Visit(nvp);
+    Base::Visit(nvp);
     return *this;
   }
 
   template <typename ValueType>
-  static void Write(const ValueType& value, base::WriteStream& stream) {
-    BinaryWriteArchive(stream).Value(value);
+  static void Write(const ValueType& value, Sink& stream) {
+    BasicBinaryWriteArchive(stream).Value(value);
   }
 
   template <typename ValueType>
   static std::string Write(const ValueType& value) {
     base::FastOStringStream ostr;
-    Write(value, ostr);
+    BasicBinaryWriteArchive<base::WriteStream>(ostr).Value(value);
     return ostr.str();
   }
 
@@ -111,9 +120,18 @@ class BinaryWriteArchive : public base::VisitArchive<BinaryWriteArchive> {
 
   template <typename Array>
   void VisitArrayHelper(Array& value) {
-    for (auto& item : value) {
-      base::ReferenceNameValuePair sub_nvp(&item, "");
-      Visit(sub_nvp);
+    using T = typename Array::value_type;
+    if constexpr (detail::IsMemcpyCompatible<T>::value) {
+      // The in-memory layout matches the serialized one, so emit the
+      // whole thing at once.
+      if (value.empty()) { return; }
+      stream_.RawWrite({reinterpret_cast<const char*>(&value[0]),
+                        value.size() * sizeof(T)});
+    } else {
+      for (auto& item : value) {
+        base::ReferenceNameValuePair sub_nvp(&item, "");
+        Base::Visit(sub_nvp);
+      }
     }
   }
 
@@ -126,7 +144,7 @@ class BinaryWriteArchive : public base::VisitArchive<BinaryWriteArchive> {
     } else {
       stream_.WriteVaruint(1);
       base::ReferenceNameValuePair sub_nvp(&**value, "");
-      Visit(sub_nvp);
+      Base::Visit(sub_nvp);
     }
   }
 
@@ -158,9 +176,37 @@ class BinaryWriteArchive : public base::VisitArchive<BinaryWriteArchive> {
     stream_.Write(*value);
   }
 
-  WriteStream stream_;
+  BasicWriteStream<Sink> stream_;
 };
 
+using BinaryWriteArchive = BasicBinaryWriteArchive<base::WriteStream>;
+using BufferBinaryWriteArchive = BasicBinaryWriteArchive<BufferSink>;
+
+/// Append the binary serialization of 'value' to 'stream'.
+///
+/// The serialized size is measured first, so that the stream is grown
+/// exactly once, then the data is written in place with no virtual
+/// calls or per-write bounds checks.  'stream' may be a
+/// ThreadWriter::OStream obtained from FileWriter::GetBuffer.
+///
+/// @return the number of bytes appended
+template <typename ValueType>
+std::size_t AppendBinary(const ValueType& value,
+                         base::FastOStringStream* stream) {
+  SizeSink size_sink;
+  BasicBinaryWriteArchive<SizeSink>(size_sink).Value(value);
+
+  auto* const data = stream->data();
+  const std::size_t old_size = data->size();
+  data->resize(old_size + size_sink.size());
+
+  BufferSink buffer_sink(data->data() + old_size);
+  BufferBinaryWriteArchive(buffer_sink).Value(value);
+  MJ_ASSERT(buffer_sink.size() == size_sink.size());
+
+  return size_sink.size();
+}
+
 /// Emit a binary schema serialization from a serializable C++ object.
 class BinarySchemaArchive : public base::VisitArchive<BinarySchemaArchive> {
  public:
@@ -0,0 +1,235 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/block_sink.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include "mjlib/base/system_fd.h"
+
+namespace mjlib {
+namespace telemetry {
+
+class FdSink::Impl {
+ public:
+  Impl(int fd, const Options& options)
+      : options_(options),
+        fd_(fd),
+        thread_(std::bind(&Impl::Run, this)) {}
+
+  ~Impl() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      done_ = true;
+    }
+    ready_.notify_all();
+    thread_.join();
+  }
+
+  /// @param essential - if true, this is never discarded
+  /// @param seek_point - if true, the receiver can resynchronize here
+  ///
+  /// @return false if the block was discarded
+  bool Push(std::string_view data, bool essential, bool seek_point) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stats_.failed) { return false; }
+
+    const int64_t size = data.size();
+    const auto fits = [&]() {
+      return queued_bytes_ == 0 ||
+          (queued_bytes_ + size) <= options_.max_queued_bytes;
+    };
+
+    if (options_.reliable) {
+      if (!fits()) {
+        writable_.wait(lock, [&]() { return stats_.failed || fits(); });
+        if (stats_.failed) { return false; }
+      }
+    } else if (!essential) {
+      if (dropping_ && (!seek_point || !fits())) {
+        stats_.blocks_dropped++;
+        return false;
+      }
+      if (!fits()) {
+        stats_.drops++;
+        stats_.blocks_dropped++;
+        dropping_ = true;
+        return false;
+      }
+      dropping_ = false;
+    }
+
+    queue_.push_back(std::string(data));
+    queued_bytes_ += size;
+    lock.unlock();
+
+    ready_.notify_one();
+    return true;
+  }
+
+  Stats stats() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return stats_;
+  }
+
+ private:
+  void Run() {
+    // A closed socket or pipe should be reported as an error from
+    // the write, not terminate the process.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGPIPE);
+    ::pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::vector<std::string> batch;
+
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [&]() { return done_ || !queue_.empty(); });
+        if (queue_.empty()) { return; }
+
+        const std::size_t count = std::min<std::size_t>(
+            queue_.size(), std::max(1, options_.max_batch));
+        for (std::size_t i = 0; i < count; i++) {
+          queued_bytes_ -= queue_.front().size();
+          batch.push_back(std::move(queue_.front()));
+          queue_.pop_front();
+        }
+      }
+      writable_.notify_all();
+
+      const auto written = Send(batch);
+      batch.clear();
+
+      {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (written < 0) {
+          stats_.failed = true;
+          queue_.clear();
+          queued_bytes_ = 0;
+        } else {
+          stats_.bytes_written += written;
+        }
+      }
+      writable_.notify_all();
+    }
+  }
+
+  /// @return the number of bytes written, or -1 on failure.
+  int64_t Send(const std::vector<std::string>& batch) {
+    int64_t total = 0;
+
+    if (options_.datagram) {
+      for (const auto& entry : batch) {
+        while (true) {
+          const auto result = ::send(
+              fd_, entry.data(), entry.size(), 0);
+          if (result >= 0) {
+            total += result;
+            break;
+          }
+          if (errno == EINTR) { continue; }
+          // This one block was too large, which need not affect the
+          // remainder.
+          if (errno == EMSGSIZE) { break; }
+          return -1;
+        }
+      }
+      return total;
+    }
+
+    std::vector<iovec> iov;
+    iov.reserve(batch.size());
+    for (const auto& entry : batch) {
+      iov.push_back({const_cast<char*>(entry.data()), entry.size()});
+    }
+
+    std::size_t index = 0;
+    while (index < iov.size()) {
+      const auto result = ::writev(fd_, &iov[index], iov.size() - index);
+      if (result < 0) {
+        if (errno == EINTR) { continue; }
+        return -1;
+      }
+      total += result;
+
+      // Advance past whatever was written, which may end partway
+      // through an element.
+      std::size_t remaining = result;
+      while (remaining > 0) {
+        if (remaining >= iov[index].iov_len) {
+          remaining -= iov[index].iov_len;
+          index++;
+        } else {
+          iov[index].iov_base =
+              static_cast<char*>(iov[index].iov_base) + remaining;
+          iov[index].iov_len -= remaining;
+          remaining = 0;
+        }
+      }
+    }
+
+    return total;
+  }
+
+  const Options options_;
+  base::SystemFd fd_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;
+  std::condition_variable writable_;
+  bool done_ = false;
+  bool dropping_ = false;
+  std::deque<std::string> queue_;
+  int64_t queued_bytes_ = 0;
+  Stats stats_;
+
+  std::thread thread_;
+};
+
+FdSink::FdSink(int fd, const Options& options)
+    : impl_(std::make_unique<Impl>(fd, options)) {}
+
+FdSink::~FdSink() {}
+
+void FdSink::Start(std::string_view header) {
+  impl_->Push(header, true, false);
+}
+
+bool FdSink::Write(Format::BlockType type, std::string_view block) {
+  // A summary describes everything since the previous one, so
+  // losing one could leave received data undescribed.
+  return impl_->Push(block,
+              type == Format::BlockType::kSchema ||
+              type == Format::BlockType::kSummary,
+              type == Format::BlockType::kSeekMarker);
+}
+
+FdSink::Stats FdSink::stats() const {
+  return impl_->stats();
+}
+
+}
+}
@@ -0,0 +1,137 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include <boost/noncopyable.hpp>
+
+#include "mjlib/telemetry/format.h"
+
+namespace mjlib {
+namespace telemetry {
+
+/// Receives the stream of encoded blocks produced by a FileWriter,
+/// either in addition to or instead of a file.  Concatenating
+/// everything passed to Start and Write results in a valid log.
+///
+/// Both methods are called from the thread which writes to the
+/// FileWriter, and should not block.
+class BlockSink {
+ public:
+  virtual ~BlockSink() {}
+
+  /// Called once, with the log header, before any blocks.
+  virtual void Start(std::string_view header) = 0;
+
+  /// Called with each complete block.
+  ///
+  /// @return false if the block was discarded and will never reach
+  /// the receiver.  The FileWriter then omits it from the positions
+  /// encoded in later seek markers and index blocks for this sink.
+  virtual bool Write(Format::BlockType, std::string_view block) = 0;
+};
+
+/// Accumulates the stream in memory.
+class MemorySink : public BlockSink {
+ public:
+  void Start(std::string_view header) override {
+    std::lock_guard<std::mutex> guard(mutex_);
+    data_.append(header);
+  }
+
+  bool Write(Format::BlockType, std::string_view block) override {
+    std::lock_guard<std::mutex> guard(mutex_);
+    data_.append(block);
+    return true;
+  }
+
+  /// Return a copy of everything written so far.
+  std::string data() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return data_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::string data_;
+};
+
+/// Writes the stream to a file descriptor from a background thread.
+/// This can be a TCP or Unix domain socket, a pipe, or a file.
+/// Queued blocks are written in batches with a single gathering
+/// write.
+class FdSink : public BlockSink, boost::noncopyable {
+ public:
+  struct Options {
+    /// If true, a producer which gets more than max_queued_bytes
+    /// ahead of the descriptor will block until it catches up.
+    ///
+    /// Otherwise, the block which would exceed it is discarded, as
+    /// are all further blocks until a seek marker which fits, so
+    /// that the receiver can resynchronize there.  Blocks already
+    /// queued are always sent, and schema and summary blocks are
+    /// never discarded.
+    bool reliable = false;
+
+    int64_t max_queued_bytes = 4 << 20;
+
+    /// The most blocks which will be written in a single call.
+    int max_batch = 64;
+
+    /// Send each block as a separate datagram, as is required for a
+    /// UDP socket.  Blocks which exceed the datagram size limit are
+    /// lost.
+    bool datagram = false;
+
+    Options() {}
+  };
+
+  /// Takes ownership of @p fd, which is closed at destruction.
+  FdSink(int fd, const Options& = {});
+
+  /// Any queued data is written before returning, unless the
+  /// descriptor has failed.
+  ~FdSink() override;
+
+  void Start(std::string_view header) override;
+  bool Write(Format::BlockType, std::string_view block) override;
+
+  struct Stats {
+    uint64_t bytes_written = 0;
+
+    /// The number of times the sink began discarding blocks, and the
+    /// number of blocks lost as a result.
+    uint64_t drops = 0;
+    uint64_t blocks_dropped = 0;
+
+    /// True if a write to the descriptor has failed, for instance
+    /// because the remote end closed.  Nothing further is written.
+    bool failed = false;
+  };
+
+  Stats stats() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
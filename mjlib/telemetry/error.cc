@@ -38,6 +38,10 @@ class ErrorCategory : public boost::system::error_category {
       case errc::kDataChecksumMismatch: return "Data checksum mismatch";
       case errc::kDecompressionError: return "Decompression error";
       case errc::kTypeMismatch: return "Type mismatch";
+      case errc::kUnknownField: return "Unknown field";
+      case errc::kUnknownSummaryFlag: return "Unknown summary flag";
+      case errc::kUnknownRecord: return "Unknown record";
+      case errc::kInvalidExpression: return "Invalid expression";
     }
     return "unknown";
   }
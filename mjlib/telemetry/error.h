@@ -34,6 +34,10 @@ enum class errc {
   kDataChecksumMismatch,
   kDecompressionError,
   kTypeMismatch,
+  kUnknownField,
+  kUnknownSummaryFlag,
+  kUnknownRecord,
+  kInvalidExpression,
 };
 
 boost::system::error_code make_error_code(errc);
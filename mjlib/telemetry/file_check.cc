@@ -0,0 +1,537 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/file_check.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/crc.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/fast_stream.h"
+#include "mjlib/base/system_error.h"
+#include "mjlib/telemetry/format.h"
+
+namespace mjlib {
+namespace telemetry {
+
+namespace {
+/// Blocks are verified and copied in pieces no larger than this, so
+/// that memory use does not depend upon the size of the file or of
+/// any block within it.
+constexpr std::size_t kChunkSize = 65536;
+
+constexpr std::string_view kHeader{"TLOG0003\x00", 9};
+
+constexpr std::string_view kInvalidBlockSize{"invalid block size"};
+
+/// The little endian representation of the seek marker constant.
+constexpr std::string_view kSeekMarker{
+  "\x64\x75\x86\x97\xa8\xb9\xca\xfd", 8};
+
+template <typename T>
+uint64_t u64(T value) {
+  return static_cast<uint64_t>(value);
+}
+
+class File {
+ public:
+  File(std::string_view name, const char* mode) {
+    file_ = ::fopen(std::string(name).c_str(), mode);
+    base::system_error::throw_if(
+        file_ == nullptr, fmt::format("When opening: '{}'", name));
+  }
+
+  ~File() {
+    ::fclose(file_);
+  }
+
+  File(const File&) = delete;
+  File& operator=(const File&) = delete;
+
+  FILE* get() { return file_; }
+
+ private:
+  FILE* file_ = nullptr;
+};
+
+class Checker {
+ public:
+  Checker(std::string_view filename, const FileCheckOptions& options)
+      : input_(filename, "rb") {
+    base::system_error::throw_if(::fseek(input_.get(), 0, SEEK_END) < 0);
+    result_.file_size = ::ftell(input_.get());
+    base::system_error::throw_if(result_.file_size < 0);
+
+    if (!options.repair_filename.empty()) {
+      output_.emplace(options.repair_filename, "wb");
+    }
+  }
+
+  FileCheckResult Run() {
+    int64_t position = kHeader.size();
+    if (ReadAt(0, kHeader.size()) != kHeader) {
+      position = Resync(0);
+      AddDamage(0, position, "invalid header");
+    }
+
+    Write(kHeader);
+
+    while (position < result_.file_size) {
+      Block block;
+      const auto reason = Verify(position, &block);
+      if (reason.empty()) {
+        Accept(position, block);
+        position += block.header_size + block.size;
+        continue;
+      }
+
+      const auto next = Resync(position + 1);
+      // A block which claims to extend past the end of the file is
+      // only a truncation if nothing valid follows it.  Otherwise
+      // its size was corrupted.
+      if (reason == kInvalidBlockSize && next == result_.file_size) {
+        result_.truncated = true;
+        AddDamage(position, next, "truncated block");
+      } else {
+        AddDamage(position, next, reason);
+      }
+      position = next;
+    }
+
+    if (output_) {
+      WriteIndex();
+      base::system_error::throw_if(::fflush(output_->get()) != 0);
+    }
+
+    return std::move(result_);
+  }
+
+ private:
+  struct Block {
+    Format::BlockType type = {};
+    int64_t header_size = 0;
+    int64_t size = 0;
+    uint64_t identifier = 0;
+  };
+
+  /// Return up to @p size bytes starting at @p position.  Fewer are
+  /// returned only at the end of the file.
+  std::string_view ReadAt(int64_t position, std::size_t size) {
+    buffer_.resize(size);
+    base::system_error::throw_if(
+        ::fseek(input_.get(), position, SEEK_SET) < 0);
+    const auto amount_read = ::fread(buffer_.data(), 1, size, input_.get());
+    base::system_error::throw_if(::ferror(input_.get()) != 0);
+    return std::string_view(buffer_.data(), amount_read);
+  }
+
+  /// Compute the CRC32 of [start, end), with the 4 bytes at @p
+  /// zero_at treated as all 0s.
+  uint32_t Crc(int64_t start, int64_t end, int64_t zero_at) {
+    boost::crc_32_type crc;
+    for (int64_t position = start; position < end; ) {
+      const auto data = ReadAt(
+          position, std::min<int64_t>(kChunkSize, end - position));
+      if (data.empty()) { break; }
+      const auto data_end = position + static_cast<int64_t>(data.size());
+      for (int64_t i = std::max(position, zero_at);
+           i < std::min(data_end, zero_at + 4); i++) {
+        buffer_[i - position] = 0;
+      }
+      crc.process_bytes(data.data(), data.size());
+      position = data_end;
+    }
+    return crc.checksum();
+  }
+
+  /// Return an empty string if a valid block begins at @p position,
+  /// or a description of what is wrong with it.
+  std::string Verify(int64_t position, Block* block) {
+    // This is enough to hold the block header and every fixed field
+    // we need to examine from any block type.
+    const auto prefix = ReadAt(position, 64);
+    base::BufferReadStream base_stream{prefix};
+    ReadStream stream{base_stream};
+
+    const auto maybe_type = stream.ReadVaruint();
+    if (!maybe_type) { return std::string(kInvalidBlockSize); }
+    if (*maybe_type == 0 ||
+        *maybe_type > u64(Format::BlockType::kNumTypes)) {
+      return fmt::format("invalid block type {}", *maybe_type);
+    }
+    block->type = static_cast<Format::BlockType>(*maybe_type);
+
+    const auto maybe_size = stream.ReadVaruint();
+    if (!maybe_size) { return std::string(kInvalidBlockSize); }
+    block->header_size = base_stream.offset();
+    if (*maybe_size > u64(result_.file_size - position - block->header_size)) {
+      return std::string(kInvalidBlockSize);
+    }
+    block->size = *maybe_size;
+
+    const auto body_start = position + block->header_size;
+    const auto end = body_start + block->size;
+    const auto remaining = [&]() {
+      return block->size -
+          (static_cast<int64_t>(base_stream.offset()) - block->header_size);
+    };
+
+    switch (block->type) {
+      case Format::BlockType::kSchema: {
+        const auto identifier = stream.ReadVaruint();
+        const auto flags = stream.ReadVaruint();
+        if (!identifier || !flags || remaining() < 0) {
+          return "malformed schema";
+        }
+        if (*flags != 0) { return "unknown schema flags"; }
+        const auto name_size = stream.ReadVaruint();
+        if (!name_size || static_cast<int64_t>(*name_size) > remaining()) {
+          return "malformed schema";
+        }
+        block->identifier = *identifier;
+        return "";
+      }
+      case Format::BlockType::kData: {
+        const auto identifier = stream.ReadVaruint();
+        const auto maybe_flags = stream.ReadVaruint();
+        if (!identifier || !maybe_flags) { return "malformed data"; }
+        block->identifier = *identifier;
+
+        const auto flags = *maybe_flags;
+        const uint64_t known =
+            u64(Format::BlockDataFlags::kPreviousOffset) |
+            u64(Format::BlockDataFlags::kTimestamp) |
+            u64(Format::BlockDataFlags::kChecksum) |
+            u64(Format::BlockDataFlags::kSnappy);
+        if (flags & ~known) { return "unknown data flags"; }
+
+        if ((flags & u64(Format::BlockDataFlags::kPreviousOffset)) &&
+            !stream.ReadVaruint()) {
+          return "malformed data";
+        }
+        if ((flags & u64(Format::BlockDataFlags::kTimestamp)) &&
+            !stream.Read<int64_t>()) {
+          return "malformed data";
+        }
+        if (!(flags & u64(Format::BlockDataFlags::kChecksum))) {
+          if (remaining() < 0) { return "malformed data"; }
+          result_.unchecked_data_blocks++;
+          return "";
+        }
+
+        const auto checksum_position = position + base_stream.offset();
+        const auto expected = stream.Read<uint32_t>();
+        if (!expected || remaining() < 0) { return "malformed data"; }
+
+        const auto actual = Crc(position, end, checksum_position);
+        if (actual != *expected) {
+          return fmt::format(
+              "data checksum mismatch, expected 0x{:08x} got 0x{:08x}",
+              *expected, actual);
+        }
+        return "";
+      }
+      case Format::BlockType::kSeekMarker: {
+        if (prefix.substr(block->header_size, kSeekMarker.size()) !=
+            kSeekMarker) {
+          return "invalid seek marker";
+        }
+        stream.Read<uint64_t>();
+        const auto checksum_position = position + base_stream.offset();
+        const auto expected = stream.Read<uint32_t>();
+        const auto header_size = stream.Read<uint8_t>();
+        const auto flags = stream.ReadVaruint();
+        if (!expected || !header_size || !flags || remaining() < 0 ||
+            *header_size != block->header_size) {
+          return "invalid seek marker";
+        }
+        if (*flags != 0) { return "unknown seek marker flags"; }
+        if (Crc(position, end, checksum_position) != *expected) {
+          return "seek marker checksum mismatch";
+        }
+        return "";
+      }
+      case Format::BlockType::kIndex: {
+        if (block->size < 12) { return "malformed index"; }
+        const auto trailer = ReadAt(end - 12, 12);
+        uint32_t trailing_size = 0;
+        std::memcpy(&trailing_size, trailer.data(), sizeof(trailing_size));
+        if (trailer.substr(4) != "TLOGIDEX" ||
+            trailing_size != block->header_size + block->size) {
+          return "malformed index";
+        }
+        return "";
+      }
+      case Format::BlockType::kCompressionDictionary:
+      case Format::BlockType::kSummary: {
+        // These have no integrity check of their own, so we can only
+        // verify their framing.
+        return "";
+      }
+    }
+
+    return "invalid block type";
+  }
+
+  /// Find the first valid seek marker at or after @p start, or the
+  /// end of the file if there are none.
+  int64_t Resync(int64_t start) {
+    // Probing candidates must not affect the statistics we report.
+    const auto unchecked = result_.unchecked_data_blocks;
+    const auto restore = [&]() {
+      result_.unchecked_data_blocks = unchecked;
+    };
+
+    for (int64_t chunk = start; chunk < result_.file_size;
+         chunk += kChunkSize) {
+      // Overlap each chunk with the next, so that a marker which
+      // straddles the boundary is still found.
+      const std::string data{
+        ReadAt(chunk, kChunkSize + kSeekMarker.size() - 1)};
+      for (auto pos = data.find(kSeekMarker); pos != std::string::npos;
+           pos = data.find(kSeekMarker, pos + 1)) {
+        if (pos >= kChunkSize) { break; }
+
+        const int64_t marker = chunk + pos;
+        // The byte following the marker and CRC records the size of
+        // the block header which precedes the marker.
+        const auto header_size = ReadAt(marker + 12, 1);
+        if (header_size.empty()) { continue; }
+        const int64_t block_start =
+            marker - static_cast<uint8_t>(header_size[0]);
+        if (block_start < start) { continue; }
+
+        Block block;
+        const bool valid = Verify(block_start, &block).empty();
+        restore();
+        if (valid && block.type == Format::BlockType::kSeekMarker) {
+          return block_start;
+        }
+      }
+    }
+
+    return result_.file_size;
+  }
+
+  void AddDamage(int64_t start, int64_t end, const std::string& reason) {
+    result_.damage.push_back({start, end, reason});
+    damaged_ = true;
+  }
+
+  void Accept(int64_t position, const Block& block) {
+    result_.blocks++;
+
+    switch (block.type) {
+      case Format::BlockType::kSchema: {
+        result_.schema_blocks++;
+        auto& entry = index_[block.identifier];
+        if (entry.schema_position < 0) {
+          entry.schema_position = output_position_;
+        }
+        break;
+      }
+      case Format::BlockType::kData: {
+        result_.data_blocks++;
+        auto& entry = index_[block.identifier];
+        if (entry.schema_position < 0) {
+          result_.orphan_data_blocks++;
+          return;
+        }
+        entry.last_position = output_position_;
+        break;
+      }
+      case Format::BlockType::kSeekMarker: {
+        result_.seek_markers++;
+        // The offsets stored in a seek marker are relative to its own
+        // position, and are no longer correct once any damaged
+        // region has been removed, so it must be rebuilt.
+        if (damaged_) {
+          RewriteSeekMarker(position, block);
+          return;
+        }
+        break;
+      }
+      case Format::BlockType::kIndex: {
+        result_.index_blocks++;
+        // A single index is rebuilt at the end of the repaired file.
+        return;
+      }
+      case Format::BlockType::kCompressionDictionary:
+      case Format::BlockType::kSummary: {
+        break;
+      }
+    }
+
+    Copy(position, block.header_size + block.size);
+  }
+
+  /// Write a replacement for the seek marker at @p position, whose
+  /// offsets refer to the most recent data blocks in the output.
+  void RewriteSeekMarker(int64_t position, const Block& block) {
+    if (!output_) { return; }
+
+    const std::string body{
+      ReadAt(position + block.header_size, block.size)};
+    base::BufferReadStream base_stream{body};
+    ReadStream stream{base_stream};
+
+    // The constant, checksum, and header size have already been
+    // verified.
+    base_stream.ignore(8 + 4 + 1);
+    const auto flags = stream.ReadVaruint();
+    const auto timestamp = stream.Read<int64_t>();
+    const auto count = stream.ReadVaruint();
+    if (!flags || !timestamp || !count) { return; }
+
+    std::vector<std::pair<uint64_t, uint64_t>> offsets;
+    for (uint64_t i = 0; i < *count; i++) {
+      const auto identifier = stream.ReadVaruint();
+      const auto offset = stream.ReadVaruint();
+      if (!identifier || !offset) { return; }
+
+      // If the referenced block was lost, the most recent one which
+      // survived takes its place.  Records whose schema was lost
+      // cannot be referenced at all, as readers would not know them.
+      const auto it = index_.find(*identifier);
+      if (it == index_.end() ||
+          it->second.schema_position < 0 ||
+          it->second.last_position < 0) {
+        continue;
+      }
+      offsets.push_back(
+          {*identifier, u64(output_position_ - it->second.last_position)});
+    }
+
+    WriteSeekMarker(*timestamp, offsets);
+  }
+
+  void WriteSeekMarker(
+      int64_t timestamp, const std::vector<std::pair<uint64_t, uint64_t>>&
+      offsets) {
+    base::FastOStringStream body;
+    WriteStream stream{body};
+
+    stream.RawWrite(kSeekMarker);
+    stream.Write(static_cast<uint32_t>(0));  // placeholder crc
+    stream.Write(static_cast<uint8_t>(0));  // placeholder header size
+    stream.WriteVaruint(0u);  // flags
+    stream.Write(timestamp);
+    stream.WriteVaruint(offsets.size());
+    for (const auto& pair : offsets) {
+      stream.WriteVaruint(pair.first);
+      stream.WriteVaruint(pair.second);
+    }
+
+    base::FastOStringStream header;
+    WriteStream header_stream{header};
+    header_stream.WriteVaruint(u64(Format::BlockType::kSeekMarker));
+    header_stream.WriteVaruint(body.view().size());
+
+    std::string block = header.str() + body.str();
+    const auto crc_position = header.view().size() + kSeekMarker.size();
+    block[crc_position + 4] = static_cast<char>(header.view().size());
+
+    boost::crc_32_type crc;
+    crc.process_bytes(block.data(), block.size());
+    const uint32_t checksum = crc.checksum();
+    std::memcpy(&block[crc_position], &checksum, sizeof(checksum));
+
+    Write(block);
+  }
+
+  void Copy(int64_t position, int64_t size) {
+    if (!output_) { return; }
+
+    const auto end = position + size;
+    while (position < end) {
+      const auto data = ReadAt(
+          position, std::min<int64_t>(kChunkSize, end - position));
+      Write(data);
+      position += data.size();
+    }
+  }
+
+  void Write(std::string_view data) {
+    if (!output_) { return; }
+
+    base::system_error::throw_if(
+        ::fwrite(data.data(), 1, data.size(), output_->get()) != data.size());
+    output_position_ += data.size();
+  }
+
+  void WriteIndex() {
+    base::FastOStringStream body;
+    WriteStream stream{body};
+
+    stream.WriteVaruint(0u);  // flags
+    const uint64_t num_elements = std::count_if(
+        index_.begin(), index_.end(),
+        [](const auto& pair) { return pair.second.schema_position >= 0; });
+    stream.WriteVaruint(num_elements);
+    for (const auto& pair : index_) {
+      if (pair.second.schema_position < 0) { continue; }
+      stream.WriteVaruint(pair.first);
+      stream.Write(u64(pair.second.schema_position));
+      stream.Write(u64(pair.second.last_position));
+    }
+
+    const auto size = body.view().size() + 4 + 8;
+    const uint32_t trailing_size = 1 + Format::GetVaruintSize(size) + size;
+    stream.Write(trailing_size);
+    stream.RawWrite({"TLOGIDEX", 8});
+
+    base::FastOStringStream header;
+    WriteStream header_stream{header};
+    header_stream.WriteVaruint(u64(Format::BlockType::kIndex));
+    header_stream.WriteVaruint(body.view().size());
+
+    Write(header.view());
+    Write(body.view());
+  }
+
+  struct IndexEntry {
+    int64_t schema_position = -1;
+    int64_t last_position = -1;
+  };
+
+  File input_;
+  std::optional<File> output_;
+
+  FileCheckResult result_;
+  std::string buffer_;
+
+  bool damaged_ = false;
+  int64_t output_position_ = 0;
+  std::map<uint64_t, IndexEntry> index_;
+};
+}
+
+FileCheckResult CheckFile(std::string_view filename,
+                          const FileCheckOptions& options) {
+  Checker checker{filename, options};
+  return checker.Run();
+}
+
+}
+}
@@ -0,0 +1,86 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mjlib {
+namespace telemetry {
+
+struct FileCheckOptions {
+  /// If non-empty, a repaired copy of the log is written to this
+  /// path.  It contains every block which verified correctly,
+  /// followed by a freshly built index.  Seek markers which follow a
+  /// removed region are rewritten to match, and refer only to records
+  /// whose schema survived.
+  std::string repair_filename;
+
+  FileCheckOptions() {}
+};
+
+struct FileCheckResult {
+  /// A contiguous region of the file which could not be decoded.
+  /// The range is [start, end).
+  struct Damage {
+    int64_t start = 0;
+    int64_t end = 0;
+    std::string reason;
+  };
+
+  std::vector<Damage> damage;
+
+  int64_t file_size = 0;
+
+  /// The number of blocks of each kind which verified correctly.
+  uint64_t blocks = 0;
+  uint64_t schema_blocks = 0;
+  uint64_t data_blocks = 0;
+  uint64_t seek_markers = 0;
+  uint64_t index_blocks = 0;
+
+  /// Data blocks which were written without a checksum, and thus
+  /// could only be checked structurally.
+  uint64_t unchecked_data_blocks = 0;
+
+  /// Data blocks whose record has no schema which verified, usually
+  /// because it was lost to damage.  These are omitted from a
+  /// repaired copy, as no reader could interpret them.
+  uint64_t orphan_data_blocks = 0;
+
+  /// True if the file ended partway through a block.
+  bool truncated = false;
+
+  bool ok() const { return damage.empty(); }
+};
+
+/// Verify every block of the given log, and optionally write a
+/// repaired copy.
+///
+/// Data checksums, seek marker checksums, and the framing of every
+/// other block are verified.  When a region cannot be decoded, the
+/// checker resynchronizes at the next valid seek marker and reports
+/// the bytes in between as damaged.  The file is processed in a
+/// single forward pass, holding no more than one block in memory at
+/// a time, so arbitrarily large logs may be checked.
+///
+/// Throws base::system_error if the input cannot be opened.
+FileCheckResult CheckFile(std::string_view filename,
+                          const FileCheckOptions& = {});
+
+}
+}
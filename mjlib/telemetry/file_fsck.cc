@@ -0,0 +1,68 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/// @file
+///
+/// Verify the integrity of a log, reporting any damaged regions, and
+/// optionally write a repaired copy.  Exits with 0 if the log had no
+/// damage, 1 otherwise.
+
+#include <iostream>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/clipp.h"
+
+#include "mjlib/telemetry/file_check.h"
+
+int main(int argc, char**argv) {
+  std::string log_filename;
+  mjlib::telemetry::FileCheckOptions options;
+  bool quiet = false;
+
+  auto group = clipp::group(
+      (clipp::option("r", "repair") & clipp::value("", options.repair_filename))
+      % "write a repaired copy to this file",
+      clipp::option("q", "quiet").set(quiet)
+      % "only report via the exit status",
+      clipp::value("LOG", log_filename)
+  );
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  const auto result = mjlib::telemetry::CheckFile(log_filename, options);
+
+  if (!quiet) {
+    for (const auto& damage : result.damage) {
+      std::cout << fmt::format(
+          "damaged: [{}, {}) {} bytes: {}\n",
+          damage.start, damage.end, damage.end - damage.start, damage.reason);
+    }
+    std::cout << fmt::format(
+        "{} bytes, {} valid blocks ({} schema, {} data, {} seek, {} index)\n",
+        result.file_size, result.blocks, result.schema_blocks,
+        result.data_blocks, result.seek_markers, result.index_blocks);
+    if (result.unchecked_data_blocks) {
+      std::cout << fmt::format(
+          "{} data blocks had no checksum\n", result.unchecked_data_blocks);
+    }
+    if (result.truncated) {
+      std::cout << "file is truncated\n";
+    }
+    std::cout << (result.ok() ? "OK\n" : "DAMAGED\n");
+  }
+
+  return result.ok() ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/// @file
+///
+/// Report the items of one record which satisfy a predicate, for
+/// instance:
+///
+///   file_query log.tlog -r servo_stats -f temp_C -f fault \
+///      -w 'temp_C > 60 && fault != 0'
+///
+/// With --bucket, the minimum, maximum, and mean of each field are
+/// reported for each interval instead.
+
+#include <iostream>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/clipp.h"
+
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/query.h"
+
+namespace pt = boost::posix_time;
+namespace tl = mjlib::telemetry;
+
+int main(int argc, char**argv) {
+  std::string log_filename;
+  tl::QueryOptions options;
+  std::string start;
+  std::string end;
+  double bucket_s = 0.0;
+
+  auto group = clipp::group(
+      (clipp::option("r", "record") & clipp::value("", options.record))
+      % "the record to query",
+      clipp::repeatable(
+          (clipp::option("f", "field") & clipp::value("", options.fields))
+          % "a field path to report"),
+      (clipp::option("w", "where") & clipp::value("", options.predicate))
+      % "only report items for which this expression is true",
+      (clipp::option("s", "start") & clipp::value("", start))
+      % "ignore items before this time, 'YYYY-MM-DD HH:MM:SS.fff'",
+      (clipp::option("e", "end") & clipp::value("", end))
+      % "ignore items after this time",
+      (clipp::option("b", "bucket") & clipp::number("", bucket_s))
+      % "aggregate into buckets of this many seconds",
+      clipp::value("LOG", log_filename)
+  );
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  if (!start.empty()) { options.start = pt::time_from_string(start); }
+  if (!end.empty()) { options.end = pt::time_from_string(end); }
+
+  tl::FileReader file_reader(log_filename);
+
+  if (bucket_s <= 0.0) {
+    std::cout << "timestamp";
+    for (const auto& field : options.fields) { std::cout << " " << field; }
+    std::cout << "\n";
+
+    tl::RunQuery(
+        file_reader, options,
+        [&](const tl::QueryMatch& match) {
+          std::cout << pt::to_iso_extended_string(match.timestamp);
+          for (const auto value : match.values) {
+            std::cout << fmt::format(" {}", value);
+          }
+          std::cout << "\n";
+        });
+    return 0;
+  }
+
+  options.bucket = pt::microseconds(static_cast<int64_t>(bucket_s * 1e6));
+
+  std::cout << "start count";
+  for (const auto& field : options.fields) {
+    std::cout << fmt::format(" {0}.min {0}.max {0}.mean", field);
+  }
+  std::cout << "\n";
+
+  tl::RunAggregateQuery(
+      file_reader, options,
+      [&](const tl::QueryBucket& bucket) {
+        std::cout << pt::to_iso_extended_string(bucket.start) << " "
+                  << bucket.count;
+        for (std::size_t i = 0; i < bucket.mean.size(); i++) {
+          std::cout << fmt::format(" {} {} {}",
+                                   bucket.min[i], bucket.max[i],
+                                   bucket.mean[i]);
+        }
+        std::cout << "\n";
+      });
+
+  return 0;
+}
@@ -14,10 +14,21 @@
 
 #include "mjlib/telemetry/file_reader.h"
 
+#include <fcntl.h>
+
+#include <algorithm>
+#include <condition_variable>
 #include <cstdlib>
 #include <cstring>
 #include <deque>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <optional>
 #include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/crc.hpp>
 
@@ -28,7 +39,10 @@
 #include "mjlib/base/crc_stream.h"
 #include "mjlib/base/file_stream.h"
 #include "mjlib/base/system_error.h"
+#include "mjlib/base/time_conversions.h"
 #include "mjlib/telemetry/error.h"
+#include "mjlib/telemetry/numeric_field.h"
+#include "mjlib/telemetry/schema_cache.h"
 
 namespace mjlib {
 namespace telemetry {
@@ -110,6 +124,128 @@ class BlockStream : public base::ReadStream {
   base::ReadStream& base_;
   std::streamsize size_;
 };
+
+/// A least recently used cache of decoded data blocks, bounded by the
+/// total size of their payloads.
+class BlockCache {
+ public:
+  using Item = FileReader::Item;
+  using Index = FileReader::Index;
+
+  BlockCache(std::size_t budget) : budget_(budget) {}
+
+  /// @return nullptr if the item is not present.  The result is only
+  /// valid until the next call to Insert.
+  const Item* Find(Index index) {
+    const auto it = map_.find(index);
+    if (it == map_.end()) { return nullptr; }
+
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return &it->second->item;
+  }
+
+  void Insert(const Item& item) {
+    const auto cost = Cost(item);
+    // Items which could never fit are just not cached.
+    if (cost > budget_) { return; }
+
+    while (size_ + cost > budget_) {
+      const auto& oldest = lru_.back();
+      size_ -= Cost(oldest.item);
+      map_.erase(oldest.item.index);
+      lru_.pop_back();
+      evictions_++;
+    }
+
+    lru_.push_front(Entry{item});
+    map_[item.index] = lru_.begin();
+    size_ += cost;
+  }
+
+  std::size_t size() const { return size_; }
+  uint64_t evictions() const { return evictions_; }
+
+ private:
+  static std::size_t Cost(const Item& item) {
+    return item.data.size() + sizeof(Entry);
+  }
+
+  struct Entry {
+    Item item;
+  };
+
+  const std::size_t budget_;
+  std::size_t size_ = 0;
+  uint64_t evictions_ = 0;
+
+  std::list<Entry> lru_;
+  std::unordered_map<Index, std::list<Entry>::iterator> map_;
+};
+
+/// Asks the operating system to read portions of a file into its
+/// cache from a background thread, so that the reading thread never
+/// blocks waiting for it.  Only the most recent request is serviced.
+class Prefetcher {
+ public:
+  Prefetcher(int fd)
+      : fd_(fd),
+        thread_(std::bind(&Prefetcher::Run, this)) {}
+
+  ~Prefetcher() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    condition_.notify_one();
+    thread_.join();
+  }
+
+  void Request(int64_t offset, int64_t size) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      request_ = std::make_pair(offset, size);
+    }
+    condition_.notify_one();
+    count_++;
+  }
+
+  uint64_t count() const { return count_; }
+
+ private:
+  void Run() {
+    while (true) {
+      std::pair<int64_t, int64_t> request;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [&]() { return done_ || !!request_; });
+        if (done_) { return; }
+        request = *request_;
+        request_.reset();
+      }
+
+#ifdef __linux__
+      // readahead blocks until the data is present, which is why we
+      // are in our own thread.
+      ::readahead(fd_, request.first, request.second);
+#else
+      ::posix_fadvise(fd_, request.first, request.second,
+                      POSIX_FADV_WILLNEED);
+#endif
+    }
+  }
+
+  const int fd_;
+
+  // Only accessed from the parent.
+  uint64_t count_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool done_ = false;
+  std::optional<std::pair<int64_t, int64_t>> request_;
+
+  std::thread thread_;
+};
 }  // namespace
 
 class Filter {
@@ -119,6 +255,21 @@ class Filter {
   virtual void new_schema(FileReader::Identifier, const std::string&) = 0;
 };
 
+namespace {
+class RecordFilter : public Filter {
+ public:
+  RecordFilter(FileReader::Identifier identifier) : identifier_(identifier) {}
+
+  bool check(FileReader::Identifier identifier) override {
+    return identifier == identifier_;
+  }
+  void new_schema(FileReader::Identifier, const std::string&) override {}
+
+ private:
+  const FileReader::Identifier identifier_;
+};
+}
+
 struct FileReader::ItemRangeContext : public Filter {
   ~ItemRangeContext() override {}
 
@@ -160,6 +311,13 @@ class FileReader::Impl {
 
     start_ = fptr_.Tell();
 
+    if (options_.cache_size) {
+      cache_.emplace(options_.cache_size);
+    }
+    if (options_.prefetch_size) {
+      prefetcher_.emplace(::fileno(fptr_.file()));
+    }
+
     MaybeProcessIndex();
   }
 
@@ -215,9 +373,15 @@ class FileReader::Impl {
       if (it != id_to_record_.end()) { return it->second; }
     }
 
-    records_.push_back({});
-    auto& record = records_.back();
+    return AddRecord(ReadSchema(identifier, block_stream), filter);
+  }
+
+  /// Decode the remainder of a schema block following its identifier.
+  /// This does not modify any state of the reader.
+  Record ReadSchema(Identifier identifier, BlockStream& block_stream) {
+    telemetry::ReadStream stream{block_stream};
 
+    Record record;
     record.identifier = identifier;
     record.flags = stream.ReadVaruint().value();
 
@@ -230,10 +394,17 @@ class FileReader::Impl {
     record.raw_schema.resize(block_stream.remaining());
     block_stream.read(record.raw_schema);
 
-    record.schema = std::make_unique<BinarySchemaParser>(
+    record.schema = SchemaCache::Global().Parse(
         record.raw_schema, record.name);
 
-    id_to_record_[identifier] = &record;
+    return record;
+  }
+
+  const Record* AddRecord(Record record_in, Filter* filter) {
+    records_.push_back(std::move(record_in));
+    auto& record = records_.back();
+
+    id_to_record_[record.identifier] = &record;
     name_to_record_[record.name] = &record;
 
     if (filter) {
@@ -274,7 +445,8 @@ class FileReader::Impl {
         }
         case Format::BlockType::kIndex:
         case Format::BlockType::kCompressionDictionary:
-        case Format::BlockType::kSeekMarker: {
+        case Format::BlockType::kSeekMarker:
+        case Format::BlockType::kSummary: {
           break;
         }
       }
@@ -282,6 +454,98 @@ class FileReader::Impl {
   }
 
   Item Read(Index index) {
+    MaybePrefetch(index);
+
+    if (cache_) {
+      const auto* const cached = cache_->Find(index);
+      if (cached) {
+        cache_stats_.hits++;
+        return *cached;
+      }
+      cache_stats_.misses++;
+    }
+
+    auto result = ReadBlock(index);
+    if (cache_) { cache_->Insert(result); }
+    return result;
+  }
+
+  void MaybePrefetch(Index index) {
+    if (!prefetcher_) { return; }
+
+    const auto size = options_.prefetch_size;
+    const bool forward = index >= last_read_;
+    last_read_ = index;
+
+    // Only issue a new request once we have consumed half of the
+    // previous one.
+    if (forward) {
+      if (index >= prefetch_start_ && (index + size / 2) < prefetch_end_) {
+        return;
+      }
+      prefetch_start_ = index;
+      prefetch_end_ = std::min(index + size, fptr_.size());
+    } else {
+      if (index < prefetch_end_ && (index - size / 2) > prefetch_start_) {
+        return;
+      }
+      prefetch_start_ = std::max(index - size, start_);
+      prefetch_end_ = index;
+    }
+
+    prefetcher_->Request(prefetch_start_, prefetch_end_ - prefetch_start_);
+  }
+
+  CacheStats cache_stats() const {
+    auto result = cache_stats_;
+    if (cache_) {
+      result.evictions = cache_->evictions();
+      result.size = cache_->size();
+    }
+    if (prefetcher_) {
+      result.prefetches = prefetcher_->count();
+    }
+    return result;
+  }
+
+  Item ReadBlock(Index index) {
+    Item result;
+    result.index = index;
+
+    DataHeader header;
+    std::string decompressed;
+    ReadData(index, &header, &result.data, &decompressed);
+    if (header.flags & static_cast<uint64_t>(Format::BlockDataFlags::kSnappy)) {
+      std::swap(decompressed, result.data);
+    }
+
+    result.flags = header.flags;
+    if (header.timestamp_us) {
+      result.timestamp =
+          base::ConvertEpochMicrosecondsToPtime(*header.timestamp_us);
+    }
+    result.record = id_to_record_.at(header.identifier);
+
+    return result;
+  }
+
+  struct DataHeader {
+    Identifier identifier = {};
+    // Format::BlockDataFlags
+    uint64_t flags = {};
+    std::optional<int64_t> timestamp_us;
+  };
+
+  /// Read the data block at @p index.  Its payload is read into @p
+  /// raw, and then if compressed, decompressed into @p decompressed.
+  /// Both are resized as necessary, so that their storage can be
+  /// reused across many calls.
+  ///
+  /// @return a view of the payload
+  std::string_view ReadData(Index index,
+                            DataHeader* data_header,
+                            std::string* raw,
+                            std::string* decompressed) {
     fptr_.Seek(index);
 
     base::CrcReadStream<boost::crc_32_type> crc_stream{file_};
@@ -295,12 +559,11 @@ class FileReader::Impl {
       crc_stream, static_cast<std::streamsize>(header.size)};
     telemetry::ReadStream stream{block_stream};
 
-    Item result;
-    result.index = index;
-    const auto identifier = stream.ReadVaruint().value();
-    result.flags = stream.ReadVaruint().value();
+    data_header->identifier = stream.ReadVaruint().value();
+    data_header->flags = stream.ReadVaruint().value();
+    data_header->timestamp_us.reset();
 
-    auto flags = result.flags;
+    auto flags = data_header->flags;
     auto check_flags = [&](auto flag) {
       const auto u64_flag = static_cast<uint64_t>(flag);
       if (flags & u64_flag) {
@@ -314,7 +577,7 @@ class FileReader::Impl {
       stream.ReadVaruint(); // discard
     }
     if (check_flags(Format::BlockDataFlags::kTimestamp)) {
-      result.timestamp = stream.ReadTimestamp().value();
+      data_header->timestamp_us = stream.Read<int64_t>().value();
     }
 
     std::optional<uint32_t> checksum;
@@ -338,30 +601,31 @@ class FileReader::Impl {
       throw base::system_error(errc::kUnknownBlockDataFlag);
     }
 
-    result.data.resize(block_stream.remaining());
-    block_stream.read(result.data);
+    raw->resize(block_stream.remaining());
+    block_stream.read(*raw);
+
+    std::string_view result = *raw;
 
     if (snappy) {
       size_t decompressed_size = 0;
       {
         const bool success = snappy::GetUncompressedLength(
-            result.data.data(), result.data.size(),
+            raw->data(), raw->size(),
             &decompressed_size);
         if (!success) {
           throw base::system_error(errc::kDecompressionError);
         }
       }
-      std::string decompressed;
-      decompressed.resize(decompressed_size);
+      decompressed->resize(decompressed_size);
       {
         const bool success = snappy::RawUncompress(
-            result.data.data(), result.data.size(),
-            &decompressed[0]);
+            raw->data(), raw->size(),
+            &(*decompressed)[0]);
         if (!success) {
           throw base::system_error(errc::kDecompressionError);
         }
       }
-      std::swap(decompressed, result.data);
+      result = *decompressed;
     }
 
     if (checksum && options_.verify_checksums) {
@@ -373,8 +637,60 @@ class FileReader::Impl {
       }
     }
 
-    result.record = id_to_record_.at(identifier);
+    return result;
+  }
+
+  void ReadRaw(const RawOptions& options, const RawCallback& callback) {
+    const auto* const record = this->record(options.record);
+    if (record == nullptr) { return; }
+
+    const int64_t start_us =
+        options.start.is_not_a_date_time() ?
+        std::numeric_limits<int64_t>::min() :
+        base::ConvertPtimeToEpochMicroseconds(options.start);
+    const int64_t end_us =
+        options.end.is_not_a_date_time() ?
+        std::numeric_limits<int64_t>::max() :
+        base::ConvertPtimeToEpochMicroseconds(options.end);
 
+    RecordFilter filter{record->identifier};
+
+    DataHeader header;
+    std::string raw;
+    std::string decompressed;
+
+    Index index = start_;
+    while (true) {
+      const auto [found, next] = ReadUntil(index, &filter);
+      if (found < 0) { break; }
+      index = next;
+
+      const auto data = ReadData(found, &header, &raw, &decompressed);
+      const auto timestamp_us = header.timestamp_us.value_or(kNoTimestamp);
+      // As with Query, timestamps are not assumed to be monotonic,
+      // so the whole log is searched.
+      if (header.timestamp_us &&
+          (timestamp_us < start_us || timestamp_us > end_us)) {
+        continue;
+      }
+
+      callback(timestamp_us, data);
+    }
+  }
+
+  uint64_t count_hint(std::string_view name) {
+    // Only summaries listed in the index are used, so without them
+    // there is nothing to read.
+    if (!summary_positions_ || summary_positions_->empty()) { return 0; }
+
+    const auto* const record = this->record(name);
+    if (record == nullptr) { return 0; }
+
+    uint64_t result = 0;
+    for (const auto& segment : segments()) {
+      const auto it = segment.entries.find(record->identifier);
+      if (it != segment.entries.end()) { result += it->second.count; }
+    }
     return result;
   }
 
@@ -567,6 +883,159 @@ class FileReader::Impl {
     return result;
   }
 
+  QueryResult Query(const QueryOptions& options) {
+    QueryResult result;
+
+    const auto* const record = this->record(options.record);
+    if (record == nullptr) { return result; }
+
+    std::optional<NumericField> field;
+    if (options.field) { field.emplace(*record->schema, *options.field); }
+
+    const int64_t start_us =
+        options.start.is_not_a_date_time() ?
+        std::numeric_limits<int64_t>::min() :
+        base::ConvertPtimeToEpochMicroseconds(options.start);
+    const int64_t end_us =
+        options.end.is_not_a_date_time() ?
+        std::numeric_limits<int64_t>::max() :
+        base::ConvertPtimeToEpochMicroseconds(options.end);
+
+    RecordFilter filter{record->identifier};
+
+    for (const auto& segment : segments()) {
+      if (segment.summarized &&
+          !MayMatch(segment, record->identifier, options, start_us, end_us)) {
+        result.segments_skipped++;
+        continue;
+      }
+
+      result.segments_scanned++;
+
+      Index index = segment.start;
+      while (true) {
+        const auto [found, next] = ReadUntil(index, &filter);
+        if (found < 0 || found >= segment.end) { break; }
+        index = next;
+
+        auto item = Read(found);
+        if (!item.timestamp.is_not_a_date_time()) {
+          const auto item_us =
+              base::ConvertPtimeToEpochMicroseconds(item.timestamp);
+          if (item_us < start_us || item_us > end_us) { continue; }
+        }
+        if (field) {
+          const double value = field->Read(item.data);
+          if (!(value >= options.min && value <= options.max)) { continue; }
+        }
+
+        result.items.push_back(std::move(item));
+      }
+    }
+
+    return result;
+  }
+
+  struct SummaryEntry {
+    uint64_t count = 0;
+    int64_t min_us = 0;
+    int64_t max_us = 0;
+    std::map<std::string, std::pair<double, double>, std::less<>> fields;
+  };
+
+  /// The data blocks in [start, end), described by the summary block
+  /// at 'end' if 'summarized' is true.
+  struct Segment {
+    Index start = 0;
+    Index end = 0;
+    bool summarized = false;
+    std::map<Identifier, SummaryEntry> entries;
+  };
+
+  bool MayMatch(const Segment& segment, Identifier identifier,
+                const QueryOptions& options,
+                int64_t start_us, int64_t end_us) const {
+    const auto it = segment.entries.find(identifier);
+    if (it == segment.entries.end()) { return false; }
+    const auto& entry = it->second;
+    if (entry.count == 0) { return false; }
+
+    if (entry.min_us != kNoTimestamp &&
+        (entry.max_us < start_us || entry.min_us > end_us)) {
+      return false;
+    }
+
+    if (options.field) {
+      const auto field_it = entry.fields.find(*options.field);
+      if (field_it != entry.fields.end()) {
+        const auto [min, max] = field_it->second;
+        if (max < options.min || min > options.max) { return false; }
+      }
+    }
+
+    return true;
+  }
+
+  /// Summary blocks are located through the index, so that finding
+  /// them does not require reading the whole log.  If the index does
+  /// not list them, the log is treated as a single segment.
+  const std::vector<Segment>& segments() {
+    if (segments_) { return *segments_; }
+
+    segments_.emplace();
+    auto& result = *segments_;
+
+    Index segment_start = start_;
+    for (const auto position : summary_positions_.value_or(
+             std::vector<Index>())) {
+      fptr_.Seek(position);
+      const auto header = ReadHeader(file_).value();
+      if (header.type != Format::BlockType::kSummary) {
+        throw base::system_error(errc::kInvalidBlockType);
+      }
+      const auto block_end = fptr_.Tell() + static_cast<Index>(header.size);
+
+      BlockStream block_stream{file_, static_cast<std::streamsize>(header.size)};
+
+      Segment segment;
+      segment.start = segment_start;
+      segment.end = position;
+      segment.summarized = true;
+
+      telemetry::ReadStream stream{block_stream};
+      const auto flags = stream.ReadVaruint().value();
+      if (flags != 0) {
+        throw base::system_error(errc::kUnknownSummaryFlag);
+      }
+      const auto nelements = stream.ReadVaruint().value();
+      for (uint64_t i = 0; i < nelements; i++) {
+        const auto identifier = stream.ReadVaruint().value();
+        auto& entry = segment.entries[identifier];
+        entry.count = stream.ReadVaruint().value();
+        entry.min_us = stream.Read<int64_t>().value();
+        entry.max_us = stream.Read<int64_t>().value();
+        const auto nfields = stream.ReadVaruint().value();
+        for (uint64_t j = 0; j < nfields; j++) {
+          auto path = stream.ReadString().value();
+          const auto min = stream.Read<double>().value();
+          const auto max = stream.Read<double>().value();
+          entry.fields[std::move(path)] = std::make_pair(min, max);
+        }
+      }
+
+      result.push_back(std::move(segment));
+      segment_start = block_end;
+    }
+
+    // Anything after the final summary must always be searched.
+    Segment remainder;
+    remainder.start = segment_start;
+    remainder.end = fptr_.size();
+    result.push_back(std::move(remainder));
+
+    return result;
+  }
+
   void FullScan() {
     class NoFilter : public Filter {
      public:
@@ -575,48 +1044,123 @@ class FileReader::Impl {
     };
 
     NoFilter no_filter;
-    ReadUntil(start_, &no_filter);
+
+    // If the log was not closed cleanly, the most recent index
+    // checkpoint lets us skip everything before it.
+    const auto checkpoint = FindIndexCheckpoint();
+    ReadUntil(checkpoint.value_or(start_), &no_filter);
     all_records_found_ = true;
   }
 
   void MaybeProcessIndex() {
+    if (!ProcessIndex(fptr_.size())) { return; }
+
+    has_index_ = true;
+    all_records_found_ = true;
+  }
+
+  /// Search backwards from the end of the file for the most recent
+  /// valid index block, as written periodically by FileWriter.  This
+  /// is useful for logs which were not closed cleanly.
+  ///
+  /// @return the position immediately after the index block
+  std::optional<Index> FindIndexCheckpoint() {
+    constexpr int64_t kChunkSize = 1 << 16;
+
+    // Checkpoints are written periodically, so if one has not been
+    // found near the end, there likely are none and searching
+    // further would just read the whole log twice.
+    const int64_t search_start = std::max<int64_t>(
+        start_, fptr_.size() - options_.index_checkpoint_search_size);
+    if (search_start >= fptr_.size()) { return {}; }
+    checkpoint_stats_.searches++;
+
+    std::vector<char> buffer;
+    int64_t chunk_end = fptr_.size();
+    while ((chunk_end - search_start) >= 8) {
+      const int64_t chunk_start =
+          std::max<int64_t>(search_start, chunk_end - kChunkSize);
+      buffer.resize(chunk_end - chunk_start);
+      fptr_.Seek(chunk_start);
+      file_.read(base::string_span(buffer.data(), buffer.size()));
+      checkpoint_stats_.bytes_searched += buffer.size();
+
+      for (int64_t i = static_cast<int64_t>(buffer.size()) - 8; i >= 0; i--) {
+        if (buffer[i] != 'T' ||
+            std::memcmp(&buffer[i], "TLOGIDEX", 8) != 0) {
+          continue;
+        }
+
+        const auto end = chunk_start + i + 8;
+        try {
+          if (ProcessIndex(end)) { return end; }
+        } catch (base::system_error&) {
+          // This was just a false positive.
+        } catch (std::bad_optional_access&) {
+          // As was this.
+        }
+      }
+
+      if (chunk_start == search_start) { break; }
+      // Overlap our chunks so as to find markers which span them.
+      chunk_end = chunk_start + 7;
+    }
+
+    checkpoint_stats_.misses++;
+    return {};
+  }
+
+  /// Attempt to process an index block which ends at @p end.
+  ///
+  /// @return false if there does not appear to be one there
+  bool ProcessIndex(Index end) {
+    if ((end - start_) < 12) { return false; }
+
     // Seek to 8 bytes from the end.
-    fptr_.Seek(fptr_.size() - 8);
+    fptr_.Seek(end - 8);
     char trailer[8] = {};
     file_.read(trailer);
 
     if (std::memcmp(trailer, "TLOGIDEX", 8) != 0) {
       // Nope, definitely not an index.
-      return;
+      return false;
     }
 
     // We have something that looks plausibly like an index.  Lets see
     // if it validates as an entire block.
-    fptr_.Seek(fptr_.size() - 12);
+    fptr_.Seek(end - 12);
     telemetry::ReadStream stream{file_};
     const uint32_t trailer_size = stream.Read<uint32_t>().value();
-    if (trailer_size >= (fptr_.size() - start_)) {
+    if (trailer_size >= (end - start_)) {
       // This purported record would be bigger than the entire log.
-      return;
+      return false;
     }
 
-    fptr_.Seek(fptr_.size() - trailer_size);
-    const auto maybe_header = ReadHeader(file_);
+    const auto block_start = end - trailer_size;
+    fptr_.Seek(block_start);
+    const auto maybe_header = ReadHeader(file_, false);
     if (!maybe_header) {
       // Nope.  Some other corruption.
-      return;
+      return false;
     }
     const auto header = *maybe_header;
     if (header.type != Format::BlockType::kIndex) {
       // Hmmmph.  Wrong type.
-      return;
+      return false;
+    }
+    if ((fptr_.Tell() - block_start) +
+        static_cast<int64_t>(header.size) != trailer_size) {
+      // The block size doesn't match the trailer.
+      return false;
     }
 
     // From here on out we'll assume the index was supposed to be
     // here, and thus we'll let other parse errors trickle up as
     // exceptions rather than silently ignoring the index block.
     const auto flags = stream.ReadVaruint().value();
-    if (flags != 0) {
+    const auto kSummaries = static_cast<uint64_t>(
+        Format::BlockIndexFlags::kSummaries);
+    if (flags & ~kSummaries) {
       throw base::system_error(errc::kUnknownIndexFlag);
     }
 
@@ -637,39 +1181,253 @@ class FileReader::Impl {
       local_records.push_back(record);
     }
 
+    std::optional<std::vector<Index>> summaries;
+    if (flags & kSummaries) {
+      summaries.emplace();
+      const auto nsummaries = stream.ReadVaruint().value();
+      for (uint64_t i = 0; i < nsummaries; i++) {
+        const auto summary = static_cast<Index>(stream.Read<uint64_t>().value());
+        if (summary < start_ || summary >= block_start) {
+          throw base::system_error(errc::kInvalidBlockType);
+        }
+        summaries->push_back(summary);
+      }
+    }
+
     // Now go and find all the schemas so that we can fill in our
-    // records structures.
-    MJ_ASSERT(records_.empty());
-    final_item_ = 0;
+    // records structures.  Every one is read and validated before any
+    // state is changed, so that a block which merely resembles an
+    // index leaves the reader untouched.
+    std::vector<Record> new_records;
+    Index new_final_item = std::max<Index>(final_item_, 0);
     for (const auto& local_record : local_records) {
+      if (local_record.schema_location < start_ ||
+          local_record.schema_location >= block_start) {
+        throw base::system_error(errc::kInvalidBlockType);
+      }
       fptr_.Seek(local_record.schema_location);
       const auto header = ReadHeader(file_).value();
+      if (header.type != Format::BlockType::kSchema ||
+          header.size > static_cast<uint64_t>(
+              block_start - local_record.schema_location)) {
+        throw base::system_error(errc::kInvalidBlockType);
+      }
       BlockStream block_stream{file_, static_cast<std::streamsize>(header.size)};
-      const auto* record = ProcessSchema(block_stream, nullptr);
-      MJ_ASSERT(record->identifier == local_record.identifier);
-      if (local_record.final_record > final_item_) {
-        final_item_ = local_record.final_record;
+      telemetry::ReadStream schema_stream{block_stream};
+      const auto identifier = schema_stream.ReadVaruint().value();
+      if (identifier != local_record.identifier) {
+        throw base::system_error(errc::kUnknownRecord);
+      }
+      if (id_to_record_.count(identifier) == 0) {
+        new_records.push_back(ReadSchema(identifier, block_stream));
+      }
+      if (local_record.final_record > new_final_item) {
+        new_final_item = local_record.final_record;
       }
     }
 
-    has_index_ = true;
-    all_records_found_ = true;
+    for (auto& record : new_records) {
+      if (id_to_record_.count(record.identifier)) { continue; }
+      AddRecord(std::move(record), nullptr);
+    }
+    final_item_ = new_final_item;
+    summary_positions_ = std::move(summaries);
+
+    return true;
   }
 
   const Options options_;
   FilePtr fptr_;
   base::FileStream file_{fptr_.file()};
 
+  std::optional<std::vector<Segment>> segments_;
+
+  std::optional<BlockCache> cache_;
+  CacheStats cache_stats_;
+  CheckpointStats checkpoint_stats_;
+
+  // This must be destroyed before fptr_.
+  std::optional<Prefetcher> prefetcher_;
+  Index last_read_ = 0;
+  Index prefetch_start_ = 0;
+  Index prefetch_end_ = 0;
+
   std::deque<Record> records_;
   std::map<Identifier, const Record*> id_to_record_;
   std::map<std::string, const Record*> name_to_record_;
 
+  // The location of every summary block, if the index listed them.
+  std::optional<std::vector<Index>> summary_positions_;
+
   Index final_item_ = -1;
   bool has_index_ = false;
   bool all_records_found_ = false;
   int64_t start_ = 0;
 };
 
+struct FileReader::JoinContext {
+  FileReader::Impl* impl = nullptr;
+  JoinOptions options;
+  ItemRangeContext filter;
+
+  Index position = -1;
+  bool exhausted = false;
+
+  static constexpr int kDriver = -1;
+  static constexpr int kUnrelated = -2;
+
+  std::map<const Record*, int> slots;
+
+  // The recent items of each joined record, in file order.
+  std::vector<std::deque<std::shared_ptr<const Item>>> history;
+
+  struct Pending {
+    JoinedItem joined;
+
+    // True for each joined record once an item following the driver
+    // has been found, after which no better previous item is
+    // expected.
+    std::vector<bool> settled;
+  };
+
+  // Driver items are held here until every joined record is settled.
+  std::deque<Pending> pending;
+  std::deque<JoinedItem> ready;
+
+  void Fill() {
+    while (ready.empty() && !exhausted) {
+      Step();
+    }
+  }
+
+  int Slot(const Record* record) {
+    const auto it = slots.find(record);
+    if (it != slots.end()) { return it->second; }
+
+    const int result = [&]() {
+      if (record->name == options.driver) { return kDriver; }
+      const auto& records = options.records;
+      const auto found =
+          std::find(records.begin(), records.end(), record->name);
+      if (found == records.end()) { return kUnrelated; }
+      return static_cast<int>(found - records.begin());
+    }();
+    slots.insert(std::make_pair(record, result));
+    return result;
+  }
+
+  /// @return true if @p item belongs at or before the driver time
+  /// @p timestamp.  Items without timestamps are ordered by their
+  /// position in the file, as given by @p read_first.
+  static bool AtOrBefore(const Item& item,
+                         boost::posix_time::ptime timestamp,
+                         bool read_first) {
+    if (timestamp.is_not_a_date_time() ||
+        item.timestamp.is_not_a_date_time()) {
+      return read_first;
+    }
+    return item.timestamp <= timestamp;
+  }
+
+  /// Consider @p item as a neighbor of the driver in @p entry.
+  void Update(Pending* entry, std::size_t slot,
+              const std::shared_ptr<const Item>& item, bool read_first) {
+    auto& joined = entry->joined;
+    if (AtOrBefore(*item, joined.driver.timestamp, read_first)) {
+      auto& previous = joined.previous[slot];
+      if (!previous || !(item->timestamp < previous->timestamp)) {
+        previous = item;
+      }
+      return;
+    }
+
+    entry->settled[slot] = true;
+    if (options.include_next && !joined.next[slot]) {
+      joined.next[slot] = item;
+    }
+  }
+
+  bool Absent(std::size_t slot) const {
+    // If every record is known, one which does not exist will never
+    // produce an item.
+    return impl->all_records_found_ &&
+        impl->name_to_record_.count(options.records[slot]) == 0;
+  }
+
+  static bool Settled(const Pending& entry) {
+    return std::all_of(entry.settled.begin(), entry.settled.end(),
+                       [](bool value) { return value; });
+  }
+
+  void Emit() {
+    while (!pending.empty() &&
+           (Settled(pending.front()) ||
+            pending.size() > options.max_pending)) {
+      ready.push_back(std::move(pending.front().joined));
+      pending.pop_front();
+    }
+  }
+
+  void Step() {
+    const auto [found, after] = impl->ReadUntil(position, &filter);
+    if (found < 0) {
+      exhausted = true;
+      for (auto& entry : pending) {
+        ready.push_back(std::move(entry.joined));
+      }
+      pending.clear();
+      return;
+    }
+    position = after;
+
+    auto item = std::make_shared<const Item>(impl->Read(found));
+    const int slot = Slot(item->record);
+    if (slot == kUnrelated) { return; }
+
+    if (slot == kDriver) {
+      const auto size = options.records.size();
+      Pending entry;
+      entry.joined.driver = *item;
+      entry.joined.previous.resize(size);
+      if (options.include_next) { entry.joined.next.resize(size); }
+      entry.settled.resize(size);
+      for (std::size_t i = 0; i < size; i++) {
+        entry.settled[i] = Absent(i);
+        for (const auto& side : history[i]) {
+          Update(&entry, i, side, true);
+        }
+      }
+      pending.push_back(std::move(entry));
+
+      // Assuming driver timestamps do not decrease, only the newest
+      // item at or before this one can be needed again.
+      const auto last_driver = item->timestamp;
+      if (!last_driver.is_not_a_date_time()) {
+        for (auto& items : history) {
+          while (items.size() >= 2 &&
+                 !items[1]->timestamp.is_not_a_date_time() &&
+                 items[1]->timestamp <= last_driver) {
+            items.pop_front();
+          }
+        }
+      }
+
+      Emit();
+      return;
+    }
+
+    auto& items = history[slot];
+    items.push_back(item);
+    if (items.size() > options.max_pending) { items.pop_front(); }
+
+    for (auto& entry : pending) {
+      Update(&entry, slot, item, false);
+    }
+
+    Emit();
+  }
+};
+
 FileReader::FileReader(std::string_view filename, const Options& options)
     : impl_(std::make_unique<Impl>(filename, options)) {}
 
@@ -695,6 +1453,27 @@ FileReader::SeekResult FileReader::Seek(boost::posix_time::ptime timestamp) {
   return impl_->Seek(timestamp);
 }
 
+FileReader::QueryResult FileReader::Query(const QueryOptions& options) {
+  return impl_->Query(options);
+}
+
+void FileReader::ReadRaw(const RawOptions& options,
+                         const RawCallback& callback) {
+  impl_->ReadRaw(options, callback);
+}
+
+uint64_t FileReader::count_hint(std::string_view record) {
+  return impl_->count_hint(record);
+}
+
+FileReader::CacheStats FileReader::cache_stats() const {
+  return impl_->cache_stats();
+}
+
+FileReader::CheckpointStats FileReader::checkpoint_stats() const {
+  return impl_->checkpoint_stats_;
+}
+
 FileReader::Item FileReader::ItemIterator::operator*() {
   return context_->impl->Read(index_);
 }
@@ -728,5 +1507,58 @@ FileReader::ItemRange FileReader::items(const ItemsOptions& options) {
   return impl_->items(options);
 }
 
+FileReader::JoinRange FileReader::join(const JoinOptions& options) {
+  auto context = std::make_shared<JoinContext>();
+  context->impl = impl_.get();
+  context->options = options;
+  context->position =
+      options.start < 0 ? impl_->start_ : options.start;
+  context->history.resize(options.records.size());
+
+  ItemsOptions items_options;
+  items_options.records = options.records;
+  items_options.records.push_back(options.driver);
+  // Any records whose schemas we have not seen yet are resolved by
+  // the filter as they are encountered.
+  context->filter.impl = impl_.get();
+  context->filter.options = items_options;
+  for (const auto& name : items_options.records) {
+    const auto it = impl_->name_to_record_.find(name);
+    if (it != impl_->name_to_record_.end()) {
+      context->filter.ids.insert(it->second->identifier);
+    } else {
+      context->filter.unknown_names.insert(name);
+    }
+  }
+
+  return JoinRange(context);
+}
+
+const FileReader::JoinedItem& FileReader::JoinIterator::operator*() const {
+  return context_->ready.front();
+}
+
+FileReader::JoinIterator& FileReader::JoinIterator::operator++() {
+  context_->ready.pop_front();
+  context_->Fill();
+  return *this;
+}
+
+bool FileReader::JoinIterator::operator!=(const JoinIterator& rhs) const {
+  const auto is_end = [](const auto& context) {
+    return !context || context->ready.empty();
+  };
+  return is_end(context_) != is_end(rhs.context_);
+}
+
+FileReader::JoinIterator FileReader::JoinRange::begin() {
+  context_->Fill();
+  return JoinIterator(context_);
+}
+
+FileReader::JoinIterator FileReader::JoinRange::end() {
+  return JoinIterator(nullptr);
+}
+
 }
 }
@@ -14,7 +14,10 @@
 
 #pragma once
 
+#include <functional>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <string>
 
 #include <boost/date_time/posix_time/posix_time_types.hpp>
@@ -33,6 +36,25 @@ class FileReader {
   struct Options {
     bool verify_checksums = true;
 
+    /// If non-zero, decoded data blocks are retained in a least
+    /// recently used cache holding up to this many bytes of payload.
+    /// Reading a cached item again requires no I/O or decompression.
+    std::size_t cache_size = 0;
+
+    /// If non-zero, a background thread asks the operating system to
+    /// read this many bytes of the file ahead of each item which is
+    /// read, in whichever direction reads are progressing.
+    int64_t prefetch_size = 0;
+
+    /// When the log has no trailing index, search at most this many
+    /// bytes back from the end for an index checkpoint to resume
+    /// scanning from.  This must exceed the amount of data the writer
+    /// produces in one FileWriter::Options::index_checkpoint_period_s,
+    /// or checkpoints will not be found and the whole log is scanned
+    /// instead.  See checkpoint_stats.  A zero value disables the
+    /// search.
+    int64_t index_checkpoint_search_size = 4 << 20;
+
     Options() {}
   };
 
@@ -44,6 +66,12 @@ class FileReader {
   /// An opaque token used to refer to positions in the log file.
   using Index = int64_t;
 
+  /// Integer timestamps are in microseconds since the epoch.  This
+  /// value indicates that no timestamp was present, and matches
+  /// FileWriter::kNoTimestamp.
+  static constexpr int64_t kNoTimestamp =
+      std::numeric_limits<int64_t>::min() + 1;
+
   struct Record {
     /// An arbitrary identifier.  Should typically not be used by
     /// clients.
@@ -51,7 +79,8 @@ class FileReader {
 
     std::string name;
     std::string raw_schema;
-    std::unique_ptr<BinarySchemaParser> schema;
+    /// Shared with other readers through SchemaCache::Global().
+    std::shared_ptr<const BinarySchemaParser> schema;
 
     /// The flags as set in the log, corresponding to
     /// Format::BlockSchemaFlags
@@ -123,6 +152,168 @@ class FileReader {
 
   ItemRange items(const ItemsOptions& = {});
 
+  struct JoinOptions {
+    /// Each item of this record produces one JoinedItem.
+    std::string driver;
+
+    /// The records to join against the driver.
+    std::vector<std::string> records;
+
+    /// If true, also report the first item of each joined record
+    /// whose timestamp follows each driver item, so that values can
+    /// be interpolated.
+    bool include_next = false;
+
+    /// Items need not be written in timestamp order, so each driver
+    /// item is held until an item with a later timestamp has been
+    /// found for every joined record.  No more than this many are
+    /// held, after which they are reported with whatever is known at
+    /// the time.  The same bound applies to the recent items retained
+    /// for each joined record.
+    std::size_t max_pending = 1024;
+
+    Index start = -1;
+
+    JoinOptions() {}
+  };
+
+  struct JoinedItem {
+    Item driver;
+
+    /// One entry for each of JoinOptions::records, in the same
+    /// order, holding the item with the latest timestamp at or before
+    /// that of the driver.  Items without timestamps are instead
+    /// ordered by their position in the file.  An entry is nullptr if
+    /// no such item exists.
+    std::vector<std::shared_ptr<const Item>> previous;
+
+    /// Only populated if JoinOptions::include_next is set, holding
+    /// the first item with a timestamp after that of the driver.
+    std::vector<std::shared_ptr<const Item>> next;
+  };
+
+  struct JoinContext;
+
+  struct JoinIterator {
+    JoinIterator(std::shared_ptr<JoinContext> context)
+        : context_(context) {}
+
+    const JoinedItem& operator*() const;
+    JoinIterator& operator++();
+    bool operator!=(const JoinIterator&) const;
+
+   private:
+    std::shared_ptr<JoinContext> context_;
+  };
+
+  struct JoinRange {
+    JoinRange(std::shared_ptr<JoinContext> context)
+        : context_(context) {}
+
+    JoinIterator begin();
+    JoinIterator end();
+
+   private:
+    std::shared_ptr<JoinContext> context_;
+  };
+
+  /// Iterate over the items of one record, pairing each with the
+  /// items of other records which were current at its timestamp.  The file is read once,
+  /// sequentially, regardless of how many records are joined.
+  JoinRange join(const JoinOptions&);
+
+  struct QueryOptions {
+    /// The name of the record to search.
+    std::string record;
+
+    /// If set, only items where this numeric field, as described in
+    /// NumericField, lies within [min, max] are returned.
+    std::optional<std::string> field;
+    double min = -std::numeric_limits<double>::infinity();
+    double max = std::numeric_limits<double>::infinity();
+
+    /// If not not_a_date_time, only items within [start, end] are
+    /// returned.
+    boost::posix_time::ptime start;
+    boost::posix_time::ptime end;
+
+    QueryOptions() {}
+  };
+
+  struct QueryResult {
+    std::vector<Item> items;
+
+    /// The log is divided into segments by its summary blocks.  These
+    /// count how many needed to be decoded, and how many could be
+    /// skipped entirely based on their summary.
+    int segments_scanned = 0;
+    int segments_skipped = 0;
+  };
+
+  /// Find all items of a single record matching the given
+  /// constraints.  Segments of the log whose summary block shows
+  /// they cannot contain a match are not decoded.  Summary blocks are
+  /// located through the log's index, which FileWriter fills in when
+  /// summary blocks are enabled.  Logs whose index does not list
+  /// them, or which have no index, are searched in their entirety.
+  QueryResult Query(const QueryOptions&);
+
+  struct RawOptions {
+    std::string record;
+
+    /// If not not_a_date_time, only items within [start, end] are
+    /// reported.
+    boost::posix_time::ptime start;
+    boost::posix_time::ptime end;
+
+    RawOptions() {}
+  };
+
+  /// The data view is only valid for the duration of the callback.
+  using RawCallback =
+      std::function<void (int64_t timestamp_us, std::string_view data)>;
+
+  /// Report the payload of every item of a single record, decompressed
+  /// as necessary, without constructing an Item for each.  As with
+  /// Query, timestamps need not be monotonic, so the whole log is
+  /// read even when an end is given.  This is the basis for ReadAll
+  /// in read_all.h.
+  void ReadRaw(const RawOptions&, const RawCallback&);
+
+  /// A lower bound on the number of items of the given record,
+  /// derived from the summary blocks listed in the log's index.  It
+  /// is zero, and is found without reading the log, if there are
+  /// none.
+  uint64_t count_hint(std::string_view record);
+
+  struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+
+    /// The number of payload bytes currently held.
+    std::size_t size = 0;
+
+    /// The number of read-ahead requests issued.
+    uint64_t prefetches = 0;
+  };
+
+  CacheStats cache_stats() const;
+
+  struct CheckpointStats {
+    /// Non-zero if the log had no trailing index, and so was searched
+    /// for an index checkpoint.
+    uint64_t searches = 0;
+
+    /// The number of those searches which found no checkpoint within
+    /// Options::index_checkpoint_search_size.
+    uint64_t misses = 0;
+
+    uint64_t bytes_searched = 0;
+  };
+
+  CheckpointStats checkpoint_stats() const;
+
  private:
   std::unique_ptr<Impl> impl_;
 };
@@ -35,6 +35,7 @@ class BlockType(enum.IntEnum):
     Index = 3
     CompressionDictionary = 4
     SeekMarker = 5
+    Summary = 6
 
 
 class FileReader:
@@ -14,7 +14,13 @@
 
 #include "mjlib/telemetry/file_writer.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <limits>
 #include <list>
 #include <map>
 #include <mutex>
@@ -29,7 +35,10 @@
 
 #include "mjlib/base/buffer_stream.h"
 #include "mjlib/base/fail.h"
+#include "mjlib/base/system_error.h"
 #include "mjlib/base/thread_writer.h"
+#include "mjlib/telemetry/binary_schema_parser.h"
+#include "mjlib/telemetry/numeric_field.h"
 
 namespace mjlib {
 namespace telemetry {
@@ -46,48 +55,570 @@ using FilePosition = int64_t;
 using Identifier = FileWriter::Identifier;
 using base::ThreadWriter;
 
-struct SchemaRecord {
+/// A bounded pool of idle buffers, which may be used concurrently
+/// from any number of threads without locking.  Each slot holds at
+/// most one buffer and is emptied or filled with a single atomic
+/// operation, so there is no ABA hazard.
+class BufferPool {
+ public:
+  using Buffer = FileWriter::Buffer;
+  using Stats = FileWriter::BufferPoolStats;
+
+  BufferPool(std::size_t size) : slots_(size) {}
+
+  ~BufferPool() {
+    for (auto& slot : slots_) {
+      delete slot.load();
+    }
+  }
+
+  Buffer Get() {
+    const auto in_use = in_use_.fetch_add(1, std::memory_order_relaxed) + 1;
+    auto high_water = high_water_.load(std::memory_order_relaxed);
+    while (in_use > high_water &&
+           !high_water_.compare_exchange_weak(
+               high_water, in_use, std::memory_order_relaxed)) {}
+
+    // Start where a buffer was most recently returned, as that is
+    // most likely to be occupied.
+    const auto start = hint_.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < slots_.size(); i++) {
+      const auto index = (start + i) % slots_.size();
+      auto& slot = slots_[index];
+      if (slot.load(std::memory_order_relaxed) == nullptr) { continue; }
+      auto* const item = slot.exchange(nullptr, std::memory_order_acquire);
+      if (item == nullptr) { continue; }
+
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return Buffer(item);
+    }
+
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return std::make_unique<ThreadWriter::OStream>();
+  }
+
+  void Put(Buffer buffer) {
+    in_use_.fetch_sub(1, std::memory_order_relaxed);
+
+    const auto start = hint_.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < slots_.size(); i++) {
+      const auto index = (start + i) % slots_.size();
+      ThreadWriter::OStream* expected = nullptr;
+      if (slots_[index].compare_exchange_strong(
+              expected, buffer.get(), std::memory_order_release,
+              std::memory_order_relaxed)) {
+        buffer.release();
+        hint_.store(index, std::memory_order_relaxed);
+        return;
+      }
+    }
+
+    // The pool is full, so this one is freed.
+    discards_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  Stats stats() const {
+    Stats result;
+    result.hits = hits_.load();
+    result.misses = misses_.load();
+    result.discards = discards_.load();
+    result.high_water = high_water_.load();
+    return result;
+  }
+
+ private:
+  std::vector<std::atomic<ThreadWriter::OStream*>> slots_;
+  std::atomic<std::size_t> hint_{0};
+
+  std::atomic<int64_t> in_use_{0};
+  std::atomic<int64_t> high_water_{0};
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> discards_{0};
+};
+
+/// Write a complete SeekMarker block.  @p offsets holds, for each
+/// identifier, the number of bytes from the start of this block back
+/// to the most recent data block.
+void WriteSeekMarker(
+    base::WriteStream& out, int64_t timestamp_us,
+    const std::vector<std::pair<Identifier, uint64_t>>& offsets) {
+  base::FastOStringStream body;
+  WriteStream stream(body);
+
+  stream.Write(static_cast<uint64_t>(0xfdcab9a897867564));
+  stream.Write(static_cast<uint32_t>(0));  // placeholder crc
+  stream.Write(static_cast<uint8_t>(0));  // placeholder header size
+
+  stream.WriteVaruint(0);  // flags
+  stream.Write(timestamp_us);
+  stream.WriteVaruint(offsets.size());
+  for (const auto& pair : offsets) {
+    stream.WriteVaruint(pair.first);
+    stream.WriteVaruint(pair.second);
+  }
+
+  base::FastOStringStream header;
+  WriteStream header_stream(header);
+  header_stream.WriteVaruint(u64(Format::BlockType::kSeekMarker));
+  header_stream.WriteVaruint(body.view().size());
+
+  std::string block = header.str() + body.str();
+  const auto header_size = header.view().size();
+  const auto crc_pos = header_size + 8;
+  block[crc_pos + 4] = static_cast<char>(header_size);
+
+  boost::crc_32_type crc;
+  crc.process_bytes(block.data(), block.size());
+  const uint32_t checksum = crc.checksum();
+  std::memcpy(&block[crc_pos], &checksum, sizeof(checksum));
+
+  out.write(block);
+}
+
+struct IndexEntry {
+  Identifier identifier = 0;
+  FilePosition schema_position = -1;
+  FilePosition last_position = -1;
+};
+
+/// Write the body of an Index block, including its trailer.
+///
+/// @param summaries the location of every summary block, which lets
+/// readers find them without scanning the log
+void WriteIndexBody(base::WriteStream& out,
+                    const std::vector<IndexEntry>& entries,
+                    const std::vector<FilePosition>& summaries) {
+  base::FastOStringStream body;
+  WriteStream stream(body);
+
+  const uint64_t flags =
+      summaries.empty() ? 0 :
+      u64(Format::BlockIndexFlags::kSummaries);
+  stream.WriteVaruint(flags);
+  stream.WriteVaruint(entries.size());
+
+  for (const auto& entry : entries) {
+    // Write out the BlockIndexRecord for each.
+    stream.WriteVaruint(entry.identifier);
+    stream.Write(u64(entry.schema_position));
+    stream.Write(u64(entry.last_position));
+  }
+
+  if (!summaries.empty()) {
+    stream.WriteVaruint(summaries.size());
+    for (const auto summary : summaries) {
+      stream.Write(u64(summary));
+    }
+  }
+
+  const uint32_t trailing_size = body.view().size() +
+      1 + // block type
+      Format::GetVaruintSize(body.view().size() + 4 + 8) +
+      4 + // this element itself
+      8; // the final 8 byte constant
+
+  stream.Write(trailing_size);
+  stream.RawWrite({"TLOGIDEX", 8});
+
+  out.write(body.view());
+}
+
+/// Holds the most recent blocks of a log in memory, for the flight
+/// recorder mode.  Blocks are grouped into segments, and only whole
+/// segments are discarded.  A segment begins at each seek point, and
+/// also whenever the current one reaches a fraction of the capacity,
+/// so that memory remains bounded when no seek points occur.  Schema
+/// blocks are retained even after their segment is discarded.
+///
+/// Blocks are appended from the writing thread, while snapshots may
+/// be taken from any thread.
+class Ring {
+ public:
+  struct Block {
+    Format::BlockType type = {};
+    Identifier identifier = 0;
+    std::size_t offset = 0;
+    std::size_t size = 0;
+  };
+
+  struct Segment {
+    /// The timestamp of the seek point which begins this segment, or
+    /// kNoTimestamp if it does not begin at one.
+    int64_t timestamp_us = FileWriter::kNoTimestamp;
+    std::string data;
+    std::vector<Block> blocks;
+
+    std::string_view block_data(const Block& block) const {
+      return std::string_view(data).substr(block.offset, block.size);
+    }
+  };
+
+  struct Snapshot {
+    /// The schema blocks which were in effect at the start of the
+    /// first segment.
+    std::vector<std::string> schemas;
+    std::vector<std::shared_ptr<const Segment>> segments;
+  };
+
+  Ring(int64_t capacity)
+      : capacity_(capacity),
+        segment_limit_(std::max<int64_t>(1, capacity / kSegmentFraction)) {}
+
+  void Append(std::string_view data) {
+    base::BufferReadStream base_stream{data};
+    ReadStream stream{base_stream};
+
+    Block block;
+    block.type = static_cast<Format::BlockType>(stream.ReadVaruint().value());
+    // Seek markers are regenerated when dumping.
+    if (block.type == Format::BlockType::kSeekMarker) { return; }
+    stream.ReadVaruint();  // size
+    if (block.type == Format::BlockType::kSchema ||
+        block.type == Format::BlockType::kData) {
+      block.identifier = stream.ReadVaruint().value();
+    }
+    block.size = data.size();
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    block.offset = current_->data.size();
+    current_->data.append(data);
+    current_->blocks.push_back(block);
+    size_ += data.size();
+    position_ += data.size();
+
+    if (static_cast<int64_t>(current_->data.size()) >= segment_limit_) {
+      // This segment has no seek point of its own, so a dump which
+      // begins here will simply start with its first block.
+      StartSegmentLocked(FileWriter::kNoTimestamp);
+    }
+
+    Evict();
+  }
+
+  void StartSegment(int64_t timestamp_us) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    StartSegmentLocked(timestamp_us);
+  }
+
+  /// The total number of bytes ever appended.  This may only be
+  /// called from the writing thread.
+  FilePosition position() const { return position_; }
+
+  Snapshot snapshot() const {
+    Snapshot result;
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (const auto& pair : schemas_) {
+      result.schemas.push_back(pair.second);
+    }
+    result.segments.assign(closed_.begin(), closed_.end());
+    // The current segment is still being appended to, so it must be
+    // copied.  It is never larger than segment_limit_, plus one block.
+    result.segments.push_back(std::make_shared<Segment>(*current_));
+
+    return result;
+  }
+
+ private:
+  static constexpr int64_t kSegmentFraction = 8;
+
+  void StartSegmentLocked(int64_t timestamp_us) {
+    if (current_->blocks.empty()) {
+      // Nothing would be lost by reusing this one.
+      current_->timestamp_us = timestamp_us;
+      return;
+    }
+    closed_.push_back(std::move(current_));
+    current_ = std::make_shared<Segment>();
+    current_->timestamp_us = timestamp_us;
+  }
+
+  void Evict() {
+    while (size_ > capacity_ && !closed_.empty()) {
+      const auto& segment = *closed_.front();
+      for (const auto& block : segment.blocks) {
+        if (block.type != Format::BlockType::kSchema) { continue; }
+        schemas_[block.identifier] = std::string(segment.block_data(block));
+      }
+      size_ -= segment.data.size();
+      closed_.pop_front();
+    }
+  }
+
+  const int64_t capacity_;
+  const int64_t segment_limit_;
+
+  mutable std::mutex mutex_;
+  std::map<Identifier, std::string> schemas_;
+  std::deque<std::shared_ptr<const Segment>> closed_;
+  std::shared_ptr<Segment> current_ = std::make_shared<Segment>();
+  int64_t size_ = 0;
+  FilePosition position_ = 0;
+};
+
+/// Write a complete log from the contents of a Ring.
+void WriteRingSnapshot(const Ring::Snapshot& snapshot,
+                       const std::string& filename) {
+  FILE* file = ::fopen(filename.c_str(), "wb");
+  base::system_error::throw_if(
+      file == nullptr, fmt::format("When opening: '{}'", filename));
+  std::unique_ptr<FILE, decltype(&::fclose)> file_guard(file, &::fclose);
+
+  FilePosition position = 0;
+  auto write = [&](std::string_view data) {
+    base::system_error::throw_if(
+        ::fwrite(data.data(), 1, data.size(), file) != data.size());
+    position += data.size();
+  };
+
+  std::map<Identifier, IndexEntry> index;
+  std::vector<FilePosition> summaries;
+
+  // Segments which were started only because of their size do not
+  // begin at a seek point.  Leading ones are skipped, so that the
+  // dump starts at the oldest seek point, if any is retained.  Only
+  // their schemas are kept.
+  std::map<Identifier, std::string_view> schemas;
+  for (const auto& schema : snapshot.schemas) {
+    base::BufferReadStream base_stream{schema};
+    ReadStream stream{base_stream};
+    stream.ReadVaruint();  // type
+    stream.ReadVaruint();  // size
+    schemas[stream.ReadVaruint().value()] = schema;
+  }
+
+  auto first = std::find_if(
+      snapshot.segments.begin(), snapshot.segments.end(),
+      [](const auto& segment) {
+        return segment->timestamp_us != FileWriter::kNoTimestamp;
+      });
+  if (first == snapshot.segments.end()) {
+    first = snapshot.segments.begin();
+  }
+  for (auto it = snapshot.segments.begin(); it != first; ++it) {
+    for (const auto& block : (*it)->blocks) {
+      if (block.type != Format::BlockType::kSchema) { continue; }
+      schemas[block.identifier] = (*it)->block_data(block);
+    }
+  }
+
+  write({"TLOG0003\x00", 9});
+
+  for (const auto& pair : schemas) {
+    index[pair.first].identifier = pair.first;
+    index[pair.first].schema_position = position;
+    write(pair.second);
+  }
+
+  // A summary describes the data written since the one before it.
+  // Only those whose predecessor is also in the dump can be complete.
+  bool summary_seen = false;
+  for (auto it = first; it != snapshot.segments.end(); ++it) {
+    const auto& segment = *it;
+    if (segment->timestamp_us != FileWriter::kNoTimestamp) {
+      // Seek markers are regenerated, as the offsets recorded when
+      // the ring was filled may refer to discarded data.
+      std::vector<std::pair<Identifier, uint64_t>> offsets;
+      for (const auto& pair : index) {
+        if (pair.second.last_position < 0) { continue; }
+        offsets.push_back(std::make_pair(
+                              pair.first,
+                              position - pair.second.last_position));
+      }
+      base::FastOStringStream marker;
+      WriteSeekMarker(marker, segment->timestamp_us, offsets);
+      write(marker.view());
+    }
+
+    for (const auto& block : segment->blocks) {
+      switch (block.type) {
+        case Format::BlockType::kSchema: {
+          auto& entry = index[block.identifier];
+          entry.identifier = block.identifier;
+          entry.schema_position = position;
+          entry.last_position = -1;
+          break;
+        }
+        case Format::BlockType::kData: {
+          index[block.identifier].last_position = position;
+          break;
+        }
+        case Format::BlockType::kSummary: {
+          if (!summary_seen) {
+            summary_seen = true;
+            continue;
+          }
+          summaries.push_back(position);
+          break;
+        }
+        default: {
+          break;
+        }
+      }
+      write(segment->block_data(block));
+    }
+  }
+
+  std::vector<IndexEntry> entries;
+  for (const auto& pair : index) {
+    // Records which have only had data written have no schema to
+    // point to.
+    if (pair.second.schema_position < 0) { continue; }
+    entries.push_back(pair.second);
+  }
+
+  base::FastOStringStream body;
+  WriteIndexBody(body, entries, summaries);
+  base::FastOStringStream block;
+  WriteStream stream(block);
+  stream.WriteVaruint(u64(Format::BlockType::kIndex));
+  stream.WriteVaruint(body.view().size());
+  stream.RawWrite(body.view());
+  write(block.view());
+
+  base::system_error::throw_if(::fflush(file) != 0);
+}
+}
+
+/// All state associated with a single identifier.
+struct FileWriter::Record {
   std::string name;
   Identifier identifier = 0;
   uint64_t block_schema_flags = 0;
   std::string schema;
-  FilePosition schema_position;
+  FilePosition schema_position = 0;
   FilePosition last_position = -1;
 
-  SchemaRecord(std::string_view name,
-               Identifier identifier,
-               uint64_t block_schema_flags,
-               std::string_view schema,
-               FilePosition schema_position)
+  // The varuint encoded identifier, which begins every data block
+  // body for this record.
+  std::string encoded_identifier;
+
+  // Sampling state.  None of this is consulted unless
+  // 'sampling_enabled' is true.
+  bool sampling_enabled = false;
+  SamplingPolicy sampling;
+  int64_t min_period_us = 0;
+  int64_t burst_duration_us = 0;
+
+  uint64_t offered_count = 0;
+  bool in_burst = false;
+  int64_t admitted_us = kNoTimestamp;
+  int64_t last_written_us = kNoTimestamp;
+  bool has_last_data = false;
+  std::string last_data;
+
+  // Summary state, accumulated since the most recent summary block.
+  struct SummaryField {
+    NumericField field;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    SummaryField(const BinarySchemaParser& parser, std::string_view path)
+        : field(parser, path) {}
+  };
+
+  std::vector<std::string> summary_paths;
+  std::unique_ptr<BinarySchemaParser> summary_parser;
+  std::vector<SummaryField> summary_fields;
+  uint64_t summary_count = 0;
+  int64_t summary_min_us = kNoTimestamp;
+  int64_t summary_max_us = kNoTimestamp;
+
+  Record(std::string_view name,
+         Identifier identifier,
+         uint64_t block_schema_flags,
+         std::string_view schema,
+         FilePosition schema_position)
       : name(name),
         identifier(identifier),
         block_schema_flags(block_schema_flags),
         schema(schema),
-        schema_position(schema_position) {}
-  SchemaRecord() {}
+        schema_position(schema_position) {
+    Encode();
+  }
+
+  Record(Identifier identifier) : identifier(identifier) {
+    Encode();
+  }
+
+  void Encode() {
+    base::FastOStringStream ostr;
+    WriteStream stream(ostr);
+    stream.WriteVaruint(identifier);
+    encoded_identifier = ostr.str();
+  }
+
+  void ResolveSummaryFields() {
+    summary_fields.clear();
+    summary_parser.reset();
+    if (summary_paths.empty() || schema.empty()) { return; }
+
+    summary_parser = std::make_unique<BinarySchemaParser>(schema, name);
+    for (const auto& path : summary_paths) {
+      summary_fields.emplace_back(*summary_parser, path);
+    }
+  }
+
+  void UpdateSummary(int64_t timestamp_us, std::string_view data) {
+    summary_count++;
+    if (timestamp_us != kNoTimestamp) {
+      // Timestamps need not be monotonic, for instance when the
+      // system clock steps or API and system timestamps are mixed.
+      summary_min_us = (summary_min_us == kNoTimestamp) ?
+          timestamp_us : std::min(summary_min_us, timestamp_us);
+      summary_max_us = (summary_max_us == kNoTimestamp) ?
+          timestamp_us : std::max(summary_max_us, timestamp_us);
+    }
+    for (auto& summary_field : summary_fields) {
+      const double value = summary_field.field.Read(data);
+      summary_field.min = std::min(summary_field.min, value);
+      summary_field.max = std::max(summary_field.max, value);
+    }
+  }
+
+  void ResetSummary() {
+    summary_count = 0;
+    summary_min_us = kNoTimestamp;
+    summary_max_us = kNoTimestamp;
+    for (auto& summary_field : summary_fields) {
+      summary_field.min = std::numeric_limits<double>::infinity();
+      summary_field.max = -std::numeric_limits<double>::infinity();
+    }
+  }
 };
-}
 
 class FileWriter::Impl : public ThreadWriter::Reclaimer {
  public:
   Impl(const Options& options)
-      : options_(options) {}
+      : options_(options) {
+    if (options_.ring_size > 0) {
+      ring_ = std::make_unique<Ring>(options_.ring_size);
+    }
+  }
 
   virtual ~Impl() {
     Close();
   }
 
+  bool open() const {
+    return writer_ || ring_ || !sinks_.empty();
+  }
+
   ThreadWriter::Options GetWriterOptions() {
     ThreadWriter::Options options;
     options.blocking_mode = (
         options_.blocking ? ThreadWriter::kBlocking :
         ThreadWriter::kAsynchronous);
     options.reclaimer = this;
+    options.preallocate_size = options_.preallocate_size;
+    options.sync_size = options_.sync_size;
     return options;
   }
 
   void Open(std::string_view filename) {
     BOOST_ASSERT(!writer_);
+    BOOST_ASSERT(!ring_);
     writer_ = std::make_unique<ThreadWriter>(filename, GetWriterOptions());
 
     PostOpen();
@@ -95,16 +626,25 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
 
   void Open(int fd) {
     BOOST_ASSERT(!writer_);
+    BOOST_ASSERT(!ring_);
     writer_ = std::make_unique<ThreadWriter>(fd, GetWriterOptions());
     PostOpen();
   }
 
   void Close() {
-    if (!writer_) { return; }
+    if (dump_thread_.joinable()) { dump_thread_.join(); }
+    if (ring_) {
+      // Anything not already dumped is discarded.
+      ring_.reset();
+    } else {
+      if (!writer_) { return; }
 
-    if (options_.index_block) { WriteIndex(); }
-    writer_.reset();
-    last_seek_block_ = {};
+      if (options_.summary_block) { WriteSummary(); }
+      if (options_.index_block) { WriteIndex(); }
+      writer_.reset();
+    }
+    last_seek_block_us_ = kNoTimestamp;
+    last_checkpoint_us_ = kNoTimestamp;
   }
 
   void Flush() {
@@ -159,17 +699,60 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
     return true;
   }
 
-  void Write(Buffer buffer) {
+  /// If @p to_sinks is false, the block is only written to the file
+  /// or ring, as sinks receive their own version.
+  void Write(Buffer buffer, bool to_sinks = true) {
+    if (!sinks_.empty()) {
+      const std::string_view block(
+          buffer->data()->data() + buffer->start(), buffer->size());
+      if (to_sinks) {
+        for (auto& sink : sinks_) { WriteSink(&sink, block); }
+      }
+      if (!writer_ && !ring_) {
+        stream_position_ += block.size();
+        Reclaim(std::move(buffer));
+        return;
+      }
+    }
+
+    if (ring_) {
+      ring_->Append(std::string_view(
+                        buffer->data()->data() + buffer->start(),
+                        buffer->size()));
+      Reclaim(std::move(buffer));
+      return;
+    }
     if (!writer_) { return; }
 
     writer_->Write(std::move(buffer));
   }
 
-  void WriteData(boost::posix_time::ptime timestamp,
+  std::future<void> Dump(std::string_view filename) {
+    if (!ring_) {
+      mjlib::base::Fail("Dump requires a non-zero ring_size");
+    }
+
+    // Only one dump is in progress at a time.
+    if (dump_thread_.joinable()) { dump_thread_.join(); }
+
+    std::packaged_task<void()> task(
+        [snapshot = ring_->snapshot(), filename = std::string(filename)]() {
+          WriteRingSnapshot(snapshot, filename);
+        });
+    auto result = task.get_future();
+    dump_thread_ = std::thread(std::move(task));
+    return result;
+  }
+
+  void WriteData(int64_t timestamp_us,
                  Identifier identifier,
                  std::string_view serialized_data,
                  const WriteFlags& write_flags) {
-    if (!writer_) { return; }
+    if (!open()) { return; }
+
+    auto* const record = FindOrAddRecord(identifier);
+    if (!Admit(record, timestamp_us)) { return; }
+    if (!Changed(record, serialized_data)) { return; }
 
     auto buffer = GetBuffer();
 
@@ -177,12 +760,12 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
     // performance or the number of copies too much.
     buffer->write(serialized_data);
 
-    WriteData(timestamp, identifier, std::move(buffer), write_flags);
+    WriteRecordData(timestamp_us, record, std::move(buffer), write_flags);
   }
 
   void WriteBlock(Format::BlockType block_type,
                   std::string_view data) {
-    if (!writer_) { return; }
+    if (!open()) { return; }
 
     auto buffer = GetBuffer();
 
@@ -204,124 +787,281 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
 
       writer_->Write(std::move(buffer));
     }
+    summary_positions_.clear();
+
+    // Sinks have already received the schemas, so these go only to
+    // the file.
+    for (auto& pair: schema_) {
+      // Records which have only had data written have no schema.
+      auto& record = pair.second;
+      if (record.schema.empty()) { continue; }
+      record.schema_position = position();
+      record.last_position = -1;
+      writer_->Write(MakeSchemaBlock(record));
+    }
+  }
+
+  /// A sink may be added after blocks have been written, so
+  /// positions within its stream are tracked separately from those
+  /// in the file.  Index blocks and seek markers, which refer to
+  /// positions, are encoded for each sink individually.
+  struct Sink {
+    BlockSink* sink = nullptr;
+    FilePosition position = 0;
+    std::map<Identifier, IndexEntry> index;
+    std::vector<FilePosition> summaries;
+  };
+
+  void AddSink(BlockSink* sink) {
+    const auto header = std::string_view("TLOG0003\x00", 9);
+    if (!writer_ && !ring_ && sinks_.empty()) {
+      stream_position_ = header.size();
+    }
 
-    for (const auto& pair: schema_) {
-      WriteSchema(pair.second.identifier,
-                  // Our schemas will be changed from under us, so we
-                  // need a temporary copy of this string.
-                  std::string(pair.second.schema));
+    sinks_.push_back({sink, 0, {}, {}});
+    auto& state = sinks_.back();
+    sink->Start(header);
+    state.position = header.size();
+    for (const auto& pair : schema_) {
+      if (pair.second.schema.empty()) { continue; }
+      auto buffer = MakeSchemaBlock(pair.second);
+      WriteSink(&state,
+                std::string_view(buffer->data()->data() + buffer->start(),
+                                 buffer->size()));
+      Reclaim(std::move(buffer));
     }
   }
 
-  FilePosition GetPreviousOffset(Identifier identifier) const {
+  void RemoveSink(BlockSink* sink) {
+    sinks_.erase(std::remove_if(sinks_.begin(), sinks_.end(),
+                                [&](const auto& state) {
+                                  return state.sink == sink;
+                                }),
+                 sinks_.end());
+  }
+
+  void WriteSink(Sink* state, std::string_view block) {
+    base::BufferReadStream base_stream{block};
+    ReadStream stream{base_stream};
+    // Every block type fits in the first byte of its varuint.
+    const auto type = static_cast<Format::BlockType>(block[0]);
+    if (type != Format::BlockType::kSchema &&
+        type != Format::BlockType::kData) {
+      if (state->sink->Write(type, block)) {
+        if (type == Format::BlockType::kSummary) {
+          state->summaries.push_back(state->position);
+        }
+        state->position += block.size();
+      }
+      return;
+    }
+
+    stream.ReadVaruint();  // type
+    stream.ReadVaruint();  // size
+    const auto identifier = stream.ReadVaruint().value();
+
+    const auto it = state->index.find(identifier);
+    const FilePosition last_position =
+        (it == state->index.end()) ? -1 : it->second.last_position;
+
+    // The previous offset is relative to the file, and must be
+    // re-encoded for the sink's stream, where the previous block may
+    // be elsewhere or absent.
+    std::string reencoded;
+    if (type == Format::BlockType::kData) {
+      reencoded = ReencodePreviousOffset(
+          block, last_position < 0 ? 0 : (state->position - last_position));
+      if (!reencoded.empty()) { block = reencoded; }
+    }
+
+    if (!state->sink->Write(type, block)) { return; }
+
+    auto& entry = state->index[identifier];
+    entry.identifier = identifier;
+    if (type == Format::BlockType::kSchema) {
+      entry.schema_position = state->position;
+      entry.last_position = -1;
+    } else {
+      entry.last_position = state->position;
+    }
+    state->position += block.size();
+  }
+
+  /// @return a copy of the data block @p block with its previous
+  /// offset replaced by @p previous_offset, or an empty string if no
+  /// change is required.
+  static std::string ReencodePreviousOffset(std::string_view block,
+                                            uint64_t previous_offset) {
+    base::BufferReadStream base_stream{block};
+    ReadStream stream{base_stream};
+    stream.ReadVaruint();  // type
+    const auto body_size = stream.ReadVaruint().value();
+    const auto body_start = base_stream.offset();
+    stream.ReadVaruint();  // identifier
+    const auto flags = stream.ReadVaruint().value();
+    if (!(flags & u64(Format::BlockDataFlags::kPreviousOffset))) { return {}; }
+
+    const auto offset_start = base_stream.offset();
+    const auto old_offset = stream.ReadVaruint().value();
+    if (old_offset == previous_offset) { return {}; }
+    const auto remainder = block.substr(base_stream.offset());
+
+    base::FastOStringStream result;
+    WriteStream writer(result);
+    writer.WriteVaruint(u64(Format::BlockType::kData));
+    writer.WriteVaruint(
+        body_size - Format::GetVaruintSize(old_offset) +
+        Format::GetVaruintSize(previous_offset));
+    writer.RawWrite(block.substr(body_start, offset_start - body_start));
+    writer.WriteVaruint(previous_offset);
+    const auto fields_start = result.view().size();
+    writer.RawWrite(remainder);
+
+    std::string output(result.view());
+    if (flags & u64(Format::BlockDataFlags::kChecksum)) {
+      const auto checksum_position =
+          fields_start +
+          ((flags & u64(Format::BlockDataFlags::kTimestamp)) ? 8 : 0);
+      std::memset(&output[checksum_position], 0, 4);
+      boost::crc_32_type crc;
+      crc.process_bytes(output.data(), output.size());
+      const uint32_t checksum = crc.checksum();
+      std::memcpy(&output[checksum_position], &checksum, sizeof(checksum));
+    }
+    return output;
+  }
+
+  FilePosition GetPreviousOffset(const Record& record) const {
     if (!writer_) { return 0; }
+    if (record.last_position < 0) { return 0; }
 
+    return position() - record.last_position;
+  }
+
+  Record* FindOrAddRecord(Identifier identifier) {
     const auto it = schema_.find(identifier);
-    if (it == schema_.end() || it->second.last_position < 0) { return 0; }
+    if (it != schema_.end()) { return &it->second; }
+    return &schema_.emplace(identifier, Record(identifier)).first->second;
+  }
 
-    const auto position = writer_->position();
-    return position - it->second.last_position;
+  Record* AddRecord(std::string_view name, std::string_view schema) {
+    const auto identifier = AllocateIdentifier(name);
+    const auto it = schema_.find(identifier);
+    if (it == schema_.end() || it->second.schema != schema) {
+      WriteSchema(identifier, schema);
+    }
+    return &schema_.at(identifier);
   }
 
   FilePosition position() const {
-    if (!writer_) { return 0; }
+    if (ring_) { return ring_->position(); }
+    if (!writer_) { return stream_position_; }
     return writer_->position();
   }
 
   void Reclaim(Buffer buffer) override {
-    std::lock_guard<std::mutex> guard(buffers_mutex_);
-    buffers_.push_back(std::move(buffer));
+    pool_.Put(std::move(buffer));
   }
 
-  void WriteSeekBlock(boost::posix_time::ptime timestamp) {
-    auto buffer = GetBuffer();
-    WriteStream stream(*buffer);
+  void WriteSeekBlock(int64_t timestamp_us) {
+    if (writer_) {
+      std::vector<std::pair<Identifier, uint64_t>> offsets;
+      for (const auto& pair : schema_) {
+        if (pair.second.last_position < 0) { continue; }
+        offsets.push_back(
+            std::make_pair(pair.first,
+                           position() - pair.second.last_position));
+      }
 
-    const int orig_start = buffer->start();
+      auto buffer = GetBuffer();
+      WriteSeekMarker(*buffer, timestamp_us, offsets);
+      Write(std::move(buffer), false);
+    }
 
-    stream.Write(static_cast<uint64_t>(0xfdcab9a897867564));
-    const int crc_pos = orig_start + 8;
+    for (auto& sink : sinks_) {
+      std::vector<std::pair<Identifier, uint64_t>> offsets;
+      for (const auto& pair : sink.index) {
+        if (pair.second.last_position < 0) { continue; }
+        offsets.push_back(
+            std::make_pair(pair.first,
+                           sink.position - pair.second.last_position));
+      }
 
-    stream.Write(static_cast<uint32_t>(0));  // placeholder crc
-    stream.Write(static_cast<uint8_t>(0));  // placeholder header size
+      base::FastOStringStream marker;
+      WriteSeekMarker(marker, timestamp_us, offsets);
+      WriteSink(&sink, marker.view());
+    }
+  }
 
-    stream.WriteVaruint(0);  // flags
-    stream.Write(timestamp);
-    const uint64_t num_elements = [&]() {
-      uint64_t count = 0;
+  void WriteIndex() {
+    if (writer_) {
+      std::vector<IndexEntry> entries;
       for (const auto& pair : schema_) {
-        if (pair.second.last_position >= 0) { count++; }
+        // Records which have only had data written have no schema to
+        // point to.
+        if (pair.second.schema.empty()) { continue; }
+
+        const auto& record = pair.second;
+        entries.push_back({pair.first, record.schema_position,
+                           record.last_position});
       }
-      return count;
-    }();
-    stream.WriteVaruint(num_elements);
-    for (const auto& pair : schema_) {
-      if (pair.second.last_position < 0) { continue; }
-      stream.WriteVaruint(pair.first);
-      stream.WriteVaruint(writer_->position() - pair.second.last_position);
-    }
 
-    const auto body_size = buffer->size();
-    const auto header_size = 1 + Format::GetVaruintSize(body_size);
-    buffer->set_start(buffer->start() - header_size);
-    {
-      base::BufferWriteStream buffer_stream{
-        base::string_span(buffer->data()->data() + buffer->start(),
-                          header_size)};
-      WriteStream header_stream{buffer_stream};
-      header_stream.WriteVaruint(u64(Format::BlockType::kSeekMarker));
-      header_stream.WriteVaruint(body_size);
+      auto buffer = GetBuffer();
+      WriteIndexBody(*buffer, entries, summary_positions_);
+      FrameBlock(Format::BlockType::kIndex, buffer);
+      Write(std::move(buffer), false);
     }
-    *(buffer->data()->data() + crc_pos + 4) = header_size;
 
-    boost::crc_32_type crc;
-    crc.process_bytes(buffer->data()->data() + buffer->start(),
-                      header_size + body_size);
+    for (auto& sink : sinks_) {
+      std::vector<IndexEntry> entries;
+      for (const auto& pair : sink.index) {
+        if (pair.second.schema_position < 0) { continue; }
+        entries.push_back(pair.second);
+      }
 
-    // Now update the CRC.
-    {
-      base::BufferWriteStream buffer_stream{
-        base::string_span(buffer->data()->data() + crc_pos, 4)};
-      WriteStream crc_stream{buffer_stream};
-      crc_stream.Write(static_cast<uint32_t>(crc.checksum()));
+      base::FastOStringStream body;
+      WriteIndexBody(body, entries, sink.summaries);
+      base::FastOStringStream block;
+      WriteStream stream(block);
+      stream.WriteVaruint(u64(Format::BlockType::kIndex));
+      stream.WriteVaruint(body.view().size());
+      stream.RawWrite(body.view());
+      WriteSink(&sink, block.view());
     }
-
-    Write(std::move(buffer));
   }
 
-  void WriteIndex() {
+  void WriteSummary() {
     auto buffer = GetBuffer();
     WriteStream stream(*buffer);
 
-    const uint64_t flags = 0;
-    stream.WriteVaruint(flags);
-    uint64_t num_elements = schema_.size();
-    stream.WriteVaruint(num_elements);
+    stream.WriteVaruint(0);  // flags
 
-    for (const auto& pair: schema_) {
-      // Write out the BlockIndexRecord for each.
-      const auto identifier = pair.first;
-      stream.WriteVaruint(identifier);
+    uint64_t num_elements = 0;
+    for (const auto& pair : schema_) {
+      if (pair.second.summary_count) { num_elements++; }
+    }
+    stream.WriteVaruint(num_elements);
 
-      const auto& record = pair.second;
+    for (auto& pair : schema_) {
+      auto& record = pair.second;
+      if (record.summary_count == 0) { continue; }
 
-      const auto schema_position = record.schema_position;
-      stream.Write(u64(schema_position));
+      stream.WriteVaruint(pair.first);
+      stream.WriteVaruint(record.summary_count);
+      stream.Write(record.summary_min_us);
+      stream.Write(record.summary_max_us);
+      stream.WriteVaruint(record.summary_fields.size());
+      for (const auto& summary_field : record.summary_fields) {
+        stream.WriteString(summary_field.field.path());
+        stream.Write(summary_field.min);
+        stream.Write(summary_field.max);
+      }
 
-      const auto last_data_position = record.last_position;
-      stream.Write(u64(last_data_position));
+      record.ResetSummary();
     }
 
-    const uint32_t trailing_size = buffer->size() +
-        1 + // block type
-        Format::GetVaruintSize(buffer->size() + 4 + 8) +
-        4 + // this element itself
-        8; // the final 8 byte constant
-
-    stream.Write(trailing_size);
-    stream.RawWrite({"TLOGIDEX", 8});
-
-    WriteBlock(Format::BlockType::kIndex, std::move(buffer));
+    if (writer_) { summary_positions_.push_back(position()); }
+    WriteBlock(Format::BlockType::kSummary, std::move(buffer));
   }
 
   void WriteSchema(Identifier identifier, std::string_view schema) {
@@ -330,15 +1070,34 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
       mjlib::base::Fail(fmt::format("unknown id {}", identifier));
     }
 
-    schema_[identifier] = SchemaRecord(
-        rit->second, identifier, 0, schema, position());
+    {
+      const auto it = schema_.find(identifier);
+      if (it == schema_.end()) {
+        schema_.emplace(
+            identifier,
+            Record(rit->second, identifier, 0, schema, position()));
+      } else {
+        // Update in place so that any sampling policy, and pointers
+        // held by RecordWriters, remain valid.
+        auto& record = it->second;
+        record.name = rit->second;
+        record.schema = schema;
+        record.schema_position = position();
+        record.last_position = -1;
+        record.ResolveSummaryFields();
+      }
+    }
 
+    Write(MakeSchemaBlock(schema_.at(identifier)));
+  }
+
+  Buffer MakeSchemaBlock(const Record& record) {
     base::FastOStringStream ostr_schema;
     WriteStream stream_schema(ostr_schema);
-    stream_schema.WriteVaruint(identifier);
+    stream_schema.WriteVaruint(record.identifier);
     stream_schema.WriteVaruint(0);
-    stream_schema.WriteString(rit->second);
-    stream_schema.RawWrite(schema);
+    stream_schema.WriteString(record.name);
+    stream_schema.RawWrite(record.schema);
 
     auto buffer = GetBuffer();
 
@@ -347,53 +1106,176 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
     stream.WriteVaruint(ostr_schema.str().size());
     stream.RawWrite(ostr_schema.str());
 
-    Write(std::move(buffer));
+    return buffer;
   }
 
   Buffer GetBuffer() {
-    std::lock_guard<std::mutex> guard(buffers_mutex_);
-
-    Buffer result;
-    if (buffers_.empty()) {
-      result = std::make_unique<ThreadWriter::OStream>();
-    } else {
-      result = std::move(buffers_.back());
-      buffers_.pop_back();
-    }
+    auto result = pool_.Get();
     result->data()->resize(kBufferStartPadding);
     result->set_start(kBufferStartPadding);
     return result;
   }
 
-  void WriteData(boost::posix_time::ptime timestamp,
+  void WriteData(int64_t timestamp_us,
                  Identifier identifier,
                  Buffer buffer,
                  const WriteFlags& write_flags) {
-    if (!writer_) { return; }
+    if (!open()) { return; }
+
+    WriteData(timestamp_us, FindOrAddRecord(identifier), std::move(buffer),
+              write_flags);
+  }
+
+  void WriteData(int64_t timestamp_us,
+                 Record* record,
+                 Buffer buffer,
+                 const WriteFlags& write_flags) {
+    if (!open()) { return; }
+
+    if (!Admit(record, timestamp_us)) {
+      Reclaim(std::move(buffer));
+      return;
+    }
+
+    WriteAdmitted(timestamp_us, record, std::move(buffer), write_flags);
+  }
+
+  /// Finish writing a record which has already passed Admit.
+  void WriteAdmitted(int64_t timestamp_us,
+                     Record* record,
+                     Buffer buffer,
+                     const WriteFlags& write_flags) {
+    if (!open()) { return; }
+
+    if (!Changed(record, std::string_view(
+                     buffer->data()->data() + buffer->start(),
+                     buffer->size()))) {
+      Reclaim(std::move(buffer));
+      return;
+    }
+
+    WriteRecordData(timestamp_us, record, std::move(buffer), write_flags);
+  }
+
+  void SetSamplingPolicy(Identifier identifier,
+                         const SamplingPolicy& policy) {
+    auto* const record = FindOrAddRecord(identifier);
+    record->sampling = policy;
+    record->min_period_us =
+        policy.max_rate_hz > 0.0 ?
+        static_cast<int64_t>(1e6 / policy.max_rate_hz) : 0;
+    record->burst_duration_us = static_cast<int64_t>(
+        policy.burst_duration_s * 1e6);
+    record->sampling_enabled =
+        policy.decimation > 1 ||
+        record->min_period_us > 0 ||
+        policy.on_change;
+    record->offered_count = 0;
+    record->has_last_data = false;
+    record->last_data.clear();
+  }
+
+  void SetSummaryFields(Identifier identifier,
+                        const std::vector<std::string>& paths) {
+    auto* const record = FindOrAddRecord(identifier);
+    record->summary_paths = paths;
+    record->ResolveSummaryFields();
+    record->ResetSummary();
+  }
+
+  void TriggerBurst(int64_t timestamp_us) {
+    burst_start_us_ =
+        timestamp_us == kNoTimestamp ? clock_.now_us() : timestamp_us;
+  }
+
+  /// @return true if a record with the given timestamp should be
+  /// written according to its sampling policy, not considering
+  /// on_change.
+  bool Admit(Record* record, int64_t timestamp_us) {
+    if (!record->sampling_enabled) { return true; }
+
+    if (timestamp_us == kNoTimestamp) { timestamp_us = clock_.now_us(); }
+
+    record->in_burst =
+        burst_start_us_ != kNoTimestamp &&
+        timestamp_us >= burst_start_us_ &&
+        (timestamp_us - burst_start_us_) < record->burst_duration_us;
+    if (record->in_burst) {
+      record->admitted_us = timestamp_us;
+      return true;
+    }
+
+    const auto count = record->offered_count++;
+    if (record->sampling.decimation > 1 &&
+        (count % record->sampling.decimation) != 0) {
+      return false;
+    }
+
+    if (record->min_period_us > 0 &&
+        record->last_written_us != kNoTimestamp &&
+        (timestamp_us - record->last_written_us) < record->min_period_us) {
+      return false;
+    }
+
+    record->admitted_us = timestamp_us;
+    return true;
+  }
+
+  bool Changed(Record* record, std::string_view data) {
+    if (!record->sampling_enabled ||
+        !record->sampling.on_change ||
+        record->in_burst) {
+      return true;
+    }
+
+    if (record->has_last_data && record->last_data == data) {
+      return false;
+    }
+
+    record->has_last_data = true;
+    record->last_data.assign(data.data(), data.size());
+    return true;
+  }
+
+  void WriteRecordData(int64_t timestamp_us,
+                       Record* record,
+                       Buffer buffer,
+                       const WriteFlags& write_flags) {
+    if (record->sampling_enabled) {
+      record->last_written_us = record->admitted_us;
+    }
 
     uint64_t block_data_flags = 0;
 
     uint64_t flag_header_size = 0;
 
     std::optional<FilePosition> previous_offset;
-    if (options_.write_previous_offsets) {
+    // In flight recorder mode, the previous block may be discarded
+    // before the log is persisted.
+    if (options_.write_previous_offsets && !ring_) {
       block_data_flags |= u64(Format::BlockDataFlags::kPreviousOffset);
-      previous_offset = GetPreviousOffset(identifier);
+      previous_offset = GetPreviousOffset(*record);
       flag_header_size += Format::GetVaruintSize(*previous_offset);
     }
 
-    std::optional<boost::posix_time::ptime> timestamp_to_write;
-    if (!timestamp.is_not_a_date_time() || options_.timestamps_system) {
+    int64_t timestamp_to_write = kNoTimestamp;
+    if (timestamp_us != kNoTimestamp || options_.timestamps_system) {
       block_data_flags |= u64(Format::BlockDataFlags::kTimestamp);
       flag_header_size += 8;
-      if (!timestamp.is_not_a_date_time()) {
-        timestamp_to_write = timestamp;
+      if (timestamp_us != kNoTimestamp) {
+        timestamp_to_write = timestamp_us;
       } else {
-        timestamp_to_write =
-            boost::posix_time::microsec_clock::universal_time();
+        timestamp_to_write = clock_.now_us();
       }
     }
 
+    if (options_.summary_block) {
+      record->UpdateSummary(
+          timestamp_to_write,
+          std::string_view(buffer->data()->data() + buffer->start(),
+                           buffer->size()));
+    }
+
     bool write_checksum = false;
     if (write_flags.checksum.evaluate(options_.default_checksum_data)) {
       block_data_flags |= u64(Format::BlockDataFlags::kChecksum);
@@ -420,7 +1302,7 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
       }
     }
 
-    const auto identifier_size = Format::GetVaruintSize(identifier);
+    const auto identifier_size = record->encoded_identifier.size();
     const auto flag_size = Format::GetVaruintSize(block_data_flags);
     const auto body_size =
         identifier_size + flag_size + flag_header_size + buffer->size();
@@ -439,7 +1321,7 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
     WriteStream writer(stream);
     writer.WriteVaruint(u64(Format::BlockType::kData));
     writer.WriteVaruint(body_size);
-    writer.WriteVaruint(identifier);
+    writer.RawWrite(record->encoded_identifier);
     writer.WriteVaruint(block_data_flags);
 
     if (block_data_flags & u64(Format::BlockDataFlags::kPreviousOffset)) {
@@ -447,7 +1329,7 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
     }
 
     if (block_data_flags & u64(Format::BlockDataFlags::kTimestamp)) {
-      writer.Write(*timestamp_to_write);
+      writer.Write(timestamp_to_write);
     }
 
     if (write_checksum) {
@@ -465,25 +1347,48 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
 
     buffer->set_start(buffer->start() - header_size);
 
-    schema_[identifier].last_position = writer_->position();
+    record->last_position = position();
 
     Write(std::move(buffer));
 
-    if (options_.seek_block_period_s != 0.0) {
-      if (last_seek_block_.is_not_a_date_time()) {
-        last_seek_block_ = timestamp;
-      } else if (!timestamp.is_not_a_date_time() &&
-                 (timestamp - last_seek_block_) >= seek_block_period_) {
-        WriteSeekBlock(timestamp);
-        last_seek_block_ = timestamp;
+    if (seek_block_period_us_ != 0) {
+      if (last_seek_block_us_ == kNoTimestamp) {
+        last_seek_block_us_ = timestamp_us;
+      } else if (timestamp_us != kNoTimestamp &&
+                 (timestamp_us - last_seek_block_us_) >=
+                 seek_block_period_us_) {
+        if (ring_) { ring_->StartSegment(timestamp_us); }
+        if (writer_ || !sinks_.empty()) { WriteSeekBlock(timestamp_us); }
+        if (options_.summary_block) { WriteSummary(); }
+        last_seek_block_us_ = timestamp_us;
+      }
+    }
+
+    if (checkpoint_period_us_ != 0 && timestamp_to_write != kNoTimestamp &&
+        writer_) {
+      if (last_checkpoint_us_ == kNoTimestamp) {
+        last_checkpoint_us_ = timestamp_to_write;
+      } else if ((timestamp_to_write - last_checkpoint_us_) >=
+                 checkpoint_period_us_) {
+        WriteIndex();
+        // Get the checkpoint to the operating system, so that it
+        // survives the process being killed.
+        writer_->Flush();
+        last_checkpoint_us_ = timestamp_to_write;
       }
     }
   }
 
   void WriteBlock(Format::BlockType block_type,
                   Buffer buffer) {
-    if (!writer_) { return; }
+    if (!open()) { return; }
+
+    FrameBlock(block_type, buffer);
+    Write(std::move(buffer));
+  }
 
+  /// Prepend the block header to @p buffer.
+  void FrameBlock(Format::BlockType block_type, Buffer& buffer) {
     size_t data_size = buffer->size();
 
     const auto block_size = 1 + Format::GetVaruintSize(buffer->size());
@@ -497,25 +1402,37 @@ class FileWriter::Impl : public ThreadWriter::Reclaimer {
     writer.WriteVaruint(u64(block_type));
     writer.WriteVaruint(u64(data_size));
     buffer->set_start(buffer->start() - block_size);
-
-    Write(std::move(buffer));
   }
 
   const Options options_;
-  const boost::posix_time::time_duration seek_block_period_{
-    mjlib::base::ConvertSecondsToDuration(options_.seek_block_period_s)};
+  const int64_t seek_block_period_us_{
+    mjlib::base::ConvertDurationToMicroseconds(
+        mjlib::base::ConvertSecondsToDuration(options_.seek_block_period_s))};
+  const int64_t checkpoint_period_us_{
+    mjlib::base::ConvertDurationToMicroseconds(
+        mjlib::base::ConvertSecondsToDuration(
+            options_.index_checkpoint_period_s))};
+  const base::EpochClock clock_{options_.clock_source};
   std::unique_ptr<ThreadWriter> writer_;
+  std::unique_ptr<Ring> ring_;
+  std::vector<Sink> sinks_;
+  // The stream position when writing only to sinks.
+  FilePosition stream_position_ = 0;
+  // The location of every summary block written to the file.
+  std::vector<FilePosition> summary_positions_;
+  std::thread dump_thread_;
 
   std::map<std::string, Identifier> identifier_map_;
   std::map<Identifier, std::string> reverse_identifier_map_;
 
   Identifier next_id_ = 1;
 
-  std::mutex buffers_mutex_;
-  std::vector<Buffer> buffers_;
+  BufferPool pool_{options_.buffer_pool_size};
 
-  std::map<Identifier, SchemaRecord> schema_;
-  boost::posix_time::ptime last_seek_block_;
+  std::map<Identifier, Record> schema_;
+  int64_t last_seek_block_us_ = kNoTimestamp;
+  int64_t burst_start_us_ = kNoTimestamp;
+  int64_t last_checkpoint_us_ = kNoTimestamp;
 };
 
 FileWriter::FileWriter(const Options& options)
@@ -537,7 +1454,7 @@ void FileWriter::Open(int fd) {
 }
 
 bool FileWriter::IsOpen() const {
-  return !!impl_->writer_;
+  return impl_->open();
 }
 
 void FileWriter::Close() {
@@ -566,7 +1483,15 @@ void FileWriter::WriteData(boost::posix_time::ptime timestamp,
                            Identifier identifier,
                            std::string_view serialized_data,
                            const WriteFlags& write_flags) {
-  impl_->WriteData(timestamp, identifier, serialized_data, write_flags);
+  impl_->WriteData(base::ConvertPtimeToEpochMicroseconds(timestamp),
+                   identifier, serialized_data, write_flags);
+}
+
+void FileWriter::WriteDataUs(int64_t timestamp_us,
+                             Identifier identifier,
+                             std::string_view serialized_data,
+                             const WriteFlags& write_flags) {
+  impl_->WriteData(timestamp_us, identifier, serialized_data, write_flags);
 }
 
 void FileWriter::WriteBlock(Format::BlockType block_type,
@@ -574,6 +1499,27 @@ void FileWriter::WriteBlock(Format::BlockType block_type,
   impl_->WriteBlock(block_type, data);
 }
 
+FileWriter::BufferPoolStats FileWriter::buffer_pool_stats() const {
+  return impl_->pool_.stats();
+}
+
+void FileWriter::AddSink(BlockSink* sink) {
+  impl_->AddSink(sink);
+}
+
+void FileWriter::RemoveSink(BlockSink* sink) {
+  impl_->RemoveSink(sink);
+}
+
+std::future<void> FileWriter::Dump(std::string_view filename) {
+  return impl_->Dump(filename);
+}
+
+FileWriter::Record* FileWriter::AddRecord(std::string_view record_name,
+                                          std::string_view schema) {
+  return impl_->AddRecord(record_name, schema);
+}
+
 FileWriter::Buffer FileWriter::GetBuffer() {
   return impl_->GetBuffer();
 }
@@ -582,7 +1528,60 @@ void FileWriter::WriteData(boost::posix_time::ptime timestamp,
                            Identifier identifier,
                            Buffer buffer,
                            const WriteFlags& write_flags) {
-  impl_->WriteData(timestamp, identifier, std::move(buffer), write_flags);
+  impl_->WriteData(base::ConvertPtimeToEpochMicroseconds(timestamp),
+                   identifier, std::move(buffer), write_flags);
+}
+
+void FileWriter::WriteDataUs(int64_t timestamp_us,
+                             Identifier identifier,
+                             Buffer buffer,
+                             const WriteFlags& write_flags) {
+  impl_->WriteData(timestamp_us, identifier, std::move(buffer), write_flags);
+}
+
+void FileWriter::WriteData(boost::posix_time::ptime timestamp,
+                           Record* record,
+                           Buffer buffer,
+                           const WriteFlags& write_flags) {
+  impl_->WriteData(base::ConvertPtimeToEpochMicroseconds(timestamp),
+                   record, std::move(buffer), write_flags);
+}
+
+void FileWriter::WriteDataUs(int64_t timestamp_us,
+                             Record* record,
+                             Buffer buffer,
+                             const WriteFlags& write_flags) {
+  impl_->WriteData(timestamp_us, record, std::move(buffer), write_flags);
+}
+
+bool FileWriter::AdmitUs(Record* record, int64_t timestamp_us) {
+  if (!impl_->open()) { return false; }
+  return impl_->Admit(record, timestamp_us);
+}
+
+void FileWriter::WriteAdmittedUs(int64_t timestamp_us,
+                                 Record* record,
+                                 Buffer buffer,
+                                 const WriteFlags& write_flags) {
+  impl_->WriteAdmitted(timestamp_us, record, std::move(buffer), write_flags);
+}
+
+void FileWriter::SetSamplingPolicy(Identifier identifier,
+                                   const SamplingPolicy& policy) {
+  impl_->SetSamplingPolicy(identifier, policy);
+}
+
+void FileWriter::SetSummaryFields(Identifier identifier,
+                                  const std::vector<std::string>& paths) {
+  impl_->SetSummaryFields(identifier, paths);
+}
+
+void FileWriter::TriggerBurst(boost::posix_time::ptime timestamp) {
+  impl_->TriggerBurst(base::ConvertPtimeToEpochMicroseconds(timestamp));
+}
+
+int64_t FileWriter::now_us() const {
+  return impl_->clock_.now_us();
 }
 
 void FileWriter::WriteBlock(Format::BlockType block_type,
@@ -18,9 +18,18 @@
 #include <boost/noncopyable.hpp>
 
 #include <cstdint>
+#include <future>
+#include <limits>
+#include <string>
 #include <string_view>
+#include <type_traits>
+#include <vector>
 
+#include "mjlib/base/epoch_clock.h"
 #include "mjlib/base/thread_writer.h"
+#include "mjlib/base/time_conversions.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+#include "mjlib/telemetry/block_sink.h"
 #include "mjlib/telemetry/format.h"
 
 namespace mjlib {
@@ -46,17 +55,51 @@ class FileWriter : boost::noncopyable {
     /// Write a trailing index block.
     bool index_block = true;
 
+    /// Emit an index block at this interval, describing the file up
+    /// to that point.  If the log is not closed cleanly, a reader can
+    /// locate the most recent one by scanning backwards from the end,
+    /// so long as FileReader::Options::index_checkpoint_search_size
+    /// exceeds the data written in one period.  A zero value disables
+    /// checkpoints.
+    double index_checkpoint_period_s = 0.0;
+
     /// Emit seek blocks at this interval.  Note, for this to have an
     /// effect, timestamps must be provided either through the API or
     /// from the system.  A zero value disables seek blocks.
     double seek_block_period_s = 1.0;
 
+    /// Emit a summary block immediately after each seek block, and
+    /// when closing.  Each describes the data written since the
+    /// previous summary, and allows readers to skip segments of the
+    /// log which cannot match a query.  See SetSummaryFields.
+    bool summary_block = false;
+
+    /// If non-zero, operate as a flight recorder.  Rather than being
+    /// written to a file, blocks are retained in memory, and once
+    /// more than this many bytes are held, the oldest segments are
+    /// discarded.  Segments begin at each seek block, and are also
+    /// limited to an eighth of this size, so the bound holds even
+    /// without timestamps.  The writer is open from construction, and
+    /// Dump may be used to persist its contents.
+    int64_t ring_size = 0;
+
+    /// The most idle buffers retained for reuse by GetBuffer.  See
+    /// buffer_pool_stats for sizing.
+    std::size_t buffer_pool_size = 128;
+
     /// If true, then writes may block.
     bool blocking = true;
 
+    /// See base::ThreadWriter::Options
+    int64_t preallocate_size = 0;
+    int64_t sync_size = 0;
+
     /// If timestamps are unspecified, use system timestamps.
     bool timestamps_system = true;
 
+    /// The source used for system timestamps.
+    base::EpochClock::Source clock_source = base::EpochClock::kRealtime;
+
     Options() {}
   };
 
@@ -72,12 +115,33 @@ class FileWriter : boost::noncopyable {
   /// descriptor instead.
   void Open(int fd);
 
-  /// Return true if any file is open for writing.
+  /// Additionally send the stream of blocks to @p sink, for
+  /// instance a socket.  It first receives the header and every
+  /// schema written so far, then each subsequent block.  Index
+  /// blocks, seek markers, and previous offsets are encoded for the
+  /// sink's own stream, counting only blocks which the sink accepted,
+  /// so it is a valid log even when added after data has been
+  /// written or when blocks are discarded.  This may be used with
+  /// or without an open file.  The sink must remain valid until it
+  /// is removed or this FileWriter is destroyed.
+  void AddSink(BlockSink* sink);
+  void RemoveSink(BlockSink* sink);
+
+  /// Return true if any file, ring, or sink is open for writing.
   bool IsOpen() const;
 
   /// Close the log, this is implicit at destruction time.
   void Close();
 
+  /// When in flight recorder mode, write the retained contents as a
+  /// complete log, starting from the oldest retained seek point, or
+  /// from the oldest retained block if no seek point remains.  The
+  /// contents are captured immediately, but the file is written from
+  /// a background thread so that producers are not stalled.  Any
+  /// error is reported through the returned future.  A subsequent
+  /// Dump or Close waits for a prior one to finish.
+  std::future<void> Dump(std::string_view filename);
+
   /// Try to write all data to the operating system.  Note, this does
   /// not necessarily mean the data has been written to disk or a
   /// backing store.
@@ -85,6 +149,12 @@ class FileWriter : boost::noncopyable {
 
   using Identifier = uint64_t;
 
+  /// The integer timestamp APIs below use microseconds since the
+  /// epoch.  This value indicates an unspecified timestamp, and is
+  /// the same as ConvertPtimeToEpochMicroseconds(not_a_date_time).
+  static constexpr int64_t kNoTimestamp =
+      std::numeric_limits<int64_t>::min() + 1;
+
   /// Allocate a unique identifier for the given name.
   Identifier AllocateIdentifier(std::string_view record_name);
 
@@ -94,6 +164,54 @@ class FileWriter : boost::noncopyable {
   /// Write a schema block to the log file.
   void WriteSchema(Identifier, std::string_view schema);
 
+  /// Controls which data blocks are written for a single identifier.
+  /// Records which are skipped are never compressed or written, and
+  /// when using a RecordWriter, are never serialized.
+  struct SamplingPolicy {
+    /// Only every Nth record offered is written.
+    int decimation = 1;
+
+    /// If non-zero, records are written no more often than this,
+    /// based upon their timestamps.
+    double max_rate_hz = 0.0;
+
+    /// If true, records are only written when their serialized form
+    /// differs from the previously written one.
+    bool on_change = false;
+
+    /// After TriggerBurst, all records are written for this long,
+    /// regardless of the above.
+    double burst_duration_s = 0.0;
+
+    SamplingPolicy() {}
+  };
+
+  /// Change the sampling policy for the given identifier.  This may
+  /// be called at any time.
+  void SetSamplingPolicy(Identifier, const SamplingPolicy&);
+
+  /// Start a burst window for all identifiers which have one
+  /// configured.  If 'timestamp' is unspecified, the current time is
+  /// used.
+  void TriggerBurst(boost::posix_time::ptime timestamp = {});
+
+  /// Include the minimum and maximum values of the given numeric
+  /// fields in summary blocks for this identifier.  Each path is as
+  /// described in NumericField.  Record counts and timestamp ranges
+  /// are always included when summary blocks are enabled.
+  ///
+  /// Paths are resolved against the schema once it is written, and
+  /// an invalid path results in a base::system_error at that time.
+  void SetSummaryFields(Identifier, const std::vector<std::string>& paths);
+
+  /// The state associated with a single identifier.  Pointers remain
+  /// valid for the lifetime of the FileWriter.
+  struct Record;
+
+  /// Allocate an identifier for the given name, and write its schema
+  /// if it has not already been written.
+  Record* AddRecord(std::string_view record_name, std::string_view schema);
+
 
   struct Override {
     Override() {}
@@ -138,9 +256,25 @@ class FileWriter : boost::noncopyable {
   /// high-performance writing where no additional copies are
   /// necessary.
 
-  /// Get a buffer which can be used to send data.
+  /// Get a buffer which can be used to send data.  This is safe to
+  /// call from any thread, and does not lock.
   Buffer GetBuffer();
 
+  struct BufferPoolStats {
+    /// GetBuffer calls satisfied from the pool, and those which
+    /// required an allocation.
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    /// Buffers freed on return because the pool was full.
+    uint64_t discards = 0;
+
+    /// The most buffers which have been in use at once.
+    int64_t high_water = 0;
+  };
+
+  BufferPoolStats buffer_pool_stats() const;
+
   // These variants of Write take a buffer, (which must have been
   // obtained by "GetBuffer" above), and returns ownership of the
   // buffer to the FileWriter class.
@@ -149,10 +283,95 @@ class FileWriter : boost::noncopyable {
                  Identifier,
                  Buffer buffer,
                  const WriteFlags& = {});
+  void WriteData(boost::posix_time::ptime timestamp,
+                 Record*,
+                 Buffer buffer,
+                 const WriteFlags& = {});
   void WriteBlock(Format::BlockType block_type,
                   Buffer buffer);
 
+  /// Variants of WriteData which take the timestamp as integer
+  /// microseconds since the epoch, avoiding any conversions.  These
+  /// are templates only so that an argument of '{}' continues to
+  /// select the ptime overloads.
+  template <typename Int, std::enable_if_t<std::is_integral_v<Int>, int> = 0>
+  void WriteData(Int timestamp_us, Identifier identifier,
+                 std::string_view serialized_data,
+                 const WriteFlags& write_flags = {}) {
+    WriteDataUs(timestamp_us, identifier, serialized_data, write_flags);
+  }
+
+  template <typename Int, std::enable_if_t<std::is_integral_v<Int>, int> = 0>
+  void WriteData(Int timestamp_us, Identifier identifier, Buffer buffer,
+                 const WriteFlags& write_flags = {}) {
+    WriteDataUs(timestamp_us, identifier, std::move(buffer), write_flags);
+  }
+
+  template <typename Int, std::enable_if_t<std::is_integral_v<Int>, int> = 0>
+  void WriteData(Int timestamp_us, Record* record, Buffer buffer,
+                 const WriteFlags& write_flags = {}) {
+    WriteDataUs(timestamp_us, record, std::move(buffer), write_flags);
+  }
+
+  /// @return the current time from the configured clock source, in
+  /// microseconds since the epoch.
+  int64_t now_us() const;
+
+  /// Writes values of one C++ type to a single record.  The schema is
+  /// written once at construction, and each Write serializes directly
+  /// into a pooled buffer with no identifier lookups.
+  template <typename T>
+  class RecordWriter {
+   public:
+    RecordWriter(FileWriter* writer,
+                 std::string_view record_name,
+                 const WriteFlags& write_flags = {})
+        : writer_(writer),
+          record_(writer->AddRecord(
+                      record_name, BinarySchemaArchive::Write<T>())),
+          identifier_(writer->AllocateIdentifier(record_name)),
+          write_flags_(write_flags) {}
+
+    Identifier identifier() const { return identifier_; }
+
+    void Write(boost::posix_time::ptime timestamp, const T& value) {
+      Write(base::ConvertPtimeToEpochMicroseconds(timestamp), value);
+    }
+
+    void Write(int64_t timestamp_us, const T& value) {
+      if (!writer_->AdmitUs(record_, timestamp_us)) { return; }
+
+      auto buffer = writer_->GetBuffer();
+      AppendBinary(value, buffer.get());
+      writer_->WriteAdmittedUs(
+          timestamp_us, record_, std::move(buffer), write_flags_);
+    }
+
+   private:
+    FileWriter* const writer_;
+    Record* const record_;
+    const Identifier identifier_;
+    const WriteFlags write_flags_;
+  };
+
+  template <typename T>
+  RecordWriter<T> MakeRecordWriter(std::string_view record_name,
+                                   const WriteFlags& write_flags = {}) {
+    return RecordWriter<T>(this, record_name, write_flags);
+  }
+
  private:
+  void WriteDataUs(int64_t timestamp_us, Identifier,
+                   std::string_view serialized_data, const WriteFlags&);
+  void WriteDataUs(int64_t timestamp_us, Identifier,
+                   Buffer, const WriteFlags&);
+  void WriteDataUs(int64_t timestamp_us, Record*,
+                   Buffer, const WriteFlags&);
+
+  bool AdmitUs(Record*, int64_t timestamp_us);
+  void WriteAdmittedUs(int64_t timestamp_us, Record*,
+                       Buffer, const WriteFlags&);
+
   class Impl;
   std::unique_ptr<Impl> impl_;
 };
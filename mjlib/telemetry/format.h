@@ -14,7 +14,11 @@
 
 #pragma once
 
+#include <array>
+#include <cstring>
 #include <optional>
+#include <string_view>
+#include <type_traits>
 
 #include "mjlib/base/assert.h"
 #include "mjlib/base/bytes.h"
@@ -75,12 +79,21 @@ struct Format {
     kIndex = 3,
     kCompressionDictionary = 4,
     kSeekMarker = 5,
-    kNumTypes = kSeekMarker,
+    kSummary = 6,
+    kNumTypes = kSummary,
   };
 
   enum class BlockSchemaFlags {
   };
 
+  enum class BlockIndexFlags {
+    /// The locations of every summary block preceding the index are
+    /// listed after its elements.
+    ///
+    ///  * varuint count, followed by count fixeduint64
+    kSummaries = 1 << 0,
+  };
+
   enum class BlockDataFlags {
     // The following flags define optional fields which will be
     // present after the flags field and before the data itself.  If
@@ -125,11 +138,16 @@ struct Format {
 };
 
 /// This provides C++ APIs for writing primitive types.
-class WriteStream {
+///
+/// The 'Sink' need only provide a 'write(std::string_view)' method.
+/// When it is a concrete type, like BufferSink or SizeSink below,
+/// every primitive is written with no virtual calls.
+template <typename Sink>
+class BasicWriteStream {
  public:
-  WriteStream(base::WriteStream& base) : base_(base) {}
+  BasicWriteStream(Sink& base) : base_(base) {}
 
-  base::WriteStream& base() { return base_; }
+  Sink& base() { return base_; }
 
   void WriteString(const std::string_view& data) {
     WriteVaruint(data.size());
@@ -190,9 +208,63 @@ class WriteStream {
     RawWrite({reinterpret_cast<const char*>(&value), sizeof(value)});
   }
 
-  base::WriteStream& base_;
+  Sink& base_;
+};
+
+using WriteStream = BasicWriteStream<base::WriteStream>;
+
+/// A non-virtual sink which writes into a contiguous region of
+/// memory.  No bounds checking is performed per write, the caller
+/// must ensure sufficient space exists beforehand, for instance by
+/// measuring with a SizeSink.
+class BufferSink {
+ public:
+  BufferSink(char* start) : start_(start), position_(start) {}
+
+  void write(const std::string_view& data) {
+    std::memcpy(position_, data.data(), data.size());
+    position_ += data.size();
+  }
+
+  std::size_t size() const { return position_ - start_; }
+  char* position() const { return position_; }
+
+ private:
+  char* const start_;
+  char* position_;
+};
+
+/// A non-virtual sink which only counts the bytes that would be
+/// written.
+class SizeSink {
+ public:
+  void write(const std::string_view& data) {
+    size_ += data.size();
+  }
+
+  std::size_t size() const { return size_; }
+
+ private:
+  std::size_t size_ = 0;
 };
 
+namespace detail {
+
+/// True for types whose in-memory representation is identical to
+/// their binary serialization, so that they can be written or read
+/// with a single memcpy.
+template <typename T>
+struct IsMemcpyCompatible {
+  static constexpr bool value = std::is_arithmetic<T>::value;
+};
+
+template <typename T, std::size_t N>
+struct IsMemcpyCompatible<std::array<T, N>> {
+  static constexpr bool value = IsMemcpyCompatible<T>::value;
+};
+
+}  // namespace detail
+
 /// This provides C++ APIs for reading primitive types.
 class ReadStream {
  public:
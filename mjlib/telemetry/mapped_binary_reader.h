@@ -14,16 +14,23 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <map>
 #include <memory>
+#include <optional>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 #include <fmt/format.h>
 
+#include "mjlib/base/buffer_stream.h"
 #include "mjlib/base/detail/serialize.h"
 #include "mjlib/base/error_code.h"
 #include "mjlib/base/fail.h"
 #include "mjlib/base/priority_tag.h"
-#include "mjlib/base/recording_stream.h"
 #include "mjlib/base/system_error.h"
 
 #include "mjlib/telemetry/binary_read_archive.h"
@@ -35,17 +42,21 @@
 
 namespace mjlib {
 namespace telemetry {
-
 /// Given a binary schema, provide mechanisms to read data matching
 /// that schema into a C++ structure that may differ.  Differences are
 /// handled according to the schema evolution rules documented in
 /// README.md.
+///
+/// When the schemas differ at the field level, the mapping is
+/// compiled once at construction into a flat plan of steps.  Runs of
+/// fixed size fields which are laid out identically in the source
+/// data and the C++ structure are collapsed into single memcpys,
+/// nested structures are flattened into the parent plan, and only
+/// variable sized or type-changed fields go through a child reader.
 template <class ParentType>
 class MappedBinaryReader {
  public:
   using Element = BinarySchemaParser::Element;
-  using StringElementMap = std::map<std::string, const Element*>;
-  using StringMap = std::map<std::string, std::string>;
 
   MappedBinaryReader(const BinarySchemaParser* parser)
       : MappedBinaryReader(parser->root()) {}
@@ -56,13 +67,8 @@ class MappedBinaryReader {
       schemas_same_ = true;
     } else if (base::IsSerializable<ParentType>() &&
                element->type == Format::Type::kObject) {
-      // We can map on a field level, prepare our mapping structure.
-      for (const auto& field : element->fields) {
-        element_map_.insert(std::make_pair(field.name, field.element));
-      }
-
-      SetupReaders<base::IsNativeSerializable<ParentType>() ? 1 :
-                   base::IsExternalSerializable<ParentType>() ? 2 : 0>();
+      // We can map on a field level, compile our plan.
+      SetupPlan();
     } else if ((element->type == Format::Type::kArray ||
                 element->type == Format::Type::kMap ||
                 element->type == Format::Type::kUnion ||
@@ -87,74 +93,34 @@ class MappedBinaryReader {
     }
   }
 
-  template <int _>
-  void SetupReaders() {
-    // We have this dummy method so that we don't instantiate things
+  void SetupPlan() {
+    // We use 'if constexpr' here so that we don't instantiate things
     // for non-structure types.
-    base::AssertNotReached();
-  }
-
-  template <>
-  void SetupReaders<1>() {
-    ParentType parent;
-    SetupNativeSerializable<ParentType>(&parent);
-  }
-
-  template <typename Serializable>
-  void SetupNativeSerializable(Serializable* serializable) {
-    SchemaArchive archive(&element_map_, this);
-    base::Serialize(serializable, &archive);
-  }
-
-  // NOTE: This class would be very simple if we didn't have to deal
-  // with external serialization, which adds a lot of complexity.  We
-  // have to handle external serialization of types that resolve to
-  // primitives and those that resolve to serializable, all while
-  // making sure we don't instantiate a template that doesn't make
-  // sense.
-
-  struct SetupReaderExternal {
-    SetupReaderExternal(MappedBinaryReader* parent) : parent_(parent) {}
-
-    template <typename T>
-    void operator()(const T& nvp) {
-      using ChildRef = decltype(*nvp.value());
-      using Child = typename std::remove_reference<ChildRef>::type;
-      SetupReaderExternalHelper<
-        base::IsNativeSerializable<Child>() ? 1 : 0>{parent_}(nvp.value());
-    }
-
-    MappedBinaryReader* parent_;
-  };
-
-  template <int _>
-  struct SetupReaderExternalHelper {
-    SetupReaderExternalHelper(MappedBinaryReader*) {}
-
-    template <typename Serializable>
-    void operator()(Serializable*) {}
-  };
-
-  template <>
-  struct SetupReaderExternalHelper<1> {
-    SetupReaderExternalHelper(MappedBinaryReader* parent) : parent_(parent) {}
+    if constexpr (base::IsSerializable<ParentType>()) {
+      ParentType parent;
+      Destinations destinations;
+      PlanArchive archive(element_, &destinations,
+                          reinterpret_cast<const char*>(&parent), this);
+
+      if constexpr (base::IsNativeSerializable<ParentType>()) {
+        base::Serialize(&parent, &archive);
+      } else {
+        // This only works if the type we get back from the external
+        // serializer is also an object.
+        mjlib::base::ExternalSerializer<ParentType> serializer;
+        serializer.Serialize(&parent, [&](const auto& nvp) {
+            using ChildRef = decltype(*nvp.value());
+            using Child = typename std::remove_reference<ChildRef>::type;
+            if constexpr (base::IsNativeSerializable<Child>()) {
+              nvp.value()->Serialize(&archive);
+            }
+          });
+      }
 
-    template <typename Serializable>
-    void operator()(Serializable* serializable) {
-      parent_->SetupNativeSerializable<Serializable>(serializable);
+      CompilePlan(element_, destinations);
+    } else {
+      base::AssertNotReached();
     }
-
-    MappedBinaryReader* parent_;
-  };
-
-  template <>
-  void SetupReaders<2>() {
-    // This only works if the type we get back from the external
-    // serializer is also an object.
-    SchemaArchive archive(&element_map_, this);
-    ParentType value;
-    mjlib::base::ExternalSerializer<ParentType> serializer;
-    serializer.Serialize(&value, SetupReaderExternal(this));
   }
 
   template <typename T>
@@ -223,7 +189,7 @@ class MappedBinaryReader {
   }
 
   ParentType Read(std::string_view data) const {
-    ParentType result;
+    ParentType result{};
     Read(&result, data);
     return result;
   }
@@ -233,52 +199,18 @@ class MappedBinaryReader {
     Read(value, stream);
   }
 
-  void Read(ParentType* value, base::ReadStream& stream) const {
-    if (schemas_same_) {
-      BinaryReadArchive(stream).Value(value);
-      return;
-    } else if (!container_readers_.empty()) {
-      ReadContainer(value, stream);
-    } else {
-      // Read all the field data in an unstructured manner.
-      //
-      // NOTE: You could imagine delaying this, and reading fields
-      // directly until one was found which needed the mapping at which
-      // point some or all of the remainder would be read into temporary
-      // memory.
-      StringMap field_data;
-      for (const auto& field : element_->fields) {
-        base::RecordingStream recording_stream{stream};
-        field.element->Ignore(recording_stream);
-        field_data.insert(std::make_pair(field.name, recording_stream.str()));
-      }
-
-      ReadHelper<base::IsNativeSerializable<ParentType>() ? 1 :
-                 base::IsExternalSerializable<ParentType>() ? 2 : 0>(
-                     &field_data, value);
-    }
-  }
-
-  template <int _>
-  void ReadHelper(StringMap*, ParentType*) const {
-    base::AssertNotReached();
-  }
-
-  template <>
-  void ReadHelper<1>(StringMap* field_data, ParentType* value) const {
-    // Now visit the C++ structure.
-    DataArchive archive(field_data, &readers_);
-    base::Serialize(value, &archive);
+  /// When reading from a contiguous buffer, the fixed size portions
+  /// of the plan are satisfied with direct copies.
+  void Read(ParentType* value, base::BufferReadStream& stream) const {
+    ReadImpl(value, stream);
   }
 
-  template <>
-  void ReadHelper<2>(StringMap* field_data, ParentType* value) const {
-    mjlib::base::ExternalSerializer<ParentType> serializer;
-    serializer.Serialize(value, ExternalDataHelper{field_data, &readers_});
+  void Read(ParentType* value, base::ReadStream& stream) const {
+    ReadImpl(value, stream);
   }
 
-  template <typename T>
-  void ReadContainer(std::vector<T>* value, base::ReadStream& stream_in) const {
+  template <typename T, typename Stream>
+  void ReadContainer(std::vector<T>* value, Stream& stream_in) const {
     ReadStream stream{stream_in};
     const auto maybe_vector_size = stream.ReadVaruint();
     value->resize(maybe_vector_size.value());
@@ -287,15 +219,15 @@ class MappedBinaryReader {
     }
   }
 
-  template <typename T, size_t N>
-  void ReadContainer(std::array<T, N>* value, base::ReadStream& stream_in) const {
+  template <typename T, size_t N, typename Stream>
+  void ReadContainer(std::array<T, N>* value, Stream& stream_in) const {
     for (auto& item : *value) {
       container_readers_.front()->Read(stream_in, &item);
     }
   }
 
-  template <typename T>
-  void ReadContainer(std::optional<T>* value, base::ReadStream& stream_in) const {
+  template <typename T, typename Stream>
+  void ReadContainer(std::optional<T>* value, Stream& stream_in) const {
     ReadStream stream{stream_in};
     const auto union_index = stream.ReadVaruint();
     if (union_index == 0) {
@@ -307,16 +239,16 @@ class MappedBinaryReader {
     }
   }
 
-  template <typename T>
-  void ReadContainer(T* value, base::ReadStream& stream_in,
+  template <typename T, typename Stream>
+  void ReadContainer(T* value, Stream& stream_in,
                      std::enable_if_t<base::IsEnum<T>::value, int> = 0) const {
     ReadStream stream{stream_in};
     const auto maybe_value = stream.ReadVaruint();
     *value = static_cast<T>(maybe_value.value());
   }
 
-  template <typename T>
-  void ReadContainer(T*, base::ReadStream&,
+  template <typename T, typename Stream>
+  void ReadContainer(T*, Stream&,
                      std::enable_if_t<!base::IsEnum<T>::value, int> = 0) const {
     base::AssertNotReached();
   }
@@ -326,12 +258,11 @@ class MappedBinaryReader {
    public:
     virtual ~Reader() {}
 
-    virtual void Read(std::string_view data, void* value) = 0;
+    virtual void Read(base::BufferReadStream& stream, void* value) = 0;
     virtual void Read(base::ReadStream& stream, void* value) = 0;
   };
 
-  using ReaderMap = std::map<std::string, std::unique_ptr<Reader>>;
-  using ContainerReaders = std::vector<std::unique_ptr<Reader>>;
+  using Readers = std::vector<std::unique_ptr<Reader>>;
 
   template <typename ChildType>
   class ChildReader : public Reader {
@@ -339,9 +270,9 @@ class MappedBinaryReader {
     ChildReader(const Element* element) : reader_(element) {}
     ~ChildReader() override {}
 
-    void Read(std::string_view data, void* value) override {
+    void Read(base::BufferReadStream& stream, void* value) override {
       ChildType* child = reinterpret_cast<ChildType*>(value);
-      reader_.Read(child, data);
+      reader_.Read(child, stream);
     }
 
     void Read(base::ReadStream& stream, void* value) override {
@@ -352,110 +283,251 @@ class MappedBinaryReader {
     MappedBinaryReader<ChildType> reader_;
   };
 
-  class SchemaArchive {
+  /// One entry in the compiled plan.  Each step consumes the next
+  /// portion of the serialized data in order.
+  struct Step {
+    enum Op {
+      /// Copy 'size' bytes to 'offset' within ParentType.
+      kCopy,
+
+      /// Discard 'size' bytes of fixed size data.
+      kSkip,
+
+      /// Discard the variable sized 'element'.
+      kIgnore,
+
+      /// Use 'reader' to fill the member at 'offset'.
+      kRead,
+    };
+
+    Op op = kCopy;
+    int64_t size = 0;
+    std::ptrdiff_t offset = 0;
+    const Element* element = nullptr;
+    Reader* reader = nullptr;
+  };
+
+  using Plan = std::vector<Step>;
+
+  struct Destination;
+  using Destinations = std::vector<Destination>;
+
+  /// Where a given C++ member lives, and how it can be filled.  This
+  /// is only used while compiling the plan.
+  struct Destination {
+    std::string name;
+    std::ptrdiff_t offset = 0;
+
+    /// If non-negative, the member is filled by copying this many
+    /// bytes.
+    int64_t copy_size = -1;
+
+    /// If true, this is a structure whose members are listed in
+    /// 'children'.
+    bool nested = false;
+    Destinations children;
+
+    /// Otherwise, the reader to use.
+    Reader* reader = nullptr;
+  };
+
+  class PlanArchive {
    public:
-    SchemaArchive(const StringElementMap* string_element_map,
-                  MappedBinaryReader* parent)
-        : string_element_map_(string_element_map),
+    PlanArchive(const Element* element,
+                Destinations* destinations,
+                const char* root,
+                MappedBinaryReader* parent)
+        : element_(element),
+          destinations_(destinations),
+          root_(root),
           parent_(parent) {}
 
     template <typename NameValuePair>
     void Visit(const NameValuePair& nvp) {
-      VisitHelper(nvp, nvp.value(), base::PriorityTag<1>());
-    }
-
-    template <typename NameValuePair, typename T>
-    void VisitHelper(const NameValuePair& nvp, T* value, base::PriorityTag<1>,
-                     std::enable_if_t<base::IsExternalSerializable<T>(), int> = 0) {
-      // We have to invoke the external serializer here.
-      mjlib::base::ExternalSerializer<T> serializer;
-      serializer.Serialize(value, [&](const auto& new_nvp) {
-          base::detail::NameValuePairNameOverride old_name(new_nvp, nvp.name());
-          Visit(old_name);
-        });
-    }
-
-    template <typename NameValuePair, typename T>
-    void VisitHelper(const NameValuePair& nvp, T*, base::PriorityTag<0>) {
       using ChildTypeCV = decltype(*nvp.value());
       using ChildType = typename std::remove_const<
         typename std::remove_reference<ChildTypeCV>::type>::type;
-      auto it = string_element_map_->find(nvp.name());
-      if (it == string_element_map_->end()) { return; }
 
-      parent_->readers_.insert(
-          std::make_pair(nvp.name(),
-                         std::make_unique<ChildReader<ChildType>>(
-                             it->second)));
+      const Element* const field_element = FindField(nvp.name());
+      if (field_element == nullptr) { return; }
+
+      Destination destination;
+      destination.name = nvp.name();
+      destination.offset =
+          reinterpret_cast<const char*>(nvp.value()) - root_;
+      if (destination.offset < 0 ||
+          static_cast<std::size_t>(destination.offset) + sizeof(ChildType) >
+          sizeof(ParentType)) {
+        throw base::system_error(
+            base::error_code(
+                errc::kTypeMismatch,
+                fmt::format(
+                    "'{}' of C++ type {} is not a member of the structure",
+                    nvp.name(), typeid(ParentType).name())));
+      }
+
+      if constexpr (detail::IsMemcpyCompatible<ChildType>::value) {
+        if (field_element->maybe_fixed_size ==
+            static_cast<int64_t>(sizeof(ChildType)) &&
+            field_element->binary_schema ==
+            BinarySchemaArchive::Write<ChildType>()) {
+          destination.copy_size = sizeof(ChildType);
+        }
+      } else if constexpr (base::IsNativeSerializable<ChildType>()) {
+        if (field_element->type == Format::Type::kObject) {
+          destination.nested = true;
+          PlanArchive child_archive(
+              field_element, &destination.children, root_, parent_);
+          base::Serialize(nvp.value(), &child_archive);
+        }
+      }
+
+      if (destination.copy_size < 0 && !destination.nested) {
+        parent_->readers_.push_back(
+            std::make_unique<ChildReader<ChildType>>(field_element));
+        destination.reader = parent_->readers_.back().get();
+      }
+
+      destinations_->push_back(std::move(destination));
     }
 
    private:
-    const StringElementMap* const string_element_map_;
+    const Element* FindField(std::string_view name) const {
+      for (const auto& field : element_->fields) {
+        if (field.name == name) { return field.element; }
+      }
+      return nullptr;
+    }
+
+    const Element* const element_;
+    Destinations* const destinations_;
+    const char* const root_;
     MappedBinaryReader* const parent_;
   };
 
-  class DataArchive {
-   public:
-    DataArchive(const StringMap* data, const ReaderMap* reader_map)
-        : data_(data), reader_map_(reader_map) {}
+  void CompilePlan(const Element* element, const Destinations& destinations) {
+    for (const auto& field : element->fields) {
+      const auto it = std::find_if(
+          destinations.begin(), destinations.end(),
+          [&](const auto& destination) {
+            return destination.name == field.name;
+          });
+      if (it == destinations.end()) {
+        AddSkip(field.element);
+      } else if (it->copy_size >= 0) {
+        AddCopy(it->offset, it->copy_size);
+      } else if (it->nested) {
+        CompilePlan(field.element, it->children);
+      } else {
+        Step step;
+        step.op = Step::kRead;
+        step.offset = it->offset;
+        step.reader = it->reader;
+        plan_.push_back(step);
+      }
+    }
+  }
 
-    template <typename NameValuePair>
-    void Visit(const NameValuePair& nvp) {
-      const auto rit = reader_map_->find(nvp.name());
-      if (rit == reader_map_->end()) { return; }
+  void AddCopy(std::ptrdiff_t offset, int64_t size) {
+    if (!plan_.empty() &&
+        plan_.back().op == Step::kCopy &&
+        (plan_.back().offset + plan_.back().size) == offset) {
+      // This continues the previous run in both the source and the
+      // destination.
+      plan_.back().size += size;
+      return;
+    }
+
+    Step step;
+    step.op = Step::kCopy;
+    step.size = size;
+    step.offset = offset;
+    plan_.push_back(step);
+  }
 
-      const auto dit = data_->find(nvp.name());
-      if (dit == data_->end()) { return; }
+  void AddSkip(const Element* element) {
+    if (element->maybe_fixed_size < 0) {
+      Step step;
+      step.op = Step::kIgnore;
+      step.element = element;
+      plan_.push_back(step);
+      return;
+    }
 
-      rit->second->Read(dit->second, nvp.value());
+    if (!plan_.empty() && plan_.back().op == Step::kSkip) {
+      plan_.back().size += element->maybe_fixed_size;
+      return;
     }
 
-   private:
-    const StringMap* const data_;
-    const ReaderMap* const reader_map_;
-  };
+    Step step;
+    step.op = Step::kSkip;
+    step.size = element->maybe_fixed_size;
+    plan_.push_back(step);
+  }
 
-  template <int _>
-  struct ExtraHelper {
-    template <typename NameValuePair>
-    void operator()(DataArchive* archive, const NameValuePair& nvp) {
-      archive->Visit(nvp);
+  template <typename Stream>
+  void ReadImpl(ParentType* value, Stream& stream) const {
+    if (schemas_same_) {
+      BinaryReadArchive(stream).Value(value);
+    } else if (!container_readers_.empty()) {
+      ReadContainer(value, stream);
+    } else {
+      ReadPlan(value, stream);
     }
-  };
+  }
 
-  template<>
-  struct ExtraHelper<1> {
-    template <typename NameValuePair>
-    void operator()(DataArchive* archive, const NameValuePair& nvp) {
-      nvp.value()->Serialize(archive);
+  template <typename Stream>
+  void ReadPlan(ParentType* value, Stream& stream) const {
+    char* const base = reinterpret_cast<char*>(value);
+    for (const auto& step : plan_) {
+      switch (step.op) {
+        case Step::kCopy: {
+          Copy(stream, base + step.offset, step.size);
+          break;
+        }
+        case Step::kSkip: {
+          Skip(stream, step.size);
+          break;
+        }
+        case Step::kIgnore: {
+          step.element->Ignore(stream);
+          break;
+        }
+        case Step::kRead: {
+          step.reader->Read(stream, base + step.offset);
+          break;
+        }
+      }
     }
-  };
+  }
 
-  struct ExternalDataHelper {
-    ExternalDataHelper(StringMap* field_data_in, const ReaderMap* readers_in)
-        : archive(field_data_in, readers_in) {}
+  static void Copy(base::BufferReadStream& stream, char* out, int64_t size) {
+    const auto to_copy = std::min<std::streamsize>(size, stream.remaining());
+    std::memcpy(out, stream.position(), to_copy);
+    stream.fast_ignore(to_copy);
+  }
 
-    template <typename NameValuePair>
-    void operator()(const NameValuePair& nvp) {
-      using ChildRef = decltype(*nvp.value());
-      using Child = typename std::remove_reference<ChildRef>::type;
-      ExtraHelper<
-        base::IsNativeSerializable<Child>() ? 1 : 0>{}(&archive, nvp);
-    }
+  static void Copy(base::ReadStream& stream, char* out, int64_t size) {
+    stream.read({out, static_cast<std::streamsize>(size)});
+  }
 
-    DataArchive archive;
-  };
+  static void Skip(base::BufferReadStream& stream, int64_t size) {
+    stream.fast_ignore(std::min<std::streamsize>(size, stream.remaining()));
+  }
+
+  static void Skip(base::ReadStream& stream, int64_t size) {
+    stream.ignore(size);
+  }
 
   bool schemas_same_ = false;
   const Element* element_;
 
-  // There is one entry here for each field of the C++ structure,
-  // indexed by name.
-  ReaderMap readers_;
-  ContainerReaders container_readers_;
+  Plan plan_;
 
-  // This is really just a member variable for convenience.
-  StringElementMap element_map_;
+  // The readers referenced by the plan, one for each C++ member which
+  // could not be copied or flattened.
+  Readers readers_;
+  Readers container_readers_;
 };
 
 }
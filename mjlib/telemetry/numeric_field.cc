@@ -0,0 +1,138 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/numeric_field.h"
+
+#include <algorithm>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/fail.h"
+#include "mjlib/base/system_error.h"
+#include "mjlib/telemetry/error.h"
+
+namespace mjlib {
+namespace telemetry {
+
+namespace {
+using FT = Format::Type;
+
+const BinarySchemaParser::Field* FindField(
+    const BinarySchemaParser::Element* object, std::string_view name) {
+  for (const auto& field : object->fields) {
+    if (field.name == name) { return &field; }
+    if (std::find(field.aliases.begin(), field.aliases.end(), name) !=
+        field.aliases.end()) {
+      return &field;
+    }
+  }
+  return nullptr;
+}
+}
+
+NumericField::NumericField(const BinarySchemaParser& parser,
+                           std::string_view path)
+    : path_(path) {
+  const Element* element = parser.root();
+  int64_t offset = 0;
+
+  std::string_view remaining = path;
+  while (!remaining.empty()) {
+    const auto dot = remaining.find('.');
+    const auto name = remaining.substr(0, dot);
+    remaining = (dot == std::string_view::npos) ?
+        std::string_view() : remaining.substr(dot + 1);
+
+    const auto* const field =
+        element->type == FT::kObject ? FindField(element, name) : nullptr;
+    if (field == nullptr) {
+      throw base::system_error(
+          {errc::kUnknownField, fmt::format("'{}' in '{}'", name, path)});
+    }
+
+    for (const auto& sibling : element->fields) {
+      if (&sibling == field) { break; }
+      skipped_.push_back(sibling.element);
+      if (offset >= 0) {
+        offset = (sibling.element->maybe_fixed_size >= 0) ?
+            (offset + sibling.element->maybe_fixed_size) : -1;
+      }
+    }
+
+    element = field->element;
+  }
+
+  switch (element->type) {
+    case FT::kBoolean:
+    case FT::kFixedInt:
+    case FT::kFixedUInt:
+    case FT::kVarint:
+    case FT::kVaruint:
+    case FT::kFloat32:
+    case FT::kFloat64:
+    case FT::kEnum:
+    case FT::kTimestamp:
+    case FT::kDuration: {
+      break;
+    }
+    default: {
+      throw base::system_error(
+          {errc::kTypeMismatch, fmt::format("'{}' is not numeric", path)});
+    }
+  }
+
+  element_ = element;
+  fixed_offset_ = offset;
+  if (fixed_offset_ >= 0) { skipped_.clear(); }
+}
+
+double NumericField::Read(std::string_view data) const {
+  base::BufferReadStream stream{data};
+  if (fixed_offset_ >= 0) {
+    stream.ignore(fixed_offset_);
+  } else {
+    for (const auto* skipped : skipped_) {
+      skipped->Ignore(stream);
+    }
+  }
+
+  switch (element_->type) {
+    case FT::kBoolean: {
+      return element_->ReadBoolean(stream) ? 1.0 : 0.0;
+    }
+    case FT::kFixedUInt:
+    case FT::kVaruint:
+    case FT::kEnum: {
+      return static_cast<double>(element_->ReadUIntLike(stream));
+    }
+    case FT::kFixedInt:
+    case FT::kVarint:
+    case FT::kTimestamp:
+    case FT::kDuration: {
+      return static_cast<double>(element_->ReadIntLike(stream));
+    }
+    case FT::kFloat32:
+    case FT::kFloat64: {
+      return element_->ReadFloatLike(stream);
+    }
+    default: {
+      break;
+    }
+  }
+  base::AssertNotReached();
+}
+
+}
+}
@@ -0,0 +1,64 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mjlib/telemetry/binary_schema_parser.h"
+
+namespace mjlib {
+namespace telemetry {
+
+/// Extracts a single numeric value, as a double, from serialized data
+/// records described by a BinarySchemaParser.
+///
+/// The path is a '.' separated list of field names, descending from
+/// the root object through nested objects, for instance
+/// "motor.temperature".  An empty path refers to the root element
+/// itself.  Booleans, integers, floating point values,
+/// enumerations, timestamps and durations are all supported.
+class NumericField {
+ public:
+  /// Throws base::system_error with errc::kUnknownField if @p path
+  /// does not name an element of the schema, or errc::kTypeMismatch
+  /// if that element is not numeric.  The parser must outlive this
+  /// object.
+  NumericField(const BinarySchemaParser&, std::string_view path);
+
+  double Read(std::string_view data) const;
+
+  const std::string& path() const { return path_; }
+
+  const BinarySchemaParser::Element* element() const { return element_; }
+
+ private:
+  using Element = BinarySchemaParser::Element;
+
+  std::string path_;
+  const Element* element_ = nullptr;
+
+  /// When every element prior to the field has a fixed size, it can
+  /// be read directly from this offset.
+  int64_t fixed_offset_ = -1;
+
+  /// Otherwise, these are the elements which precede it, and must
+  /// be skipped over in order.
+  std::vector<const Element*> skipped_;
+};
+
+}
+}
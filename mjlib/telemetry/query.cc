@@ -0,0 +1,513 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/query.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <optional>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/assert.h"
+#include "mjlib/base/system_error.h"
+#include "mjlib/telemetry/error.h"
+
+namespace mjlib {
+namespace telemetry {
+
+/// A recursive descent parser which emits instructions for a stack
+/// machine in postfix order.
+class QueryExpression::Parser {
+ public:
+  Parser(const BinarySchemaParser& schema, std::string_view expression,
+         QueryExpression* output)
+      : schema_(schema),
+        expression_(expression),
+        output_(output) {}
+
+  void Parse() {
+    ParseOr();
+    SkipSpace();
+    if (position_ != expression_.size()) {
+      Error("unexpected text");
+    }
+  }
+
+ private:
+  using Op = QueryExpression::Op;
+
+  void ParseOr() {
+    ParseAnd();
+    while (Consume("||")) {
+      ParseAnd();
+      Emit(Op::kOr);
+    }
+  }
+
+  void ParseAnd() {
+    ParseEquality();
+    while (Consume("&&")) {
+      ParseEquality();
+      Emit(Op::kAnd);
+    }
+  }
+
+  void ParseEquality() {
+    ParseRelational();
+    while (true) {
+      if (Consume("==")) {
+        ParseRelational();
+        Emit(Op::kEqual);
+      } else if (Consume("!=")) {
+        ParseRelational();
+        Emit(Op::kNotEqual);
+      } else {
+        return;
+      }
+    }
+  }
+
+  void ParseRelational() {
+    ParseAdditive();
+    while (true) {
+      // The two character operators must be tried first.
+      if (Consume("<=")) {
+        ParseAdditive();
+        Emit(Op::kLessEqual);
+      } else if (Consume(">=")) {
+        ParseAdditive();
+        Emit(Op::kGreaterEqual);
+      } else if (Consume("<")) {
+        ParseAdditive();
+        Emit(Op::kLess);
+      } else if (Consume(">")) {
+        ParseAdditive();
+        Emit(Op::kGreater);
+      } else {
+        return;
+      }
+    }
+  }
+
+  void ParseAdditive() {
+    ParseMultiplicative();
+    while (true) {
+      if (Consume("+")) {
+        ParseMultiplicative();
+        Emit(Op::kAdd);
+      } else if (Consume("-")) {
+        ParseMultiplicative();
+        Emit(Op::kSubtract);
+      } else {
+        return;
+      }
+    }
+  }
+
+  void ParseMultiplicative() {
+    ParseUnary();
+    while (true) {
+      if (Consume("*")) {
+        ParseUnary();
+        Emit(Op::kMultiply);
+      } else if (Consume("/")) {
+        ParseUnary();
+        Emit(Op::kDivide);
+      } else {
+        return;
+      }
+    }
+  }
+
+  void ParseUnary() {
+    if (Consume("-")) {
+      ParseUnary();
+      Emit(Op::kNegate);
+    } else if (Peek("!") && !Peek("!=")) {
+      Consume("!");
+      ParseUnary();
+      Emit(Op::kNot);
+    } else {
+      ParsePrimary();
+    }
+  }
+
+  void ParsePrimary() {
+    SkipSpace();
+    if (Consume("(")) {
+      ParseOr();
+      Expect(")");
+      return;
+    }
+
+    if (position_ >= expression_.size()) {
+      Error("expected a value");
+    }
+
+    const char c = expression_[position_];
+    if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+      ParseNumber();
+      return;
+    }
+
+    if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+      const auto name = ParseIdentifier();
+      if (Consume("(")) {
+        ParseFunction(name);
+      } else {
+        EmitField(name);
+      }
+      return;
+    }
+
+    Error("expected a value");
+  }
+
+  void ParseFunction(std::string_view name) {
+    if (name == "abs") {
+      ParseOr();
+      Emit(Op::kAbs);
+    } else if (name == "min" || name == "max") {
+      ParseOr();
+      Expect(",");
+      ParseOr();
+      Emit(name == "min" ? Op::kMin : Op::kMax);
+    } else {
+      Error(fmt::format("unknown function '{}'", name));
+    }
+    Expect(")");
+  }
+
+  void ParseNumber() {
+    const std::string text(expression_.substr(position_));
+    char* end = nullptr;
+    const double value = std::strtod(text.c_str(), &end);
+    if (end == text.c_str()) { Error("invalid number"); }
+    position_ += end - text.c_str();
+
+    Emit(Op::kConstant, value);
+  }
+
+  std::string_view ParseIdentifier() {
+    const auto start = position_;
+    while (position_ < expression_.size()) {
+      const auto c = static_cast<unsigned char>(expression_[position_]);
+      if (!std::isalnum(c) && c != '_' && c != '.') { break; }
+      position_++;
+    }
+    return expression_.substr(start, position_ - start);
+  }
+
+  void EmitField(std::string_view path) {
+    auto& fields = output_->fields_;
+    const auto it = std::find_if(
+        fields.begin(), fields.end(),
+        [&](const auto& field) { return field.path() == path; });
+    const auto index = it - fields.begin();
+    if (it == fields.end()) {
+      fields.emplace_back(schema_, path);
+    }
+    Emit(Op::kField, index);
+  }
+
+  void Emit(Op op, double argument = 0.0) {
+    output_->program_.push_back({op, argument});
+    switch (op) {
+      case Op::kConstant:
+      case Op::kField: {
+        depth_++;
+        break;
+      }
+      case Op::kNegate:
+      case Op::kNot:
+      case Op::kAbs: {
+        break;
+      }
+      default: {
+        depth_--;
+        break;
+      }
+    }
+    output_->max_stack_ = std::max(output_->max_stack_, depth_);
+  }
+
+  void SkipSpace() {
+    while (position_ < expression_.size() &&
+           std::isspace(static_cast<unsigned char>(expression_[position_]))) {
+      position_++;
+    }
+  }
+
+  bool Peek(std::string_view token) {
+    SkipSpace();
+    return expression_.substr(position_, token.size()) == token;
+  }
+
+  bool Consume(std::string_view token) {
+    if (!Peek(token)) { return false; }
+    position_ += token.size();
+    return true;
+  }
+
+  void Expect(std::string_view token) {
+    if (!Consume(token)) { Error(fmt::format("expected '{}'", token)); }
+  }
+
+  [[noreturn]] void Error(std::string_view message) {
+    throw base::system_error(
+        base::error_code(
+            errc::kInvalidExpression,
+            fmt::format("{} at offset {} in '{}'",
+                        message, position_, expression_)));
+  }
+
+  const BinarySchemaParser& schema_;
+  const std::string_view expression_;
+  QueryExpression* const output_;
+  std::size_t position_ = 0;
+  std::size_t depth_ = 0;
+};
+
+QueryExpression::QueryExpression(const BinarySchemaParser& schema,
+                                 std::string_view expression) {
+  Parser(schema, expression, this).Parse();
+}
+
+double QueryExpression::Evaluate(std::string_view data) const {
+  constexpr std::size_t kFixedStack = 32;
+  std::array<double, kFixedStack> fixed_stack;
+  std::vector<double> dynamic_stack;
+  double* stack = fixed_stack.data();
+  if (max_stack_ > kFixedStack) {
+    dynamic_stack.resize(max_stack_);
+    stack = dynamic_stack.data();
+  }
+
+  std::size_t size = 0;
+  auto binary = [&](auto operation) {
+    const double rhs = stack[--size];
+    double& lhs = stack[size - 1];
+    lhs = operation(lhs, rhs);
+  };
+
+  for (const auto& instruction : program_) {
+    switch (instruction.op) {
+      case Op::kConstant: {
+        stack[size++] = instruction.argument;
+        break;
+      }
+      case Op::kField: {
+        stack[size++] = fields_[
+            static_cast<std::size_t>(instruction.argument)].Read(data);
+        break;
+      }
+      case Op::kNegate: {
+        stack[size - 1] = -stack[size - 1];
+        break;
+      }
+      case Op::kNot: {
+        stack[size - 1] = (stack[size - 1] == 0.0) ? 1.0 : 0.0;
+        break;
+      }
+      case Op::kAbs: {
+        stack[size - 1] = std::abs(stack[size - 1]);
+        break;
+      }
+      case Op::kAdd: {
+        binary([](double a, double b) { return a + b; });
+        break;
+      }
+      case Op::kSubtract: {
+        binary([](double a, double b) { return a - b; });
+        break;
+      }
+      case Op::kMultiply: {
+        binary([](double a, double b) { return a * b; });
+        break;
+      }
+      case Op::kDivide: {
+        binary([](double a, double b) { return a / b; });
+        break;
+      }
+      case Op::kMin: {
+        binary([](double a, double b) { return std::min(a, b); });
+        break;
+      }
+      case Op::kMax: {
+        binary([](double a, double b) { return std::max(a, b); });
+        break;
+      }
+      case Op::kLess: {
+        binary([](double a, double b) { return a < b ? 1.0 : 0.0; });
+        break;
+      }
+      case Op::kLessEqual: {
+        binary([](double a, double b) { return a <= b ? 1.0 : 0.0; });
+        break;
+      }
+      case Op::kGreater: {
+        binary([](double a, double b) { return a > b ? 1.0 : 0.0; });
+        break;
+      }
+      case Op::kGreaterEqual: {
+        binary([](double a, double b) { return a >= b ? 1.0 : 0.0; });
+        break;
+      }
+      case Op::kEqual: {
+        binary([](double a, double b) { return a == b ? 1.0 : 0.0; });
+        break;
+      }
+      case Op::kNotEqual: {
+        binary([](double a, double b) { return a != b ? 1.0 : 0.0; });
+        break;
+      }
+      case Op::kAnd: {
+        binary([](double a, double b) {
+            return (a != 0.0 && b != 0.0) ? 1.0 : 0.0; });
+        break;
+      }
+      case Op::kOr: {
+        binary([](double a, double b) {
+            return (a != 0.0 || b != 0.0) ? 1.0 : 0.0; });
+        break;
+      }
+    }
+  }
+
+  MJ_ASSERT(size == 1);
+  return stack[0];
+}
+
+namespace {
+/// Invoke @p callback with every matching item.
+template <typename Callback>
+void VisitMatches(FileReader& reader, const QueryOptions& options,
+                  Callback callback) {
+  const auto* const record = reader.record(options.record);
+  if (record == nullptr) {
+    throw base::system_error(
+        base::error_code(
+            errc::kUnknownRecord,
+            fmt::format("record '{}' not present in log", options.record)));
+  }
+
+  std::vector<NumericField> fields;
+  for (const auto& path : options.fields) {
+    fields.emplace_back(*record->schema, path);
+  }
+
+  std::optional<QueryExpression> predicate;
+  if (!options.predicate.empty()) {
+    predicate.emplace(*record->schema, options.predicate);
+  }
+
+  FileReader::ItemsOptions items_options;
+  items_options.records = { options.record };
+  if (!options.start.is_special()) {
+    const auto seek = reader.Seek(options.start);
+    const auto it = seek.find(record);
+    if (it != seek.end()) { items_options.start = it->second; }
+  }
+
+  QueryMatch match;
+  match.values.resize(fields.size());
+
+  for (const auto& item : reader.items(items_options)) {
+    if (!options.start.is_special() && item.timestamp < options.start) {
+      continue;
+    }
+    if (!options.end.is_special() && item.timestamp > options.end) {
+      break;
+    }
+    if (predicate && !predicate->Matches(item.data)) { continue; }
+
+    match.timestamp = item.timestamp;
+    for (std::size_t i = 0; i < fields.size(); i++) {
+      match.values[i] = fields[i].Read(item.data);
+    }
+    callback(match);
+  }
+}
+}
+
+void RunQuery(FileReader& reader, const QueryOptions& options,
+              const std::function<void (const QueryMatch&)>& callback) {
+  VisitMatches(reader, options, callback);
+}
+
+void RunAggregateQuery(
+    FileReader& reader, const QueryOptions& options,
+    const std::function<void (const QueryBucket&)>& callback) {
+  if (options.bucket.is_special() ||
+      options.bucket <= boost::posix_time::time_duration()) {
+    throw base::system_error(
+        base::error_code(
+            errc::kInvalidExpression, "bucket duration must be positive"));
+  }
+
+  const auto size = options.fields.size();
+  const auto bucket_us = options.bucket.total_microseconds();
+
+  QueryBucket bucket;
+  std::vector<double> sum;
+
+  auto reset = [&](boost::posix_time::ptime start) {
+    bucket.start = start;
+    bucket.count = 0;
+    bucket.min.assign(size, std::numeric_limits<double>::infinity());
+    bucket.max.assign(size, -std::numeric_limits<double>::infinity());
+    bucket.mean.assign(size, 0.0);
+    sum.assign(size, 0.0);
+  };
+
+  auto emit = [&]() {
+    if (bucket.count == 0) { return; }
+    for (std::size_t i = 0; i < size; i++) {
+      bucket.mean[i] = sum[i] / bucket.count;
+    }
+    callback(bucket);
+  };
+
+  boost::posix_time::ptime origin;
+  VisitMatches(reader, options, [&](const QueryMatch& match) {
+      if (origin.is_special()) {
+        origin = match.timestamp;
+        reset(origin);
+      }
+
+      const auto offset_us = (match.timestamp - origin).total_microseconds();
+      if (match.timestamp >= bucket.start + options.bucket) {
+        emit();
+        reset(origin + boost::posix_time::microseconds(
+                  (offset_us / bucket_us) * bucket_us));
+      }
+
+      bucket.count++;
+      for (std::size_t i = 0; i < size; i++) {
+        const double value = match.values[i];
+        bucket.min[i] = std::min(bucket.min[i], value);
+        bucket.max[i] = std::max(bucket.max[i], value);
+        sum[i] += value;
+      }
+    });
+  emit();
+}
+
+}
+}
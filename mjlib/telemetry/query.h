@@ -0,0 +1,146 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/telemetry/binary_schema_parser.h"
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/numeric_field.h"
+
+namespace mjlib {
+namespace telemetry {
+
+/// An arithmetic and logical expression over the numeric fields of a
+/// record, for instance:
+///
+///   abs(motor.velocity) > 2.5 && (mode == 3 || fault != 0)
+///
+/// Field paths are as for NumericField.  The supported operators, in
+/// order of increasing precedence, are: || && (== !=) (< <= > >=)
+/// (+ -) (* /) and the unary ! and -.  abs(), min(), and max() are
+/// also available.  Logical operators treat any non-zero value as
+/// true and result in 0 or 1.
+///
+/// The expression is compiled once against a schema into a flat
+/// program, which is then evaluated directly against serialized data.
+class QueryExpression {
+ public:
+  /// Throws base::system_error with errc::kInvalidExpression if the
+  /// expression cannot be parsed, or as NumericField for invalid
+  /// fields.  The parser must outlive this object.
+  QueryExpression(const BinarySchemaParser&, std::string_view expression);
+
+  double Evaluate(std::string_view data) const;
+
+  bool Matches(std::string_view data) const {
+    return Evaluate(data) != 0.0;
+  }
+
+  /// The distinct fields referenced by the expression.
+  const std::vector<NumericField>& fields() const { return fields_; }
+
+  enum class Op : uint8_t {
+    kConstant,
+    kField,
+    kNegate,
+    kNot,
+    kAbs,
+    kAdd,
+    kSubtract,
+    kMultiply,
+    kDivide,
+    kMin,
+    kMax,
+    kLess,
+    kLessEqual,
+    kGreater,
+    kGreaterEqual,
+    kEqual,
+    kNotEqual,
+    kAnd,
+    kOr,
+  };
+
+  struct Instruction {
+    Op op = Op::kConstant;
+    /// The value for kConstant, or the field index for kField.
+    double argument = 0.0;
+  };
+
+ private:
+  class Parser;
+
+  std::vector<NumericField> fields_;
+  std::vector<Instruction> program_;
+  std::size_t max_stack_ = 0;
+};
+
+struct QueryOptions {
+  std::string record;
+
+  /// The fields to report for each match.
+  std::vector<std::string> fields;
+
+  /// If non-empty, only items for which this QueryExpression is true
+  /// are reported.
+  std::string predicate;
+
+  /// If set, only items within this range are considered.
+  boost::posix_time::ptime start;
+  boost::posix_time::ptime end;
+
+  /// If positive, matches are aggregated into buckets of this
+  /// duration, aligned to the start of the first match.
+  boost::posix_time::time_duration bucket;
+
+  QueryOptions() {}
+};
+
+struct QueryMatch {
+  boost::posix_time::ptime timestamp;
+  /// One value for each of QueryOptions::fields.
+  std::vector<double> values;
+};
+
+struct QueryBucket {
+  boost::posix_time::ptime start;
+  uint64_t count = 0;
+
+  /// One value for each of QueryOptions::fields.
+  std::vector<double> min;
+  std::vector<double> max;
+  std::vector<double> mean;
+};
+
+/// Report every item of the record which matches the options.
+///
+/// Throws base::system_error with errc::kUnknownRecord if the record
+/// is not present, or as QueryExpression and NumericField.
+void RunQuery(FileReader&, const QueryOptions&,
+              const std::function<void (const QueryMatch&)>&);
+
+/// Report every non-empty bucket of matching items, in order.
+void RunAggregateQuery(FileReader&, const QueryOptions&,
+                       const std::function<void (const QueryBucket&)>&);
+
+}
+}
@@ -0,0 +1,96 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/mapped_binary_reader.h"
+#include "mjlib/telemetry/schema_cache.h"
+
+namespace mjlib {
+namespace telemetry {
+
+struct ReadAllOptions {
+  /// If not not_a_date_time, only items within [start, end] are
+  /// read.
+  boost::posix_time::ptime start;
+  boost::posix_time::ptime end;
+
+  ReadAllOptions() {}
+};
+
+template <typename T>
+struct ReadAllResult {
+  std::vector<T> values;
+
+  /// Microseconds since the epoch for each element of 'values', or
+  /// FileReader::kNoTimestamp if one was not recorded.
+  std::vector<int64_t> timestamps;
+};
+
+/// Decode every item of the given record into @p values, with the
+/// corresponding timestamps in @p timestamps.  Both are appended to,
+/// so that callers may reuse their storage.  Each item is decoded
+/// directly from the payload buffer, through a single
+/// MappedBinaryReader shared through SchemaCache::Global().
+///
+/// @return the number of items appended
+template <typename T>
+std::size_t ReadAll(FileReader& reader,
+                    std::string_view record_name,
+                    std::vector<T>* values,
+                    std::vector<int64_t>* timestamps,
+                    const ReadAllOptions& options = {}) {
+  const auto* const record = reader.record(record_name);
+  if (record == nullptr) { return 0; }
+
+  const auto mapped = SchemaCache::Global().Reader<T>(record->schema);
+
+  const auto hint = reader.count_hint(record_name);
+  values->reserve(values->size() + hint);
+  timestamps->reserve(timestamps->size() + hint);
+
+  const auto original_size = values->size();
+
+  FileReader::RawOptions raw_options;
+  raw_options.record = std::string(record_name);
+  raw_options.start = options.start;
+  raw_options.end = options.end;
+  reader.ReadRaw(raw_options, [&](int64_t timestamp_us, std::string_view data) {
+      base::BufferReadStream stream{data};
+      values->emplace_back();
+      mapped->Read(&values->back(), stream);
+      timestamps->push_back(timestamp_us);
+    });
+
+  return values->size() - original_size;
+}
+
+template <typename T>
+ReadAllResult<T> ReadAll(FileReader& reader,
+                         std::string_view record_name,
+                         const ReadAllOptions& options = {}) {
+  ReadAllResult<T> result;
+  ReadAll(reader, record_name, &result.values, &result.timestamps, options);
+  return result;
+}
+
+}
+}
@@ -0,0 +1,225 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/replay.h"
+
+#include <chrono>
+#include <map>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/system_error.h"
+#include "mjlib/telemetry/error.h"
+
+namespace mjlib {
+namespace telemetry {
+
+class Replay::Impl {
+ public:
+  Impl(boost::asio::io_context& context, FileReader* reader,
+       const Options& options)
+      : time_(io::DebugDeadlineService::Install(context)),
+        context_(context),
+        reader_(reader),
+        options_(options) {
+    auto initial = options_.start;
+    if (initial.is_special()) {
+      for (const auto& item : reader_->items()) {
+        initial = item.timestamp;
+        break;
+      }
+    }
+    time_->SetTime(initial);
+  }
+
+  const FileReader::Record* FindRecord(std::string_view name) const {
+    const auto* const record = reader_->record(name);
+    if (record == nullptr) {
+      throw base::system_error(
+          base::error_code(
+              errc::kUnknownRecord,
+              fmt::format("record '{}' not present in log", name)));
+    }
+    return record;
+  }
+
+  void SubscribeItem(std::string_view name, ItemCallback callback) {
+    FindRecord(name);
+    auto& callbacks = callbacks_[std::string(name)];
+    callbacks.push_back(std::move(callback));
+  }
+
+  uint64_t Run() {
+    if (!range_) { Open(); }
+    if (finished_) { return 0; }
+
+    stop_ = false;
+    wall_start_ = std::chrono::steady_clock::now();
+    log_start_ = time_->now();
+
+    uint64_t count = 0;
+    while (!stop_ && *current_ != range_->end()) {
+      const auto item = **current_;
+      ++(*current_);
+
+      if (!options_.start.is_special() && item.timestamp < options_.start) {
+        continue;
+      }
+      if (!options_.end.is_special() && item.timestamp > options_.end) {
+        stop_ = true;
+        finished_ = true;
+        break;
+      }
+
+      if (!item.timestamp.is_special()) {
+        AdvanceTo(item.timestamp);
+      }
+
+      const auto it = callbacks_.find(item.record->name);
+      if (it != callbacks_.end()) {
+        for (const auto& callback : it->second) {
+          callback(item);
+        }
+      }
+      count++;
+      Poll();
+    }
+
+    if (!(*current_ != range_->end())) { finished_ = true; }
+    if (finished_ && !options_.end.is_special()) {
+      AdvanceTo(options_.end);
+    }
+
+    return count;
+  }
+
+  void Stop() {
+    stop_ = true;
+  }
+
+  void AdvanceTo(boost::posix_time::ptime timestamp) {
+    const auto now = time_->now();
+    if (!now.is_special() && timestamp < now) { timestamp = now; }
+
+    while (true) {
+      auto next = time_->next_expiration();
+      if (next.is_special() || next > timestamp) { break; }
+      if (next < time_->now()) { next = time_->now(); }
+      Step(next);
+    }
+    Step(timestamp);
+  }
+
+  io::DebugDeadlineService* const time_;
+
+ private:
+  void Open() {
+    FileReader::ItemsOptions items_options;
+    for (const auto& pair : callbacks_) {
+      items_options.records.push_back(pair.first);
+    }
+
+    if (!options_.start.is_special()) {
+      // Begin at the latest index which precedes the start for every
+      // subscribed record.
+      const auto seek = reader_->Seek(options_.start);
+      std::optional<FileReader::Index> start;
+      for (const auto& pair : callbacks_) {
+        const auto it = seek.find(reader_->record(pair.first));
+        if (it == seek.end()) { start.reset(); break; }
+        start = start ? std::min(*start, it->second) : it->second;
+      }
+      if (start) { items_options.start = *start; }
+    }
+
+    range_.emplace(reader_->items(items_options));
+    current_.emplace(range_->begin());
+  }
+
+  void Step(boost::posix_time::ptime timestamp) {
+    Pace(timestamp);
+    time_->SetTime(timestamp);
+    Poll();
+  }
+
+  void Pace(boost::posix_time::ptime timestamp) {
+    if (options_.speed <= 0.0 || log_start_.is_special()) { return; }
+    const double elapsed_us =
+        (timestamp - log_start_).total_microseconds() / options_.speed;
+    std::this_thread::sleep_until(
+        wall_start_ + std::chrono::microseconds(
+            static_cast<int64_t>(elapsed_us)));
+  }
+
+  void Poll() {
+    context_.poll();
+    context_.restart();
+  }
+
+  boost::asio::io_context& context_;
+  FileReader* const reader_;
+  const Options options_;
+
+  std::map<std::string, std::vector<ItemCallback>> callbacks_;
+
+  std::optional<FileReader::ItemRange> range_;
+  std::optional<FileReader::ItemIterator> current_;
+  bool stop_ = false;
+  bool finished_ = false;
+
+  std::chrono::steady_clock::time_point wall_start_;
+  boost::posix_time::ptime log_start_;
+};
+
+Replay::Replay(boost::asio::io_context& context, FileReader* reader,
+               const Options& options)
+    : impl_(std::make_unique<Impl>(context, reader, options)) {}
+
+Replay::~Replay() {}
+
+void Replay::SubscribeItem(std::string_view record_name,
+                           ItemCallback callback) {
+  impl_->SubscribeItem(record_name, std::move(callback));
+}
+
+uint64_t Replay::Run() {
+  return impl_->Run();
+}
+
+void Replay::Stop() {
+  impl_->Stop();
+}
+
+void Replay::AdvanceTo(boost::posix_time::ptime timestamp) {
+  impl_->AdvanceTo(timestamp);
+}
+
+boost::posix_time::ptime Replay::now() const {
+  return impl_->time_->now();
+}
+
+io::DebugDeadlineService* Replay::time() {
+  return impl_->time_;
+}
+
+const FileReader::Record* Replay::FindRecord(std::string_view name) const {
+  return impl_->FindRecord(name);
+}
+
+}
+}
@@ -0,0 +1,117 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "mjlib/io/debug_deadline_service.h"
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/mapped_binary_reader.h"
+#include "mjlib/telemetry/schema_cache.h"
+
+namespace mjlib {
+namespace telemetry {
+
+/// Replays a log into code built on io::DeadlineTimer and the
+/// io_context, with time controlled entirely by the log.
+///
+/// Construction installs an io::DebugDeadlineService on the context
+/// and sets its time to the start of the log.  Run then visits each
+/// subscribed item in log order.  Before each is dispatched, time is
+/// advanced to its timestamp, stopping at every intervening timer
+/// expiration so that handlers observe the time they asked for, and
+/// all ready handlers are run.  A timer which expires at the same
+/// time as an item runs first.
+///
+/// The result depends only upon the log and the handlers, not the
+/// replay speed or the host.  Time never moves backwards; an item
+/// stamped earlier than its predecessor is dispatched at the
+/// predecessor's time.
+class Replay : boost::noncopyable {
+ public:
+  struct Options {
+    /// 0 replays as fast as possible, 1 in real time, and N at N
+    /// times real time.
+    double speed = 0.0;
+
+    /// If set, only items within this range are replayed.  When an
+    /// end is given, time is advanced to it after the last item.
+    boost::posix_time::ptime start;
+    boost::posix_time::ptime end;
+
+    Options() {}
+  };
+
+  /// The @p reader must outlive this object.
+  Replay(boost::asio::io_context&, FileReader* reader, const Options& = {});
+  ~Replay();
+
+  using ItemCallback = std::function<void (const FileReader::Item&)>;
+
+  /// Invoke @p callback with each raw item from the given record.
+  ///
+  /// @throws base::system_error with errc::kUnknownRecord if the log
+  /// has no such record.
+  void SubscribeItem(std::string_view record_name, ItemCallback callback);
+
+  /// Invoke @p callback with each item of the record decoded into a
+  /// T, which need only be compatible with the logged schema, as with
+  /// MappedBinaryReader.
+  template <typename T, typename Callback>
+  void Subscribe(std::string_view record_name, Callback callback) {
+    const auto* const record = FindRecord(record_name);
+    auto reader = SchemaCache::Global().Reader<T>(record->schema);
+    SubscribeItem(
+        record_name,
+        [reader, callback = std::move(callback)](
+            const FileReader::Item& item) {
+          const T value = reader->Read(item.data);
+          callback(value);
+        });
+  }
+
+  /// Replay every subscribed item.  May be called again after Stop,
+  /// in which case it resumes with the next item.
+  ///
+  /// @return the number of items dispatched by this call
+  uint64_t Run();
+
+  /// Cause Run to return after the current item has been processed.
+  void Stop();
+
+  /// Advance time to @p timestamp, running every timer which expires
+  /// on the way.
+  void AdvanceTo(boost::posix_time::ptime timestamp);
+
+  boost::posix_time::ptime now() const;
+
+  io::DebugDeadlineService* time();
+
+ private:
+  const FileReader::Record* FindRecord(std::string_view) const;
+
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -0,0 +1,171 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/schema_cache.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace mjlib {
+namespace telemetry {
+
+class SchemaCache::Impl {
+ public:
+  Impl(const Options& options) : options_(options) {}
+
+  std::shared_ptr<const BinarySchemaParser> Parse(
+      std::string_view schema, std::string_view record_name) {
+    // The record name is part of the key, as it names the root
+    // element of the parsed tree.
+    std::string key;
+    key.reserve(record_name.size() + 1 + schema.size());
+    key.append(record_name);
+    key.push_back('\0');
+    key.append(schema);
+
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      const auto it = parsers_.find(key);
+      if (it != parsers_.end()) {
+        stats_.parse_hits++;
+        return it->second;
+      }
+    }
+
+    // Parse outside the lock, so that unrelated schemas can be
+    // parsed concurrently.
+    auto parser = std::make_shared<const BinarySchemaParser>(
+        schema, record_name);
+
+    std::lock_guard<std::mutex> guard(mutex_);
+    stats_.parse_misses++;
+    const auto [it, inserted] =
+        parsers_.emplace(std::move(key), std::move(parser));
+    // Take a reference first, so that the new entry is not itself
+    // evicted.
+    auto result = it->second;
+    if (inserted) { MaybeEvict(); }
+    return result;
+  }
+
+  std::shared_ptr<const void> FindReader(
+      const BinarySchemaParser* parser, std::type_index type) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    const auto it = readers_.find({parser, type});
+    if (it == readers_.end()) { return {}; }
+    stats_.reader_hits++;
+    return it->second;
+  }
+
+  std::shared_ptr<const void> AddReader(
+      const BinarySchemaParser* parser, std::type_index type,
+      std::shared_ptr<const void> reader) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stats_.reader_misses++;
+    const auto [it, inserted] =
+        readers_.emplace(std::make_pair(parser, type), std::move(reader));
+    // Take a reference first, so that the new entry is not itself
+    // evicted.
+    auto result = it->second;
+    if (inserted) { MaybeEvict(); }
+    return result;
+  }
+
+  Stats stats() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto result = stats_;
+    result.parsers = parsers_.size();
+    result.readers = readers_.size();
+    return result;
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    readers_.clear();
+    parsers_.clear();
+  }
+
+ private:
+  void MaybeEvict() {
+    if (parsers_.size() + readers_.size() <= options_.max_entries) {
+      return;
+    }
+
+    // Readers hold a reference to their parser, so they must be
+    // considered first.
+    for (auto it = readers_.begin(); it != readers_.end();) {
+      if (it->second.use_count() == 1) {
+        it = readers_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    for (auto it = parsers_.begin(); it != parsers_.end();) {
+      if (it->second.use_count() == 1) {
+        it = parsers_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  const Options options_;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<
+    std::string, std::shared_ptr<const BinarySchemaParser>> parsers_;
+  std::map<std::pair<const BinarySchemaParser*, std::type_index>,
+           std::shared_ptr<const void>> readers_;
+  Stats stats_;
+};
+
+SchemaCache::SchemaCache(const Options& options)
+    : impl_(std::make_unique<Impl>(options)) {}
+
+SchemaCache::~SchemaCache() {}
+
+SchemaCache& SchemaCache::Global() {
+  static SchemaCache cache;
+  return cache;
+}
+
+std::shared_ptr<const BinarySchemaParser> SchemaCache::Parse(
+    std::string_view schema, std::string_view record_name) {
+  return impl_->Parse(schema, record_name);
+}
+
+SchemaCache::Stats SchemaCache::stats() const {
+  return impl_->stats();
+}
+
+void SchemaCache::Clear() {
+  impl_->Clear();
+}
+
+std::shared_ptr<const void> SchemaCache::FindReader(
+    const BinarySchemaParser* parser, std::type_index type) {
+  return impl_->FindReader(parser, type);
+}
+
+std::shared_ptr<const void> SchemaCache::AddReader(
+    const BinarySchemaParser* parser, std::type_index type,
+    std::shared_ptr<const void> reader) {
+  return impl_->AddReader(parser, type, std::move(reader));
+}
+
+}
+}
@@ -0,0 +1,117 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <typeindex>
+
+#include <boost/noncopyable.hpp>
+
+#include "mjlib/telemetry/binary_schema_parser.h"
+#include "mjlib/telemetry/mapped_binary_reader.h"
+
+namespace mjlib {
+namespace telemetry {
+
+/// Shares parsed schemas, and the MappedBinaryReader plans compiled
+/// from them, between every reader in the process.  Logs from the
+/// same program nearly always contain identical schemas, so opening
+/// many of them need only parse each distinct schema once.
+///
+/// Entries are keyed by the record name and the complete schema
+/// bytes.  Once more than Options::max_entries are present, those
+/// not referenced outside of the cache are discarded.
+///
+/// All methods are thread safe, as are the const methods of the
+/// returned objects.
+class SchemaCache : boost::noncopyable {
+ public:
+  struct Options {
+    std::size_t max_entries = 1024;
+
+    Options() {}
+  };
+
+  SchemaCache(const Options& = {});
+  ~SchemaCache();
+
+  /// The cache used by FileReader and StreamDecoder.
+  static SchemaCache& Global();
+
+  /// Return the parsed form of @p schema, as if constructed with
+  /// BinarySchemaParser(schema, record_name).
+  std::shared_ptr<const BinarySchemaParser> Parse(
+      std::string_view schema, std::string_view record_name = "");
+
+  /// Return a reader which maps data described by @p parser into T.
+  /// The reader keeps the parser alive.
+  template <typename T>
+  std::shared_ptr<const MappedBinaryReader<T>> Reader(
+      const std::shared_ptr<const BinarySchemaParser>& parser) {
+    const std::type_index type{typeid(T)};
+    if (auto existing = FindReader(parser.get(), type)) {
+      return std::static_pointer_cast<const MappedBinaryReader<T>>(existing);
+    }
+
+    struct Holder {
+      Holder(std::shared_ptr<const BinarySchemaParser> parser_in)
+          : parser(std::move(parser_in)),
+            reader(parser.get()) {}
+
+      std::shared_ptr<const BinarySchemaParser> parser;
+      MappedBinaryReader<T> reader;
+    };
+
+    // Compile outside of any lock, then keep whichever instance
+    // arrived first.
+    auto holder = std::make_shared<Holder>(parser);
+    std::shared_ptr<const MappedBinaryReader<T>> result(
+        holder, &holder->reader);
+    return std::static_pointer_cast<const MappedBinaryReader<T>>(
+        AddReader(parser.get(), type, result));
+  }
+
+  struct Stats {
+    uint64_t parse_hits = 0;
+    uint64_t parse_misses = 0;
+    uint64_t reader_hits = 0;
+    uint64_t reader_misses = 0;
+
+    /// The number currently held.
+    std::size_t parsers = 0;
+    std::size_t readers = 0;
+  };
+
+  Stats stats() const;
+
+  /// Discard every entry.  Objects which have already been returned
+  /// remain valid.
+  void Clear();
+
+ private:
+  std::shared_ptr<const void> FindReader(
+      const BinarySchemaParser*, std::type_index);
+  std::shared_ptr<const void> AddReader(
+      const BinarySchemaParser*, std::type_index,
+      std::shared_ptr<const void>);
+
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -0,0 +1,349 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/stream_decoder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <optional>
+
+#include <boost/crc.hpp>
+
+#include <fmt/format.h>
+
+#include <snappy.h>
+
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/system_error.h"
+#include "mjlib/telemetry/error.h"
+#include "mjlib/telemetry/schema_cache.h"
+
+namespace mjlib {
+namespace telemetry {
+
+class StreamDecoder::Impl {
+ public:
+  Impl(SchemaCallback schema_callback,
+       DataCallback data_callback,
+       const Options& options)
+      : options_(options),
+        schema_callback_(std::move(schema_callback)),
+        data_callback_(std::move(data_callback)),
+        header_found_(!options.expect_header) {}
+
+  void Push(std::string_view data) {
+    position_ += data.size();
+
+    // First, finish off any block we were in the middle of.  We only
+    // copy as many bytes as that block needs.
+    while (!buffer_.empty()) {
+      const auto required = UnitSize(buffer_);
+      if (required && buffer_.size() == *required) {
+        ProcessUnit(buffer_);
+        buffer_.clear();
+        break;
+      }
+      if (data.empty()) { break; }
+
+      // Until we know how large the block is, feed the header in a
+      // byte at a time, so as to never copy beyond the block's end.
+      const std::size_t to_take = std::min<std::size_t>(
+          required ? (*required - buffer_.size()) : 1, data.size());
+      buffer_.append(data.data(), to_take);
+      data.remove_prefix(to_take);
+    }
+
+    // Then decode all complete blocks directly from the caller's
+    // buffer.
+    while (buffer_.empty() && !data.empty()) {
+      const auto size = UnitSize(data);
+      if (!size || *size > data.size()) { break; }
+
+      ProcessUnit(data.substr(0, *size));
+      data.remove_prefix(*size);
+    }
+
+    // And save whatever partial block remains.
+    buffer_.append(data.data(), data.size());
+  }
+
+  const Record* record(std::string_view name) const {
+    const auto it = name_to_record_.find(name);
+    if (it == name_to_record_.end()) { return nullptr; }
+    return it->second;
+  }
+
+  int64_t position() const { return position_; }
+
+  std::size_t buffered() const { return buffer_.size(); }
+
+  std::string_view Decompress(std::string_view raw) {
+    if (raw.data() == decompressed_source_) { return decompressed_; }
+
+    size_t decompressed_size = 0;
+    if (!snappy::GetUncompressedLength(
+            raw.data(), raw.size(), &decompressed_size)) {
+      throw base::system_error(errc::kDecompressionError);
+    }
+    decompressed_.resize(decompressed_size);
+    if (!snappy::RawUncompress(raw.data(), raw.size(), &decompressed_[0])) {
+      throw base::system_error(errc::kDecompressionError);
+    }
+    decompressed_source_ = raw.data();
+
+    return decompressed_;
+  }
+
+ private:
+  /// Return the total size of the next unit (the file header or a
+  /// block) which begins at @p data, or nullopt if more data is
+  /// required to determine it.
+  std::optional<std::size_t> UnitSize(std::string_view data) const {
+    if (!header_found_) {
+      const std::size_t magic_size = std::min<std::size_t>(8, data.size());
+      if (std::memcmp(data.data(), "TLOG0003", magic_size) != 0) {
+        throw base::system_error(errc::kInvalidHeader);
+      }
+      if (data.size() < 8) { return {}; }
+
+      base::BufferReadStream base_stream{data.substr(8)};
+      telemetry::ReadStream stream{base_stream};
+      if (!stream.ReadVaruint()) { return {}; }
+      return 8 + base_stream.offset();
+    }
+
+    base::BufferReadStream base_stream{data};
+    telemetry::ReadStream stream{base_stream};
+    const auto maybe_type = stream.ReadVaruint();
+    if (!maybe_type) { return {}; }
+    const auto type = *maybe_type;
+    if (type > static_cast<uint64_t>(Format::BlockType::kNumTypes) ||
+        type == 0) {
+      throw base::system_error(errc::kInvalidBlockType);
+    }
+    const auto maybe_size = stream.ReadVaruint();
+    if (!maybe_size) { return {}; }
+
+    return base_stream.offset() + *maybe_size;
+  }
+
+  void ProcessUnit(std::string_view unit) {
+    if (!header_found_) {
+      ProcessHeader(unit);
+    } else {
+      ProcessBlock(unit);
+    }
+    offset_ += unit.size();
+  }
+
+  void ProcessHeader(std::string_view unit) {
+    base::BufferReadStream base_stream{unit.substr(8)};
+    telemetry::ReadStream stream{base_stream};
+    const auto header_flags = stream.ReadVaruint().value();
+    if (header_flags != 0) {
+      // There are no known header flags yet.
+      throw base::system_error(errc::kInvalidHeaderFlags);
+    }
+    header_found_ = true;
+  }
+
+  void ProcessBlock(std::string_view block) {
+    base::BufferReadStream base_stream{block};
+    telemetry::ReadStream stream{base_stream};
+    const auto type =
+        static_cast<Format::BlockType>(stream.ReadVaruint().value());
+    stream.ReadVaruint().value();  // size
+
+    const auto header_size = base_stream.offset();
+
+    switch (type) {
+      case Format::BlockType::kSchema: {
+        ProcessSchema(block.substr(header_size));
+        break;
+      }
+      case Format::BlockType::kData: {
+        ProcessData(block, header_size);
+        break;
+      }
+      case Format::BlockType::kIndex:
+      case Format::BlockType::kCompressionDictionary:
+      case Format::BlockType::kSeekMarker:
+      case Format::BlockType::kSummary: {
+        break;
+      }
+    }
+  }
+
+  void ProcessSchema(std::string_view body) {
+    base::BufferReadStream base_stream{body};
+    telemetry::ReadStream stream{base_stream};
+
+    const auto identifier = stream.ReadVaruint().value();
+    if (id_to_record_.count(identifier)) { return; }
+
+    const auto flags = stream.ReadVaruint().value();
+    if (flags) {
+      throw base::system_error(errc::kUnknownBlockSchemaFlag);
+    }
+
+    records_.push_back({});
+    auto& record = records_.back();
+
+    record.identifier = identifier;
+    record.flags = flags;
+    record.name = stream.ReadString().value();
+    record.raw_schema = std::string(body.substr(base_stream.offset()));
+    record.schema = SchemaCache::Global().Parse(
+        record.raw_schema, record.name);
+
+    id_to_record_[identifier] = &record;
+    name_to_record_[record.name] = &record;
+
+    if (schema_callback_) { schema_callback_(record); }
+  }
+
+  void ProcessData(std::string_view block, std::size_t header_size) {
+    base::BufferReadStream base_stream{block.substr(header_size)};
+    telemetry::ReadStream stream{base_stream};
+
+    Item result;
+    result.index = offset_;
+    result.impl_ = this;
+
+    const auto identifier = stream.ReadVaruint().value();
+    result.flags = stream.ReadVaruint().value();
+
+    auto flags = result.flags;
+    auto check_flags = [&](auto flag) {
+      const auto u64_flag = static_cast<uint64_t>(flag);
+      if (flags & u64_flag) {
+        flags &= ~u64_flag;
+        return true;
+      }
+      return false;
+    };
+
+    if (check_flags(Format::BlockDataFlags::kPreviousOffset)) {
+      stream.ReadVaruint(); // discard
+    }
+    if (check_flags(Format::BlockDataFlags::kTimestamp)) {
+      result.timestamp = stream.ReadTimestamp().value();
+    }
+
+    std::optional<uint32_t> checksum;
+    const std::size_t checksum_offset = header_size + base_stream.offset();
+    if (check_flags(Format::BlockDataFlags::kChecksum)) {
+      checksum = stream.Read<uint32_t>().value();
+    }
+
+    result.snappy_ = check_flags(Format::BlockDataFlags::kSnappy);
+
+    if (flags != 0) {
+      throw base::system_error(errc::kUnknownBlockDataFlag);
+    }
+
+    result.raw_ = block.substr(header_size + base_stream.offset());
+
+    if (checksum && options_.verify_checksums) {
+      // The checksum covers the entire block, with the checksum field
+      // itself treated as all 0s.
+      boost::crc_32_type crc;
+      const uint32_t all_zeros = 0;
+      crc.process_bytes(block.data(), checksum_offset);
+      crc.process_bytes(&all_zeros, sizeof(all_zeros));
+      const auto after = checksum_offset + sizeof(all_zeros);
+      crc.process_bytes(block.data() + after, block.size() - after);
+
+      if (*checksum != crc.checksum()) {
+        throw base::system_error(
+            {errc::kDataChecksumMismatch,
+                  fmt::format("Expected checksum 0x{:08x} got 0x{:08x}",
+                              crc.checksum(), *checksum)});
+      }
+    }
+
+    const auto it = id_to_record_.find(identifier);
+    if (it == id_to_record_.end()) {
+      // We have not seen a schema for this yet, which can happen
+      // when joining a stream partway through.  There is nothing we
+      // can usefully report.
+      return;
+    }
+    result.record = it->second;
+
+    if (data_callback_) { data_callback_(result); }
+
+    // Any cached decompression refers to a buffer which may not
+    // outlive this call.
+    decompressed_source_ = nullptr;
+  }
+
+  const Options options_;
+  SchemaCallback schema_callback_;
+  DataCallback data_callback_;
+
+  bool header_found_ = false;
+
+  /// The total number of bytes passed to Push.
+  int64_t position_ = 0;
+
+  /// The stream position of the next unit to be processed.
+  int64_t offset_ = 0;
+
+  /// A partial unit, held until the remainder arrives.
+  std::string buffer_;
+
+  std::string decompressed_;
+  const char* decompressed_source_ = nullptr;
+
+  std::deque<Record> records_;
+  std::map<Identifier, const Record*> id_to_record_;
+  std::map<std::string, const Record*, std::less<>> name_to_record_;
+};
+
+std::string_view StreamDecoder::Item::data() const {
+  if (!snappy_) { return raw_; }
+  return impl_->Decompress(raw_);
+}
+
+StreamDecoder::StreamDecoder(SchemaCallback schema_callback,
+                             DataCallback data_callback,
+                             const Options& options)
+    : impl_(std::make_unique<Impl>(
+                std::move(schema_callback), std::move(data_callback),
+                options)) {}
+
+StreamDecoder::~StreamDecoder() {}
+
+void StreamDecoder::Push(std::string_view data) {
+  impl_->Push(data);
+}
+
+const StreamDecoder::Record* StreamDecoder::record(
+    std::string_view name) const {
+  return impl_->record(name);
+}
+
+int64_t StreamDecoder::position() const {
+  return impl_->position();
+}
+
+std::size_t StreamDecoder::buffered() const {
+  return impl_->buffered();
+}
+
+}
+}
@@ -0,0 +1,115 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/telemetry/binary_schema_parser.h"
+#include "mjlib/telemetry/format.h"
+
+namespace mjlib {
+namespace telemetry {
+
+/// Incrementally decode a log with a format as described in README.md
+/// from a sequence of arbitrarily sized chunks, such as those
+/// received from a pipe or socket.
+///
+/// Complete blocks are decoded directly out of the chunks passed to
+/// Push.  Only a block which straddles the end of a chunk is
+/// buffered internally.
+class StreamDecoder {
+ private:
+  class Impl;
+ public:
+  struct Options {
+    bool verify_checksums = true;
+
+    /// If false, the stream is assumed to begin directly with a
+    /// block, for instance when joining a live stream midway.
+    bool expect_header = true;
+
+    Options() {}
+  };
+
+  using Identifier = uint64_t;
+
+  struct Record {
+    Identifier identifier = {};
+
+    std::string name;
+    std::string raw_schema;
+    /// Shared with other readers through SchemaCache::Global().
+    std::shared_ptr<const BinarySchemaParser> schema;
+
+    /// Format::BlockSchemaFlags
+    uint64_t flags = {};
+  };
+
+  class Item {
+   public:
+    /// The position of this block's header in the stream.
+    int64_t index = {};
+
+    boost::posix_time::ptime timestamp;
+
+    /// Format::BlockDataFlags
+    uint64_t flags = {};
+    const Record* record = nullptr;
+
+    /// The serialized data, decompressed if necessary.  Both the
+    /// Item and the returned view are only valid for the duration of
+    /// the callback.
+    std::string_view data() const;
+
+   private:
+    friend class StreamDecoder::Impl;
+
+    Impl* impl_ = nullptr;
+    std::string_view raw_;
+    bool snappy_ = false;
+  };
+
+  using SchemaCallback = std::function<void (const Record&)>;
+  using DataCallback = std::function<void (const Item&)>;
+
+  StreamDecoder(SchemaCallback, DataCallback, const Options& = {});
+  ~StreamDecoder();
+
+  /// Decode as many blocks as are completed by @p data, invoking the
+  /// callbacks for each before returning.
+  ///
+  /// Throws base::system_error if the stream is malformed.
+  void Push(std::string_view data);
+
+  const Record* record(std::string_view name) const;
+
+  /// The total number of bytes passed to Push.
+  int64_t position() const;
+
+  /// The number of bytes currently held while waiting for the
+  /// remainder of a block.
+  std::size_t buffered() const;
+
+ private:
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -0,0 +1,129 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/base/visitor.h"
+
+namespace mjlib {
+namespace telemetry {
+namespace test {
+
+/// Representative of a small, frequently logged status record.
+struct BenchmarkServo {
+  int32_t id = 0;
+  int8_t mode = 0;
+  float position = 0.0f;
+  float velocity = 0.0f;
+  float torque = 0.0f;
+  float voltage = 0.0f;
+  float temperature = 0.0f;
+  uint16_t fault = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(id));
+    a->Visit(MJ_NVP(mode));
+    a->Visit(MJ_NVP(position));
+    a->Visit(MJ_NVP(velocity));
+    a->Visit(MJ_NVP(torque));
+    a->Visit(MJ_NVP(voltage));
+    a->Visit(MJ_NVP(temperature));
+    a->Visit(MJ_NVP(fault));
+  }
+};
+
+/// Representative of a large per-cycle record, with nested
+/// structures, arrays, and a string.
+struct BenchmarkFrame {
+  boost::posix_time::ptime timestamp;
+  uint64_t cycle = 0;
+  std::array<double, 4> attitude = {};
+  std::array<double, 3> rate_dps = {};
+  std::vector<BenchmarkServo> servos;
+  std::string state;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(timestamp));
+    a->Visit(MJ_NVP(cycle));
+    a->Visit(MJ_NVP(attitude));
+    a->Visit(MJ_NVP(rate_dps));
+    a->Visit(MJ_NVP(servos));
+    a->Visit(MJ_NVP(state));
+  }
+};
+
+/// A later version of BenchmarkServo, as a reader built against
+/// newer code might see it: fields removed, one added, and the
+/// remainder reordered.
+struct BenchmarkServoEvolved {
+  float temperature = 0.0f;
+  int32_t id = 0;
+  float position = 0.0f;
+  float velocity = 0.0f;
+  float torque = 0.0f;
+  uint16_t fault = 0;
+  float current = 0.0f;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(temperature));
+    a->Visit(MJ_NVP(id));
+    a->Visit(MJ_NVP(position));
+    a->Visit(MJ_NVP(velocity));
+    a->Visit(MJ_NVP(torque));
+    a->Visit(MJ_NVP(fault));
+    a->Visit(MJ_NVP(current));
+  }
+};
+
+inline BenchmarkServo MakeBenchmarkServo(int index) {
+  BenchmarkServo result;
+  result.id = index;
+  result.mode = 10;
+  result.position = 0.01f * index;
+  result.velocity = -0.5f + index;
+  result.torque = 0.25f * index;
+  result.voltage = 24.0f;
+  result.temperature = 30.0f + index;
+  return result;
+}
+
+inline BenchmarkFrame MakeBenchmarkFrame(int index) {
+  BenchmarkFrame result;
+  result.timestamp = boost::posix_time::ptime(
+      boost::gregorian::date(2023, 1, 1)) +
+      boost::posix_time::milliseconds(index);
+  result.cycle = index;
+  result.attitude = {{1.0, 0.0, 0.0, 0.0}};
+  result.rate_dps = {{0.1 * index, -0.2, 0.3}};
+  for (int i = 0; i < 12; i++) {
+    result.servos.push_back(MakeBenchmarkServo(i + index));
+  }
+  result.state = "walking";
+  return result;
+}
+
+}
+}
+}
@@ -87,7 +87,7 @@ name=.value_enum.value_enum type=6 bs=06 maybe_fixed_size=-1 int_size=-1
 name=.value_array type=18 bs=121000000976616c75655f75333200040401030000000000000000 maybe_fixed_size=-1 int_size=-1
 name=.value_array.value_array type=16 bs=1000000976616c75655f75333200040401030000000000000000 maybe_fixed_size=4 int_size=-1
 name=.value_array.value_array.value_u32 type=4 bs=0404 maybe_fixed_size=4 int_size=4
-name=.value_fixedarray type=19 bs=13020401 maybe_fixed_size=-1 int_size=-1
+name=.value_fixedarray type=19 bs=13020401 maybe_fixed_size=2 int_size=-1
 name=.value_fixedarray.value_fixedarray type=4 bs=0401 maybe_fixed_size=1 int_size=1
 name=.value_optional type=21 bs=1501030400 maybe_fixed_size=-1 int_size=-1
 name=.value_optional.value_optional type=1 bs=01 maybe_fixed_size=0 int_size=-1
@@ -58,6 +58,48 @@ BOOST_AUTO_TEST_CASE(BinaryWriteArchive) {
       expected, telemetry::BinaryWriteArchive::Write(all_types));
 }
 
+namespace {
+struct ArrayTest {
+  std::vector<float> floats = {1.0f, 2.0f, 3.0f};
+  std::array<int16_t, 2> shorts = {{4, 5}};
+  std::vector<std::string> strings = {"a"};
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(floats));
+    a->Visit(MJ_NVP(shorts));
+    a->Visit(MJ_NVP(strings));
+  }
+};
+}
+
+BOOST_AUTO_TEST_CASE(BufferBinaryWriteArchive) {
+  const base::test::AllTypesTest all_types;
+  const auto expected = telemetry::BinaryWriteArchive::Write(all_types);
+
+  base::FastOStringStream ostr;
+  ostr.write("xy");
+  const auto size = telemetry::AppendBinary(all_types, &ostr);
+  BOOST_TEST(size == expected.size());
+  BOOST_TEST(ostr.str() == "xy" + expected);
+
+  const ArrayTest array_test;
+  const std::vector<uint8_t> array_expected = {
+    0x03,  // floats size
+    0x00, 0x00, 0x80, 0x3f,
+    0x00, 0x00, 0x00, 0x40,
+    0x00, 0x00, 0x40, 0x40,
+    0x04, 0x00, 0x05, 0x00,  // shorts
+    0x01, 0x01, 'a',  // strings
+  };
+  telemetry::test::Compare(
+      array_expected, telemetry::BinaryWriteArchive::Write(array_test));
+
+  base::FastOStringStream array_ostr;
+  telemetry::AppendBinary(array_test, &array_ostr);
+  telemetry::test::Compare(array_expected, array_ostr.str());
+}
+
 BOOST_AUTO_TEST_CASE(BinarySchemaArchive) {
   base::FastOStringStream ostr;
   telemetry::BinarySchemaArchive dut(ostr);
@@ -0,0 +1,288 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mjlib/telemetry/block_sink.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <thread>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/temporary_file.h"
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/file_writer.h"
+#include "mjlib/telemetry/stream_decoder.h"
+
+using namespace mjlib;
+namespace tl = telemetry;
+
+namespace {
+const boost::posix_time::ptime kStart =
+    boost::posix_time::time_from_string("2020-03-10 00:00:00");
+
+void WriteItems(tl::FileWriter* writer, int count) {
+  const auto id1 = writer->AllocateIdentifier("test1");
+  for (int i = 0; i < count; i++) {
+    writer->WriteData(kStart + boost::posix_time::milliseconds(10 * i), id1,
+                      "id1: " + std::to_string(i) + std::string(100, 'x'));
+  }
+}
+
+std::vector<int> Decode(std::string_view data) {
+  std::vector<int> result;
+  tl::StreamDecoder decoder{
+    {},
+    [&](const tl::StreamDecoder::Item& item) {
+      result.push_back(std::stoi(std::string(item.data().substr(5))));
+    }};
+  decoder.Push(data);
+  BOOST_TEST(decoder.buffered() == 0);
+  return result;
+}
+
+std::string ToFile(const base::TemporaryFile& file, std::string_view data) {
+  std::ofstream outf(file.native(), std::ios::binary);
+  outf.write(data.data(), data.size());
+  return file.native();
+}
+
+int ItemValue(tl::FileReader* reader, tl::FileReader::Index index) {
+  tl::FileReader::ItemsOptions options;
+  options.start = index;
+  const auto item = *reader->items(options).begin();
+  return std::stoi(item.data.substr(5));
+}
+
+/// Verify that the previous offset of every data block in @p data
+/// refers to the data block before it.
+void CheckPreviousOffsets(std::string_view data, tl::FileReader* reader) {
+  const auto read_varuint = [&](std::size_t* offset) {
+    uint64_t result = 0;
+    int shift = 0;
+    while (true) {
+      const auto byte = static_cast<uint8_t>(data.at((*offset)++));
+      result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) { return result; }
+      shift += 7;
+    }
+  };
+
+  tl::FileReader::Index last = -1;
+  for (const auto& item : reader->items()) {
+    std::size_t offset = item.index;
+    read_varuint(&offset);  // type
+    read_varuint(&offset);  // size
+    read_varuint(&offset);  // identifier
+    read_varuint(&offset);  // flags
+    const auto previous_offset = read_varuint(&offset);
+    BOOST_TEST(previous_offset ==
+               static_cast<uint64_t>(last < 0 ? 0 : item.index - last));
+    last = item.index;
+  }
+}
+
+std::string ReadAll(int fd) {
+  std::string result;
+  char buf[4096] = {};
+  while (true) {
+    const auto amount = ::read(fd, buf, sizeof(buf));
+    if (amount <= 0) { break; }
+    result.append(buf, amount);
+  }
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(BlockSinkMemory) {
+  base::TemporaryFile tempfile;
+
+  tl::MemorySink sink;
+  {
+    tl::FileWriter writer{tempfile.native()};
+    const auto id1 = writer.AllocateIdentifier("test1");
+    writer.WriteSchema(id1, "\x0a");  // string
+
+    // The sink receives the header and existing schemas when added.
+    writer.AddSink(&sink);
+    WriteItems(&writer, 200);
+  }
+
+  std::ifstream inf(tempfile.native(), std::ios::binary);
+  const std::string file_contents(std::istreambuf_iterator<char>(inf), {});
+
+  // The sink sees exactly the same stream as the file.
+  BOOST_TEST(sink.data() == file_contents);
+  BOOST_TEST(Decode(sink.data()).size() == 200);
+}
+
+BOOST_AUTO_TEST_CASE(BlockSinkLate) {
+  base::TemporaryFile tempfile;
+
+  tl::MemorySink sink;
+  {
+    tl::FileWriter::Options options;
+    options.seek_block_period_s = 0.1;
+    tl::FileWriter writer{tempfile.native(), options};
+    const auto id1 = writer.AllocateIdentifier("test1");
+    writer.WriteSchema(id1, "\x0a");  // string
+    for (int i = 0; i < 200; i++) {
+      // The sink misses the first half of the data.
+      if (i == 100) { writer.AddSink(&sink); }
+      writer.WriteData(kStart + boost::posix_time::milliseconds(10 * i), id1,
+                       "id1: " + std::to_string(i) + std::string(1000, 'x'));
+    }
+  }
+
+  const auto values = Decode(sink.data());
+  BOOST_TEST_REQUIRE(values.size() == 100);
+  BOOST_TEST(values.front() == 100);
+
+  // The index, seek markers, and previous offsets refer to positions
+  // within the sink's own stream.
+  base::TemporaryFile copy;
+  tl::FileReader reader{ToFile(copy, sink.data())};
+  BOOST_TEST_REQUIRE(reader.has_index());
+  const auto final_item = reader.final_item();
+  BOOST_TEST_REQUIRE(final_item < static_cast<int64_t>(sink.data().size()));
+  BOOST_TEST(ItemValue(&reader, final_item) == 199);
+
+  for (const int i : {100, 150, 199}) {
+    const auto seek =
+        reader.Seek(kStart + boost::posix_time::milliseconds(10 * i));
+    BOOST_TEST_REQUIRE(seek.size() == 1);
+    BOOST_TEST(ItemValue(&reader, seek.begin()->second) == i);
+  }
+
+  CheckPreviousOffsets(sink.data(), &reader);
+}
+
+BOOST_AUTO_TEST_CASE(BlockSinkWithoutFile) {
+  tl::MemorySink sink;
+  tl::FileWriter writer;
+  BOOST_TEST(!writer.IsOpen());
+  writer.AddSink(&sink);
+  BOOST_TEST(writer.IsOpen());
+
+  const auto id1 = writer.AllocateIdentifier("test1");
+  writer.WriteSchema(id1, "\x0a");  // string
+  WriteItems(&writer, 10);
+
+  const auto values = Decode(sink.data());
+  BOOST_TEST_REQUIRE(values.size() == 10);
+  BOOST_TEST(values.back() == 9);
+}
+
+BOOST_AUTO_TEST_CASE(BlockSinkFdReliable) {
+  int fds[2] = {};
+  BOOST_TEST_REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  std::string received;
+  std::thread reader([&]() { received = ReadAll(fds[1]); });
+
+  tl::FdSink::Options options;
+  options.reliable = true;
+  options.max_queued_bytes = 1024;
+  {
+    tl::FdSink sink{fds[0], options};
+    {
+      tl::FileWriter writer;
+      writer.AddSink(&sink);
+      const auto id1 = writer.AllocateIdentifier("test1");
+      writer.WriteSchema(id1, "\x0a");  // string
+      WriteItems(&writer, 1000);
+    }
+    // The destructor completes any queued writes and closes the
+    // descriptor.
+  }
+  reader.join();
+  ::close(fds[1]);
+
+  const auto values = Decode(received);
+  BOOST_TEST_REQUIRE(values.size() == 1000);
+  for (int i = 0; i < 1000; i++) { BOOST_TEST(values[i] == i); }
+}
+
+BOOST_AUTO_TEST_CASE(BlockSinkFdDrop) {
+  int fds[2] = {};
+  BOOST_TEST_REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  const int sndbuf = 4096;
+  ::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+  tl::FdSink::Options options;
+  options.max_queued_bytes = 8192;
+
+  tl::FdSink::Stats stats;
+  std::string received;
+  std::thread reader;
+  {
+    std::optional<tl::FdSink> sink;
+    sink.emplace(fds[0], options);
+    {
+      tl::FileWriter::Options writer_options;
+      writer_options.seek_block_period_s = 0.1;
+      tl::FileWriter writer{writer_options};
+      writer.AddSink(&*sink);
+      const auto id1 = writer.AllocateIdentifier("test1");
+      writer.WriteSchema(id1, "\x0a");  // string
+
+      // Nothing is reading yet, so the sink falls behind, but the
+      // writer is never blocked.
+      WriteItems(&writer, 5000);
+    }
+
+    stats = sink->stats();
+
+    // Now drain what remains.  Destroying the sink waits for its
+    // queue to empty, then closes the descriptor.
+    reader = std::thread([&]() { received = ReadAll(fds[1]); });
+    sink.reset();
+  }
+  reader.join();
+  ::close(fds[1]);
+
+  BOOST_TEST(stats.drops > 0);
+  BOOST_TEST(stats.blocks_dropped > 0);
+  BOOST_TEST(!stats.failed);
+
+  // What was received is still a valid stream, resynchronized at
+  // seek markers.
+  const auto values = Decode(received);
+  BOOST_TEST_REQUIRE(!values.empty());
+  BOOST_TEST(values.size() < 5000);
+  for (std::size_t i = 1; i < values.size(); i++) {
+    BOOST_TEST(values[i] > values[i - 1]);
+  }
+
+  // Positions encoded in the stream count only what was received, so
+  // it can be read and sought as a log.
+  base::TemporaryFile copy;
+  tl::FileReader log{ToFile(copy, received)};
+  BOOST_TEST(ItemValue(&log, log.final_item()) == values.back());
+  for (const std::size_t i : {std::size_t(0), values.size() / 2,
+          values.size() - 1}) {
+    const auto seek = log.Seek(
+        kStart + boost::posix_time::milliseconds(10 * values[i]));
+    BOOST_TEST_REQUIRE(seek.size() == 1);
+    BOOST_TEST(ItemValue(&log, seek.begin()->second) == values[i]);
+  }
+
+  CheckPreviousOffsets(received, &log);
+}
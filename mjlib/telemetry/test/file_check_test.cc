@@ -0,0 +1,327 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mjlib/telemetry/file_check.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/temporary_file.h"
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/file_writer.h"
+
+using namespace mjlib;
+namespace tl = telemetry;
+
+namespace {
+const boost::posix_time::ptime kStart =
+    boost::posix_time::time_from_string("2020-03-10 00:00:00");
+
+void MakeLog(const std::string& filename) {
+  tl::FileWriter writer{filename};
+
+  const auto id1 = writer.AllocateIdentifier("test1");
+  const auto id2 = writer.AllocateIdentifier("test2");
+  writer.WriteSchema(id1, "\x0a");  // string
+  writer.WriteSchema(id2, "\x0a");  // string
+  for (int i = 0; i < 20; i++) {
+    const auto timestamp = kStart + boost::posix_time::seconds(i);
+    writer.WriteData(timestamp, id1, "id1: " + std::to_string(i));
+    writer.WriteData(timestamp, id2, "id2: " + std::to_string(i));
+  }
+}
+
+std::string ReadFile(const std::string& filename) {
+  std::ifstream inf(filename, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(inf), {});
+}
+
+void WriteFile(const std::string& filename, const std::string& contents) {
+  std::ofstream outf(filename, std::ios::binary);
+  outf.write(contents.data(), contents.size());
+}
+
+/// Return the offset of the block which contains @p target.
+std::size_t FindBlock(const std::string& contents, std::size_t target) {
+  const auto read_varuint = [&](std::size_t* position) {
+    uint64_t result = 0;
+    int shift = 0;
+    while (true) {
+      const auto byte = static_cast<uint8_t>(contents.at((*position)++));
+      result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) { return result; }
+      shift += 7;
+    }
+  };
+
+  std::size_t position = 9;
+  while (true) {
+    std::size_t next = position;
+    read_varuint(&next);
+    const auto size = read_varuint(&next);
+    next += size;
+    if (target < next) { return position; }
+    position = next;
+  }
+}
+
+std::vector<std::string> ReadItems(const std::string& filename) {
+  tl::FileReader reader{filename};
+  std::vector<std::string> result;
+  for (const auto& item : reader.items()) {
+    result.push_back(std::string(item.data.begin(), item.data.end()));
+  }
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(FileCheckClean) {
+  base::TemporaryFile log;
+  MakeLog(log.native());
+
+  base::TemporaryFile repaired;
+  tl::FileCheckOptions options;
+  options.repair_filename = repaired.native();
+  const auto result = tl::CheckFile(log.native(), options);
+
+  BOOST_TEST(result.ok());
+  BOOST_TEST(!result.truncated);
+  BOOST_TEST(result.schema_blocks == 2);
+  BOOST_TEST(result.data_blocks == 40);
+  BOOST_TEST(result.seek_markers > 10);
+  BOOST_TEST(result.index_blocks == 1);
+  BOOST_TEST(result.unchecked_data_blocks == 0);
+
+  // An undamaged log is reproduced exactly.
+  BOOST_TEST(ReadFile(repaired.native()) == ReadFile(log.native()));
+}
+
+BOOST_AUTO_TEST_CASE(FileCheckCorrupt) {
+  base::TemporaryFile log;
+  MakeLog(log.native());
+
+  const auto original = ReadItems(log.native());
+  BOOST_TEST_REQUIRE(original.size() == 40);
+
+  auto contents = ReadFile(log.native());
+  const auto position = contents.find("id1: 7");
+  BOOST_TEST_REQUIRE(position != std::string::npos);
+  contents[position] ^= 0x01;
+  WriteFile(log.native(), contents);
+
+  base::TemporaryFile repaired;
+  tl::FileCheckOptions options;
+  options.repair_filename = repaired.native();
+  const auto result = tl::CheckFile(log.native(), options);
+
+  BOOST_TEST_REQUIRE(result.damage.size() == 1);
+  const auto& damage = result.damage.front();
+  BOOST_TEST(damage.start < static_cast<int64_t>(position));
+  BOOST_TEST(damage.end > static_cast<int64_t>(position));
+  BOOST_TEST(damage.reason.find("checksum") != std::string::npos);
+  BOOST_TEST(!result.truncated);
+  BOOST_TEST(result.index_blocks == 1);
+
+  // Everything except the damaged region survives, and the repaired
+  // copy reads back cleanly.
+  const auto repaired_check = tl::CheckFile(repaired.native());
+  BOOST_TEST(repaired_check.ok());
+  // Seek markers on either side of the damage are retained.
+  BOOST_TEST(repaired_check.seek_markers == result.seek_markers);
+
+  const auto items = ReadItems(repaired.native());
+  BOOST_TEST(items.size() == result.data_blocks);
+  BOOST_TEST(items.size() < original.size());
+  BOOST_TEST(items.size() >= original.size() - 4);
+  for (const auto& item : items) {
+    BOOST_TEST(std::count(original.begin(), original.end(), item) == 1);
+  }
+  BOOST_TEST(std::count(items.begin(), items.end(), "id1: 7") == 0);
+  BOOST_TEST(items.back() == "id2: 19");
+
+  tl::FileReader reader{repaired.native()};
+  BOOST_TEST(reader.has_index());
+}
+
+BOOST_AUTO_TEST_CASE(FileCheckTruncated) {
+  base::TemporaryFile log;
+  MakeLog(log.native());
+
+  // Cut the file off partway through the final data block, which
+  // also loses the index.
+  auto contents = ReadFile(log.native());
+  const auto position = contents.find("id2: 19");
+  BOOST_TEST_REQUIRE(position != std::string::npos);
+  contents.resize(position + 3);
+  WriteFile(log.native(), contents);
+
+  base::TemporaryFile repaired;
+  tl::FileCheckOptions options;
+  options.repair_filename = repaired.native();
+  const auto result = tl::CheckFile(log.native(), options);
+
+  BOOST_TEST(result.truncated);
+  BOOST_TEST_REQUIRE(result.damage.size() == 1);
+  BOOST_TEST(result.damage.front().end ==
+             static_cast<int64_t>(contents.size()));
+  BOOST_TEST(result.data_blocks == 39);
+  BOOST_TEST(result.index_blocks == 0);
+
+  BOOST_TEST(tl::CheckFile(repaired.native()).ok());
+  const auto items = ReadItems(repaired.native());
+  BOOST_TEST(items.size() == 39);
+  BOOST_TEST(items.back() == "id1: 19");
+
+  tl::FileReader reader{repaired.native()};
+  BOOST_TEST(reader.has_index());
+}
+
+BOOST_AUTO_TEST_CASE(FileCheckInvalidHeader) {
+  base::TemporaryFile log;
+  MakeLog(log.native());
+
+  auto contents = ReadFile(log.native());
+  contents[2] = 'X';
+  WriteFile(log.native(), contents);
+
+  const auto result = tl::CheckFile(log.native());
+  BOOST_TEST_REQUIRE(result.damage.size() == 1);
+  BOOST_TEST(result.damage.front().start == 0);
+  BOOST_TEST(result.damage.front().reason == "invalid header");
+  // We still recover everything after the first seek marker.
+  BOOST_TEST(result.data_blocks > 30);
+}
+
+BOOST_AUTO_TEST_CASE(FileCheckInvalidSize) {
+  base::TemporaryFile log;
+  MakeLog(log.native());
+
+  // Replace the size of a block in the middle of the file with one
+  // that extends well past its end.
+  auto contents = ReadFile(log.native());
+  const auto position = contents.find("id1: 7");
+  BOOST_TEST_REQUIRE(position != std::string::npos);
+  const auto block = FindBlock(contents, position);
+  BOOST_TEST_REQUIRE(static_cast<uint8_t>(contents[block + 1]) < 0x80);
+  contents.replace(block + 1, 1, std::string("\xff\xff\xff\xff\x0f", 5));
+  WriteFile(log.native(), contents);
+
+  const auto result = tl::CheckFile(log.native());
+  BOOST_TEST(!result.truncated);
+  BOOST_TEST_REQUIRE(result.damage.size() == 1);
+  BOOST_TEST(result.damage.front().start == static_cast<int64_t>(block));
+  BOOST_TEST(result.damage.front().reason == "invalid block size");
+  BOOST_TEST(result.index_blocks == 1);
+}
+
+BOOST_AUTO_TEST_CASE(FileCheckSeekAfterDamage) {
+  base::TemporaryFile log;
+
+  // This is large enough that seeking makes use of the markers.
+  {
+    tl::FileWriter writer{log.native()};
+    const auto id = writer.AllocateIdentifier("test");
+    writer.WriteSchema(id, "\x0a");  // string
+    for (int i = 0; i < 2000; i++) {
+      writer.WriteData(kStart + boost::posix_time::seconds(i), id,
+                       "item " + std::to_string(i) + std::string(200, ' '));
+    }
+  }
+
+  auto contents = ReadFile(log.native());
+  const auto position = contents.find("item 10 ");
+  BOOST_TEST_REQUIRE(position != std::string::npos);
+  contents[position] ^= 0x01;
+  WriteFile(log.native(), contents);
+
+  base::TemporaryFile repaired;
+  tl::FileCheckOptions options;
+  options.repair_filename = repaired.native();
+  const auto result = tl::CheckFile(log.native(), options);
+  BOOST_TEST_REQUIRE(result.damage.size() == 1);
+  BOOST_TEST(tl::CheckFile(repaired.native()).seek_markers ==
+             result.seek_markers);
+
+  // Seeking relies upon the rewritten markers.
+  tl::FileReader reader{repaired.native()};
+  for (const int i : {5, 500, 1000, 1999}) {
+    BOOST_TEST_CONTEXT(i) {
+      const auto seek = reader.Seek(kStart + boost::posix_time::seconds(i));
+      BOOST_TEST_REQUIRE(seek.size() == 1);
+      tl::FileReader::ItemsOptions items_options;
+      items_options.start = seek.begin()->second;
+      const auto item = *reader.items(items_options).begin();
+      BOOST_TEST(item.data.substr(0, item.data.find(' ', 5)) ==
+                 "item " + std::to_string(i));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(FileCheckDamagedSchema) {
+  base::TemporaryFile log;
+
+  {
+    tl::FileWriter writer{log.native()};
+    const auto id1 = writer.AllocateIdentifier("test1");
+    const auto id2 = writer.AllocateIdentifier("test2");
+    writer.WriteSchema(id1, "\x0a");  // string
+    writer.WriteSchema(id2, "\x0a");  // string
+    for (int i = 0; i < 2000; i++) {
+      const auto timestamp = kStart + boost::posix_time::seconds(i);
+      writer.WriteData(timestamp, id1,
+                       "item " + std::to_string(i) + std::string(200, ' '));
+      writer.WriteData(timestamp, id2, "id2: " + std::to_string(i));
+    }
+  }
+
+  // Give the second schema an unknown flag, so that it is rejected.
+  auto contents = ReadFile(log.native());
+  const auto position = contents.find("test2");
+  BOOST_TEST_REQUIRE(position != std::string::npos);
+  const auto block = FindBlock(contents, position);
+  BOOST_TEST_REQUIRE(block + 5 == position);
+  contents[block + 3] = 0x01;
+  WriteFile(log.native(), contents);
+
+  base::TemporaryFile repaired;
+  tl::FileCheckOptions options;
+  options.repair_filename = repaired.native();
+  const auto result = tl::CheckFile(log.native(), options);
+  BOOST_TEST_REQUIRE(result.damage.size() == 1);
+  BOOST_TEST(result.damage.front().reason.find("schema") != std::string::npos);
+  BOOST_TEST(result.orphan_data_blocks > 0);
+
+  // The rewritten seek markers only refer to records which are
+  // still known.
+  tl::FileReader reader{repaired.native()};
+  BOOST_TEST(reader.record("test1") != nullptr);
+  BOOST_TEST(reader.record("test2") == nullptr);
+  for (const int i : {500, 1999}) {
+    BOOST_TEST_CONTEXT(i) {
+      const auto seek = reader.Seek(kStart + boost::posix_time::seconds(i));
+      BOOST_TEST_REQUIRE(seek.size() == 1);
+      BOOST_TEST(seek.begin()->first->name == "test1");
+      tl::FileReader::ItemsOptions items_options;
+      items_options.start = seek.begin()->second;
+      const auto item = *reader.items(items_options).begin();
+      BOOST_TEST(item.data.substr(0, item.data.find(' ', 5)) ==
+                 "item " + std::to_string(i));
+    }
+  }
+}
@@ -15,12 +15,14 @@
 #include "mjlib/telemetry/file_reader.h"
 
 #include <fstream>
+#include <iterator>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/test/auto_unit_test.hpp>
 
 #include "mjlib/base/temporary_file.h"
 #include "mjlib/base/system_error.h"
+#include "mjlib/telemetry/binary_write_archive.h"
 #include "mjlib/telemetry/error.h"
 #include "mjlib/telemetry/file_writer.h"
 
@@ -420,3 +422,492 @@ BOOST_AUTO_TEST_CASE(SeekTest) {
                      (*items.begin()).timestamp - query)) < 200.0);
   }
 }
+
+BOOST_AUTO_TEST_CASE(IndexCheckpointTest) {
+  base::TemporaryFile tempfile;
+
+  const boost::posix_time::ptime start =
+      boost::posix_time::time_from_string("2020-03-10 00:00:00");
+
+  {
+    telemetry::FileWriter::Options options;
+    options.index_block = false;
+    options.index_checkpoint_period_s = 1.0;
+    telemetry::FileWriter writer{tempfile.native(), options};
+
+    const auto id1 = writer.AllocateIdentifier("test1");
+    writer.WriteSchema(id1, "\x0a");  // string
+
+    for (int i = 0; i < 5; i++) {
+      writer.WriteData(start + boost::posix_time::seconds(i), id1,
+                       "id1: " + std::to_string(i));
+    }
+
+    // This record only appears after the most recent checkpoint.
+    const auto id2 = writer.AllocateIdentifier("test2");
+    writer.WriteSchema(id2, "\x0a");  // string
+    writer.WriteData(start + boost::posix_time::milliseconds(4500), id2,
+                     "id2: 0");
+  }
+
+  // Now corrupt the block immediately following the first schema so
+  // that a scan from the beginning of the log cannot succeed.
+  {
+    std::string contents;
+    {
+      std::ifstream inf(tempfile.native(), std::ios::binary);
+      contents.assign(std::istreambuf_iterator<char>(inf), {});
+    }
+    const auto schema_end = contents.find(std::string("test1\x0a"));
+    BOOST_TEST_REQUIRE(schema_end != std::string::npos);
+    contents[schema_end + 6] = 0x7f;
+
+    std::ofstream outf(tempfile.native(), std::ios::binary);
+    outf.write(contents.data(), contents.size());
+  }
+
+  DUT dut{tempfile.native()};
+  BOOST_TEST(!dut.has_index());
+  const auto records = dut.records();
+  BOOST_TEST(records.size() == 2);
+  BOOST_TEST(dut.record("test1") != nullptr);
+  BOOST_TEST(dut.record("test2") != nullptr);
+  BOOST_TEST(dut.checkpoint_stats().searches == 1);
+  BOOST_TEST(dut.checkpoint_stats().misses == 0);
+
+  auto items = dut.items(
+      [&]() {
+        DUT::ItemsOptions options;
+        options.start = dut.final_item();
+        return options;
+      }());
+  BOOST_TEST_REQUIRE((items.begin() != items.end()));
+  BOOST_TEST((*items.begin()).timestamp ==
+             start + boost::posix_time::milliseconds(4500));
+}
+
+BOOST_AUTO_TEST_CASE(IndexCheckpointFalseMatchTest) {
+  // A data record which happens to contain something that looks like
+  // an index checkpoint, whose second entry is invalid.
+  std::vector<uint8_t> log{
+    0x54, 0x4c, 0x4f, 0x47, 0x30, 0x30, 0x30, 0x33, 0x00,
+
+    // Schema block at 9
+    0x01, 0x09,
+    0x01, 0x00, 0x05, 't', 'e', 's', 't', '1', 0x0a,
+
+    // Data block at 20
+    0x02, 0x35,
+    0x01, 0x00, 0x32,
+
+    // The embedded index at 25
+    0x03, 0x30,
+    0x00, 0x02,
+    0x01,
+    0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x40, 0x42, 0x0f, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x02,
+    0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x32, 0x00, 0x00, 0x00,
+    'T', 'L', 'O', 'G', 'I', 'D', 'E', 'X',
+
+    // Data block at 75
+    0x02, 0x03,
+    0x01, 0x00, 0x00,
+  };
+  TemporaryContents contents{log};
+
+  DUT dut{contents.native()};
+  BOOST_TEST(!dut.has_index());
+  BOOST_TEST(dut.records().size() == 1);
+  BOOST_TEST(dut.record("test1") != nullptr);
+  // Nothing from the partially valid index should have been used.
+  BOOST_TEST(dut.final_item() == 75);
+  BOOST_TEST(dut.checkpoint_stats().searches == 1);
+  BOOST_TEST(dut.checkpoint_stats().misses == 1);
+}
+
+namespace {
+struct Motor {
+  double temperature = 0.0;
+  int32_t count = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(temperature));
+    a->Visit(MJ_NVP(count));
+  }
+};
+
+struct MotorState {
+  std::string name;
+  Motor motor;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(name));
+    a->Visit(MJ_NVP(motor));
+  }
+};
+}
+
+BOOST_AUTO_TEST_CASE(SummaryQueryTest) {
+  base::TemporaryFile tempfile;
+
+  const boost::posix_time::ptime start =
+      boost::posix_time::time_from_string("2020-03-10 00:00:00");
+
+  {
+    telemetry::FileWriter::Options options;
+    options.summary_block = true;
+    telemetry::FileWriter writer{tempfile.native(), options};
+
+    const auto id1 = writer.AllocateIdentifier("motor");
+    const auto id2 = writer.AllocateIdentifier("other");
+    writer.SetSummaryFields(id1, {"motor.temperature"});
+    writer.WriteSchema(
+        id1, telemetry::BinarySchemaArchive::Write<MotorState>());
+    writer.WriteSchema(id2, "\x0a");  // string
+
+    // The temperature spends a short time above 60 around the 50s
+    // mark and is otherwise cool.
+    MotorState state;
+    state.name = "m1";
+    for (int i = 0; i < 1000; i++) {
+      const auto timestamp = start + boost::posix_time::milliseconds(i * 100);
+      state.motor.temperature = (i >= 500 && i < 520) ? 70.0 : 30.0;
+      state.motor.count = i;
+      writer.WriteData(timestamp, id1,
+                       telemetry::BinaryWriteArchive::Write(state));
+      if ((i % 10) == 0) {
+        writer.WriteData(timestamp, id2, "other");
+      }
+    }
+  }
+
+  DUT dut{tempfile.native()};
+
+  {
+    DUT::QueryOptions options;
+    options.record = "motor";
+    options.field = "motor.temperature";
+    options.min = 60.0;
+    const auto result = dut.Query(options);
+    BOOST_TEST_REQUIRE(result.items.size() == 20);
+    BOOST_TEST(result.items.front().timestamp ==
+               start + boost::posix_time::seconds(50));
+    BOOST_TEST(result.items.back().timestamp ==
+               start + boost::posix_time::milliseconds(51900));
+    for (const auto& item : result.items) {
+      BOOST_TEST(item.record->name == "motor");
+    }
+
+    // The vast majority of the log should not have needed decoding.
+    BOOST_TEST(result.segments_scanned <= 4);
+    BOOST_TEST(result.segments_skipped >= 90);
+  }
+
+  {
+    // Time ranges can be used alone as well.
+    DUT::QueryOptions options;
+    options.record = "motor";
+    options.start = start + boost::posix_time::seconds(10);
+    options.end = start + boost::posix_time::milliseconds(10900);
+    const auto result = dut.Query(options);
+    BOOST_TEST(result.items.size() == 10);
+    BOOST_TEST(result.segments_skipped >= 90);
+  }
+
+  {
+    // Fields which were not summarized can still be queried, they
+    // just require everything to be decoded.
+    DUT::QueryOptions options;
+    options.record = "motor";
+    options.field = "motor.count";
+    options.min = 995;
+    const auto result = dut.Query(options);
+    BOOST_TEST(result.items.size() == 5);
+    BOOST_TEST(result.segments_skipped == 0);
+  }
+
+  {
+    DUT::QueryOptions options;
+    options.record = "nonexistent";
+    BOOST_TEST(dut.Query(options).items.empty());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(SummaryQueryNonMonotonicTest) {
+  base::TemporaryFile tempfile;
+
+  const boost::posix_time::ptime start =
+      boost::posix_time::time_from_string("2020-03-10 00:00:00");
+
+  {
+    telemetry::FileWriter::Options options;
+    options.summary_block = true;
+    telemetry::FileWriter writer{tempfile.native(), options};
+
+    const auto id1 = writer.AllocateIdentifier("test1");
+    writer.WriteSchema(id1, "\x0a");  // string
+
+    for (int i = 0; i < 100; i++) {
+      writer.WriteData(start + boost::posix_time::milliseconds(i * 100),
+                       id1, "id1");
+      if (i == 55) {
+        // The clock stepped backwards.
+        writer.WriteData(start + boost::posix_time::milliseconds(1050),
+                         id1, "stepped");
+      }
+    }
+  }
+
+  DUT dut{tempfile.native()};
+
+  DUT::QueryOptions options;
+  options.record = "test1";
+  options.start = start + boost::posix_time::milliseconds(1040);
+  options.end = start + boost::posix_time::milliseconds(1060);
+  const auto result = dut.Query(options);
+  BOOST_TEST_REQUIRE(result.items.size() == 1);
+  BOOST_TEST(result.items.front().data == "stepped");
+  BOOST_TEST(result.segments_skipped > 0);
+
+  // ReadRaw finds the same items.
+  DUT::RawOptions raw_options;
+  raw_options.record = "test1";
+  raw_options.start = options.start;
+  raw_options.end = options.end;
+  std::vector<std::string> raw;
+  dut.ReadRaw(raw_options, [&](int64_t, std::string_view data) {
+      raw.push_back(std::string(data));
+    });
+  BOOST_TEST(raw == std::vector<std::string>({"stepped"}),
+             boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(BlockCacheTest) {
+  base::TemporaryFile tempfile;
+
+  const boost::posix_time::ptime start =
+      boost::posix_time::time_from_string("2020-03-10 00:00:00");
+
+  {
+    telemetry::FileWriter writer{tempfile.native()};
+    const auto id1 = writer.AllocateIdentifier("test1");
+    writer.WriteSchema(id1, "\x0a");  // string
+    for (int i = 0; i < 100; i++) {
+      writer.WriteData(start + boost::posix_time::seconds(i), id1,
+                       "id1: " + std::to_string(i) + std::string(1000, 'x'));
+    }
+  }
+
+  const auto read_all = [](DUT& dut) {
+    std::vector<DUT::Item> result;
+    for (const auto& item : dut.items()) {
+      result.push_back(item);
+    }
+    return result;
+  };
+
+  {
+    DUT::Options options;
+    options.cache_size = 1 << 20;
+    options.prefetch_size = 1 << 16;
+    DUT dut{tempfile.native(), options};
+
+    const auto first = read_all(dut);
+    BOOST_TEST_REQUIRE(first.size() == 100);
+    BOOST_TEST(dut.cache_stats().hits == 0);
+    BOOST_TEST(dut.cache_stats().misses == 100);
+    BOOST_TEST(dut.cache_stats().size > 100000);
+    BOOST_TEST(dut.cache_stats().prefetches > 0);
+
+    // Scrubbing back over the same items only hits the cache.
+    const auto second = read_all(dut);
+    BOOST_TEST_REQUIRE(second.size() == 100);
+    for (size_t i = 0; i < first.size(); i++) {
+      BOOST_TEST(first[i].data == second[i].data);
+      BOOST_TEST(first[i].timestamp == second[i].timestamp);
+      BOOST_TEST(first[i].index == second[i].index);
+    }
+    BOOST_TEST(dut.cache_stats().hits == 100);
+    BOOST_TEST(dut.cache_stats().misses == 100);
+    BOOST_TEST(dut.cache_stats().evictions == 0);
+  }
+
+  {
+    // With a small budget, older entries are evicted.
+    DUT::Options options;
+    options.cache_size = 20000;
+    DUT dut{tempfile.native(), options};
+
+    read_all(dut);
+    read_all(dut);
+    const auto stats = dut.cache_stats();
+    BOOST_TEST(stats.misses == 200);
+    BOOST_TEST(stats.evictions > 150);
+    BOOST_TEST(stats.size <= 20000);
+    BOOST_TEST(stats.prefetches == 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(JoinTest) {
+  base::TemporaryFile tempfile;
+
+  const boost::posix_time::ptime start =
+      boost::posix_time::time_from_string("2020-03-10 00:00:00");
+  const auto ms = [&](int value) {
+    return start + boost::posix_time::milliseconds(value);
+  };
+
+  {
+    telemetry::FileWriter writer{tempfile.native()};
+    const auto servo = writer.AllocateIdentifier("servo");
+    const auto imu = writer.AllocateIdentifier("imu");
+    const auto control = writer.AllocateIdentifier("control");
+    const auto unrelated = writer.AllocateIdentifier("unrelated");
+    for (auto id : {servo, imu, control, unrelated}) {
+      writer.WriteSchema(id, "\x0a");  // string
+    }
+
+    for (int i = 0; i < 100; i++) {
+      if ((i % 3) == 0) {
+        writer.WriteData(ms(i), imu, "imu " + std::to_string(i));
+      }
+      if ((i % 7) == 5) {
+        writer.WriteData(ms(i), control, "control " + std::to_string(i));
+      }
+      if ((i % 10) == 0) {
+        writer.WriteData(ms(i), servo, "servo " + std::to_string(i));
+      }
+      writer.WriteData(ms(i), unrelated, "unrelated");
+    }
+  }
+
+  // The expected timestamp of the most recent item at or before 't'
+  // for something with the given period and offset.
+  const auto previous = [&](int t, int period, int offset) {
+    const int result = ((t - offset) / period) * period + offset;
+    return (t < offset) ? -1 : result;
+  };
+  const auto next = [&](int t, int period, int offset) {
+    const int result = previous(t, period, offset) + period;
+    return (t < offset) ? offset : result;
+  };
+
+  for (const bool include_next : {false, true}) {
+    BOOST_TEST_CONTEXT("include_next " << include_next) {
+      DUT dut{tempfile.native()};
+
+      DUT::JoinOptions options;
+      options.driver = "servo";
+      options.records = {"imu", "control", "nonexistent"};
+      options.include_next = include_next;
+
+      int count = 0;
+      for (const auto& joined : dut.join(options)) {
+        const int t = count * 10;
+        BOOST_TEST_CONTEXT("t=" << t) {
+          BOOST_TEST(joined.driver.record->name == "servo");
+          BOOST_TEST(joined.driver.timestamp == ms(t));
+          BOOST_TEST_REQUIRE(joined.previous.size() == 3);
+
+          BOOST_TEST_REQUIRE(!!joined.previous[0]);
+          BOOST_TEST(joined.previous[0]->record->name == "imu");
+          BOOST_TEST(joined.previous[0]->timestamp == ms(previous(t, 3, 0)));
+
+          const int expected_control = previous(t, 7, 5);
+          if (expected_control < 0) {
+            BOOST_TEST(!joined.previous[1]);
+          } else {
+            BOOST_TEST_REQUIRE(!!joined.previous[1]);
+            BOOST_TEST(joined.previous[1]->timestamp == ms(expected_control));
+          }
+
+          BOOST_TEST(!joined.previous[2]);
+
+          if (!include_next) {
+            BOOST_TEST(joined.next.empty());
+          } else {
+            BOOST_TEST_REQUIRE(joined.next.size() == 3);
+            BOOST_TEST_REQUIRE(!!joined.next[0]);
+            BOOST_TEST(joined.next[0]->timestamp == ms(next(t, 3, 0)));
+            const int expected_next_control = next(t, 7, 5);
+            if (expected_next_control >= 100) {
+              BOOST_TEST(!joined.next[1]);
+            } else {
+              BOOST_TEST_REQUIRE(!!joined.next[1]);
+              BOOST_TEST(joined.next[1]->timestamp ==
+                         ms(expected_next_control));
+            }
+            BOOST_TEST(!joined.next[2]);
+          }
+        }
+        count++;
+      }
+      BOOST_TEST(count == 10);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(JoinTimestampTest) {
+  base::TemporaryFile tempfile;
+
+  const boost::posix_time::ptime start =
+      boost::posix_time::time_from_string("2020-03-10 00:00:00");
+  const auto ms = [&](int value) {
+    return start + boost::posix_time::milliseconds(value);
+  };
+
+  {
+    telemetry::FileWriter writer{tempfile.native()};
+    const auto servo = writer.AllocateIdentifier("servo");
+    const auto imu = writer.AllocateIdentifier("imu");
+    const auto control = writer.AllocateIdentifier("control");
+    for (auto id : {servo, imu, control}) {
+      writer.WriteSchema(id, "\x0a");  // string
+    }
+
+    // Items are not written in timestamp order across records.
+    writer.WriteData(ms(3), control, "control 3");
+    writer.WriteData(ms(5), imu, "imu 5");
+    writer.WriteData(ms(20), control, "control 20");
+    writer.WriteData(ms(10), servo, "servo 10");
+    writer.WriteData(ms(8), imu, "imu 8");
+    writer.WriteData(ms(15), imu, "imu 15");
+    writer.WriteData(ms(30), control, "control 30");
+  }
+
+  for (const bool include_next : {false, true}) {
+    BOOST_TEST_CONTEXT("include_next " << include_next) {
+      DUT dut{tempfile.native()};
+
+      DUT::JoinOptions options;
+      options.driver = "servo";
+      options.records = {"imu", "control"};
+      options.include_next = include_next;
+
+      int count = 0;
+      for (const auto& joined : dut.join(options)) {
+        BOOST_TEST(joined.driver.timestamp == ms(10));
+        BOOST_TEST_REQUIRE(joined.previous.size() == 2);
+        BOOST_TEST_REQUIRE(!!joined.previous[0]);
+        BOOST_TEST(joined.previous[0]->data == "imu 8");
+        BOOST_TEST_REQUIRE(!!joined.previous[1]);
+        BOOST_TEST(joined.previous[1]->data == "control 3");
+
+        if (include_next) {
+          BOOST_TEST_REQUIRE(joined.next.size() == 2);
+          BOOST_TEST_REQUIRE(!!joined.next[0]);
+          BOOST_TEST(joined.next[0]->data == "imu 15");
+          BOOST_TEST_REQUIRE(!!joined.next[1]);
+          BOOST_TEST(joined.next[1]->data == "control 20");
+        }
+        count++;
+      }
+      BOOST_TEST(count == 1);
+    }
+  }
+}
@@ -14,8 +14,11 @@
 
 #include "mjlib/telemetry/file_writer.h"
 
+#include <fstream>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <fmt/format.h>
 
@@ -23,6 +26,10 @@
 #include <boost/test/auto_unit_test.hpp>
 
 #include "mjlib/base/temporary_file.h"
+#include "mjlib/base/test/all_types_struct.h"
+
+#include "mjlib/telemetry/binary_write_archive.h"
+#include "mjlib/telemetry/file_reader.h"
 
 using mjlib::telemetry::FileWriter;
 
@@ -357,3 +364,372 @@ BOOST_AUTO_TEST_CASE(FileWriterSeek) {
   const auto contents = Contents(temp.native());
   BOOST_TEST(contents == expected);
 }
+
+BOOST_AUTO_TEST_CASE(FileWriterRecordWriter) {
+  // A RecordWriter should produce exactly the same file as the
+  // identifier based API.
+  mjlib::base::TemporaryFile expected_file;
+  mjlib::base::TemporaryFile actual_file;
+
+  using mjlib::base::test::AllTypesTest;
+  namespace tl = mjlib::telemetry;
+
+  AllTypesTest value;
+  const auto timestamp1 = MakeTimestamp("2020-03-10 00:00:00");
+  const auto timestamp2 = MakeTimestamp("2020-03-10 00:00:01");
+
+  {
+    FileWriter dut{expected_file.native()};
+    const auto id = dut.AllocateIdentifier("test");
+    dut.WriteSchema(id, tl::BinarySchemaArchive::Write<AllTypesTest>());
+    dut.WriteData(timestamp1, id, tl::BinaryWriteArchive::Write(value));
+    value.value_u32 = 1234;
+    dut.WriteData(timestamp2, id, tl::BinaryWriteArchive::Write(value));
+  }
+
+  value = {};
+
+  {
+    FileWriter dut{actual_file.native()};
+    auto writer = dut.MakeRecordWriter<AllTypesTest>("test");
+    // A second writer for the same record shares its identifier and
+    // does not emit a second schema.
+    FileWriter::RecordWriter<AllTypesTest> writer2(&dut, "test");
+    writer.Write(timestamp1, value);
+    value.value_u32 = 1234;
+    writer2.Write(timestamp2, value);
+  }
+
+  BOOST_TEST(Contents(actual_file.native()) ==
+             Contents(expected_file.native()));
+}
+
+BOOST_AUTO_TEST_CASE(FileWriterIntegerTimestamps) {
+  // The integer timestamp APIs should produce the same file as the
+  // ptime ones, including seek markers.
+  mjlib::base::TemporaryFile expected_file;
+  mjlib::base::TemporaryFile actual_file;
+
+  FileWriter::Options options;
+  options.default_compression = false;
+
+  const auto t0 = MakeTimestamp("2020-03-10 00:00:00");
+  const auto t1 = MakeTimestamp("2020-03-10 00:00:01");
+  const auto t2 = MakeTimestamp("2020-03-10 00:00:02");
+
+  {
+    FileWriter dut{expected_file.native(), options};
+    const auto id = dut.AllocateIdentifier("test");
+    dut.WriteSchema(id, "testschema");
+    dut.WriteData(t0, id, "testdata");
+    dut.WriteData(t1, id, "testdata2");
+    dut.WriteData(t2, id, "testdata3");
+  }
+
+  {
+    using mjlib::base::ConvertPtimeToEpochMicroseconds;
+    FileWriter dut{actual_file.native(), options};
+    const auto id = dut.AllocateIdentifier("test");
+    dut.WriteSchema(id, "testschema");
+    dut.WriteData(ConvertPtimeToEpochMicroseconds(t0), id, "testdata");
+    dut.WriteData(ConvertPtimeToEpochMicroseconds(t1), id, "testdata2");
+    dut.WriteData(ConvertPtimeToEpochMicroseconds(t2), id, "testdata3");
+  }
+
+  BOOST_TEST(Contents(actual_file.native()) ==
+             Contents(expected_file.native()));
+}
+
+BOOST_AUTO_TEST_CASE(FileWriterClockSource) {
+  FileWriter::Options options;
+  options.clock_source = mjlib::base::EpochClock::kMonotonic;
+  FileWriter dut{options};
+
+  const auto now = mjlib::base::ConvertPtimeToEpochMicroseconds(
+      boost::posix_time::microsec_clock::universal_time());
+  BOOST_TEST(std::abs(dut.now_us() - now) < 1000000);
+}
+
+namespace {
+void WriteSampled(const std::string& filename,
+                  const FileWriter::SamplingPolicy& policy,
+                  const std::vector<int>& to_write,
+                  std::optional<int> burst_at = {}) {
+  FileWriter::Options options;
+  options.default_compression = false;
+  options.seek_block_period_s = 0.0;
+  FileWriter dut{filename, options};
+  const auto id = dut.AllocateIdentifier("test");
+  dut.WriteSchema(id, "testschema");
+  dut.SetSamplingPolicy(id, policy);
+
+  const auto start = MakeTimestamp("2020-03-10 00:00:00");
+  for (int i : to_write) {
+    const auto timestamp = start + boost::posix_time::milliseconds(i);
+    if (burst_at && *burst_at == i) { dut.TriggerBurst(timestamp); }
+    // Every pair of records has the same contents.
+    dut.WriteData(timestamp, id, fmt::format("data{}", i / 2));
+  }
+}
+
+std::string ExpectedSampled(const std::vector<int>& to_write) {
+  mjlib::base::TemporaryFile temp;
+  WriteSampled(temp.native(), {}, to_write);
+  return Contents(temp.native());
+}
+
+std::string ActualSampled(const FileWriter::SamplingPolicy& policy,
+                          std::optional<int> burst_at = {}) {
+  mjlib::base::TemporaryFile temp;
+  std::vector<int> all;
+  for (int i = 0; i < 20; i++) { all.push_back(i); }
+  WriteSampled(temp.native(), policy, all, burst_at);
+  return Contents(temp.native());
+}
+}
+
+BOOST_AUTO_TEST_CASE(FileWriterSampling) {
+  {
+    FileWriter::SamplingPolicy policy;
+    policy.decimation = 5;
+    BOOST_TEST(ActualSampled(policy) == ExpectedSampled({0, 5, 10, 15}));
+  }
+
+  {
+    FileWriter::SamplingPolicy policy;
+    policy.max_rate_hz = 250.0;  // every 4ms
+    BOOST_TEST(ActualSampled(policy) == ExpectedSampled({0, 4, 8, 12, 16}));
+  }
+
+  {
+    FileWriter::SamplingPolicy policy;
+    policy.on_change = true;
+    BOOST_TEST(ActualSampled(policy) ==
+               ExpectedSampled({0, 2, 4, 6, 8, 10, 12, 14, 16, 18}));
+  }
+
+  {
+    FileWriter::SamplingPolicy policy;
+    policy.decimation = 10;
+    policy.burst_duration_s = 0.003;
+    BOOST_TEST(ActualSampled(policy, 13) ==
+               ExpectedSampled({0, 10, 13, 14, 15}));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(FileWriterRing) {
+  const boost::posix_time::ptime start =
+      boost::posix_time::time_from_string("2020-03-10 00:00:00");
+
+  FileWriter::Options options;
+  options.ring_size = 4096;
+  options.default_compression = false;
+  FileWriter dut{options};
+  BOOST_TEST(dut.IsOpen());
+
+  const auto id1 = dut.AllocateIdentifier("test1");
+  const auto id2 = dut.AllocateIdentifier("test2");
+  dut.WriteSchema(id1, "\x0a");  // string
+  dut.WriteSchema(id2, "\x0a");  // string
+
+  // Nothing has been discarded yet, so everything is present.
+  for (int i = 0; i < 10; i++) {
+    dut.WriteData(start + boost::posix_time::milliseconds(100 * i), id1,
+                  fmt::format("id1: {:04d}", i));
+  }
+
+  mjlib::base::TemporaryFile early;
+  dut.Dump(early.native()).get();
+  {
+    mjlib::telemetry::FileReader reader{early.native()};
+    BOOST_TEST(reader.has_index());
+    int count = 0;
+    for (const auto& item : reader.items()) {
+      BOOST_TEST(item.record->name == "test1");
+      count++;
+    }
+    BOOST_TEST(count == 10);
+  }
+
+  // Write much more than the ring can hold.
+  for (int i = 10; i < 1000; i++) {
+    const auto timestamp = start + boost::posix_time::milliseconds(100 * i);
+    dut.WriteData(timestamp, id1, fmt::format("id1: {:04d}", i));
+    if (i % 10 == 0) {
+      dut.WriteData(timestamp, id2, fmt::format("id2: {:04d}", i));
+    }
+  }
+
+  mjlib::base::TemporaryFile late;
+  auto future = dut.Dump(late.native());
+  // Writing may continue while the dump is in progress.
+  dut.WriteData(start + boost::posix_time::seconds(100), id1, "id1: 1000");
+  future.get();
+
+  mjlib::telemetry::FileReader reader{late.native()};
+  BOOST_TEST(reader.has_index());
+  BOOST_TEST(reader.record("test1") != nullptr);
+  BOOST_TEST(reader.record("test2") != nullptr);
+
+  std::vector<int> values;
+  boost::posix_time::ptime first_timestamp;
+  for (const auto& item : reader.items()) {
+    if (item.record->name != "test1") { continue; }
+    if (values.empty()) { first_timestamp = item.timestamp; }
+    values.push_back(std::stoi(
+                         std::string(item.data.begin() + 5, item.data.end())));
+  }
+
+  // Only a suffix was retained, beginning at a seek point, and with
+  // no gaps.
+  BOOST_TEST_REQUIRE(values.size() > 10);
+  BOOST_TEST(values.size() < 200);
+  BOOST_TEST(values.back() == 999);
+  for (std::size_t i = 1; i < values.size(); i++) {
+    BOOST_TEST(values[i] == values[i - 1] + 1);
+  }
+  BOOST_TEST(first_timestamp ==
+             start + boost::posix_time::milliseconds(100 * values.front()));
+
+  // And seeking works within it.
+  const auto seek = reader.Seek(
+      start + boost::posix_time::milliseconds(100 * (values.back() - 5)));
+  BOOST_TEST(seek.count(reader.record("test1")) == 1);
+}
+
+BOOST_AUTO_TEST_CASE(FileWriterRingSizeSegments) {
+  const boost::posix_time::ptime start =
+      boost::posix_time::time_from_string("2020-03-10 00:00:00");
+
+  // Seek points are far enough apart that segments are also started
+  // because of their size, and the oldest retained one usually does
+  // not begin at a seek point.
+  for (const int64_t ring_size : {4096, 6144, 8192, 12288}) {
+    BOOST_TEST_CONTEXT(ring_size) {
+      FileWriter::Options options;
+      options.ring_size = ring_size;
+      options.default_compression = false;
+      options.summary_block = true;
+      FileWriter dut{options};
+
+      const auto id = dut.AllocateIdentifier("test");
+      dut.WriteSchema(id, "\x0a");  // string
+      for (int i = 0; i < 2000; i++) {
+        dut.WriteData(start + boost::posix_time::milliseconds(10 * i), id,
+                      fmt::format("item: {:05d}", i));
+      }
+
+      mjlib::base::TemporaryFile dump;
+      dut.Dump(dump.native()).get();
+
+      mjlib::telemetry::FileReader reader{dump.native()};
+      std::vector<int> values;
+      for (const auto& item : reader.items()) {
+        values.push_back(std::stoi(
+                             std::string(item.data.begin() + 6,
+                                         item.data.end())));
+      }
+
+      // The dump still begins just after a seek point, which are
+      // made once per second.
+      BOOST_TEST_REQUIRE(values.size() > 10);
+      BOOST_TEST(values.front() % 100 == 1);
+      BOOST_TEST(values.back() == 1999);
+
+      // A summary is written at each seek point, describing the items
+      // since the previous one.  The one which describes data before
+      // the dump is omitted, so the remainder count exactly those up
+      // to the last seek point.
+      BOOST_TEST(reader.count_hint("test") == 1900 - values.front() + 1);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(FileWriterRingNoTimestamps) {
+  // Without timestamps there are no seek points, but the ring must
+  // still remain bounded.
+  FileWriter::Options options;
+  options.ring_size = 4096;
+  options.default_compression = false;
+  FileWriter dut{options};
+
+  const auto id = dut.AllocateIdentifier("test");
+  dut.WriteSchema(id, "\x0a");  // string
+  for (int i = 0; i < 20000; i++) {
+    dut.WriteData({}, id, fmt::format("item: {:05d}", i));
+  }
+
+  mjlib::base::TemporaryFile dump;
+  dut.Dump(dump.native()).get();
+  std::ifstream inf(dump.native(), std::ios::binary | std::ios::ate);
+  BOOST_TEST(inf.tellg() < 2 * 4096);
+
+  mjlib::telemetry::FileReader reader{dump.native()};
+  BOOST_TEST(reader.has_index());
+  std::vector<int> values;
+  for (const auto& item : reader.items()) {
+    values.push_back(std::stoi(
+                         std::string(item.data.begin() + 6, item.data.end())));
+  }
+
+  BOOST_TEST_REQUIRE(values.size() > 50);
+  BOOST_TEST(values.back() == 19999);
+  for (std::size_t i = 1; i < values.size(); i++) {
+    BOOST_TEST(values[i] == values[i - 1] + 1);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(FileWriterBufferPool) {
+  mjlib::telemetry::MemorySink sink;
+  FileWriter::Options options;
+  options.buffer_pool_size = 4;
+  FileWriter dut{options};
+  dut.AddSink(&sink);
+
+  const auto initial = dut.buffer_pool_stats();
+
+  std::vector<FileWriter::Buffer> buffers;
+  for (int i = 0; i < 6; i++) { buffers.push_back(dut.GetBuffer()); }
+  {
+    const auto stats = dut.buffer_pool_stats();
+    BOOST_TEST(stats.misses - initial.misses == 6);
+    BOOST_TEST(stats.high_water == 6);
+  }
+
+  // Writing returns each buffer, but only 4 can be retained.
+  for (auto& buffer : buffers) {
+    buffer->write("abc");
+    dut.WriteBlock(mjlib::telemetry::Format::BlockType::kSummary,
+                   std::move(buffer));
+  }
+  buffers.clear();
+  {
+    const auto stats = dut.buffer_pool_stats();
+    BOOST_TEST(stats.discards == 2);
+  }
+
+  for (int i = 0; i < 4; i++) { buffers.push_back(dut.GetBuffer()); }
+  {
+    const auto stats = dut.buffer_pool_stats();
+    BOOST_TEST(stats.hits - initial.hits == 4);
+    BOOST_TEST(stats.misses - initial.misses == 6);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(FileWriterBufferPoolThreaded) {
+  // Here buffers are returned from the writer's background thread
+  // while the producer is taking them.
+  mjlib::base::TemporaryFile temp;
+  FileWriter dut{temp.native()};
+  const auto id = dut.AllocateIdentifier("test");
+  dut.WriteSchema(id, "\x0a");  // string
+  for (int i = 0; i < 20000; i++) {
+    dut.WriteData({}, id, fmt::format("value {}", i));
+  }
+  dut.Close();
+
+  const auto stats = dut.buffer_pool_stats();
+  BOOST_TEST(stats.hits > 0);
+  BOOST_TEST(stats.hits + stats.misses >= 20000);
+  BOOST_TEST(stats.high_water > 0);
+}
@@ -253,3 +253,81 @@ BOOST_AUTO_TEST_CASE(ParseExternalSerializer) {
     BOOST_TEST(copy.baz == 23);
   }
 }
+
+namespace {
+struct PlanSource {
+  int32_t a = 1;
+  int32_t b = 2;
+  std::string dropped = "dropped";
+  int16_t also_dropped = 3;
+  std::array<float, 3> vec = {{4.0f, 5.0f, 6.0f}};
+  base::test::SubTest1 nested{7};
+  std::vector<int32_t> list = {8, 9};
+  int32_t c = 10;
+
+  template <typename Archive>
+  void Serialize(Archive* a_) {
+    a_->Visit(MJ_NVP(a));
+    a_->Visit(MJ_NVP(b));
+    a_->Visit(MJ_NVP(dropped));
+    a_->Visit(MJ_NVP(also_dropped));
+    a_->Visit(MJ_NVP(vec));
+    a_->Visit(MJ_NVP(nested));
+    a_->Visit(MJ_NVP(list));
+    a_->Visit(MJ_NVP(c));
+  }
+};
+
+struct PlanDest {
+  int32_t a = 0;
+  int32_t b = 0;
+  std::array<float, 3> vec = {};
+  base::test::SubTest1 nested{0};
+  int32_t c = 0;
+  std::vector<int32_t> list;
+  int32_t missing = 11;
+
+  template <typename Archive>
+  void Serialize(Archive* a_) {
+    a_->Visit(MJ_NVP(a));
+    a_->Visit(MJ_NVP(b));
+    a_->Visit(MJ_NVP(vec));
+    a_->Visit(MJ_NVP(nested));
+    a_->Visit(MJ_NVP(c));
+    a_->Visit(MJ_NVP(list));
+    a_->Visit(MJ_NVP(missing));
+  }
+};
+}
+
+BOOST_AUTO_TEST_CASE(PlanEvolution) {
+  tl::BinarySchemaParser parser(tl::BinarySchemaArchive::Write<PlanSource>());
+  tl::MappedBinaryReader<PlanDest> dut{&parser};
+  const auto data = tl::BinaryWriteArchive::Write(PlanSource());
+
+  auto check = [](const PlanDest& dest) {
+    BOOST_TEST(dest.a == 1);
+    BOOST_TEST(dest.b == 2);
+    BOOST_TEST(dest.vec[0] == 4.0f);
+    BOOST_TEST(dest.vec[1] == 5.0f);
+    BOOST_TEST(dest.vec[2] == 6.0f);
+    BOOST_TEST(dest.nested.value_u32 == 7);
+    BOOST_TEST(dest.list.size() == 2);
+    BOOST_TEST(dest.c == 10);
+    BOOST_TEST(dest.missing == 11);
+  };
+
+  check(dut.Read(data));
+
+  {
+    // The generic stream path should give the same answer, and
+    // consume exactly the record.
+    const std::string with_trailer = data + "x";
+    base::BufferReadStream buffer_stream{with_trailer};
+    base::ReadStream& stream = buffer_stream;
+    PlanDest dest;
+    dut.Read(&dest, stream);
+    check(dest);
+    BOOST_TEST(buffer_stream.remaining() == 1);
+  }
+}
@@ -0,0 +1,88 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/numeric_field.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/system_error.h"
+#include "mjlib/base/test/all_types_struct.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+#include "mjlib/telemetry/error.h"
+
+using namespace mjlib;
+namespace tl = telemetry;
+
+BOOST_AUTO_TEST_CASE(NumericFieldBasic) {
+  tl::BinarySchemaParser parser(
+      tl::BinarySchemaArchive::Write<base::test::AllTypesTest>());
+
+  base::test::AllTypesTest value;
+  value.value_bool = true;
+  value.value_i16 = -1234;
+  value.value_f64 = 2.5;
+  value.value_str = "a longer string";
+  value.value_object.value_u32 = 87;
+  value.value_enum = base::test::TestEnumeration::kAnotherValue;
+  const auto data = tl::BinaryWriteArchive::Write(value);
+
+  struct Test {
+    std::string path;
+    double expected;
+  };
+
+  const Test tests[] = {
+    // These all have a fixed offset.
+    { "value_bool", 1.0 },
+    { "value_i16", -1234.0 },
+    { "value_u64", 8.0 },
+    { "value_f32", 9.0 },
+    { "value_f64", 2.5 },
+
+    // While these must skip over variable length fields.
+    { "value_object.value_u32", 87.0 },
+    { "value_enum", 20.0 },
+    { "value_timestamp", 1000000.0 },
+    { "value_duration", 500000.0 },
+  };
+
+  for (const auto& test : tests) {
+    BOOST_TEST_CONTEXT(test.path) {
+      tl::NumericField dut(parser, test.path);
+      BOOST_TEST(dut.path() == test.path);
+      BOOST_TEST(dut.Read(data) == test.expected);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(NumericFieldErrors) {
+  tl::BinarySchemaParser parser(
+      tl::BinarySchemaArchive::Write<base::test::AllTypesTest>());
+
+  const auto check = [&](const std::string& path, tl::errc expected) {
+    BOOST_TEST_CONTEXT(path) {
+      BOOST_CHECK_EXCEPTION(
+          tl::NumericField(parser, path),
+          base::system_error,
+          [&](const auto& e) { return e.code() == expected; });
+    }
+  };
+
+  check("not_present", tl::errc::kUnknownField);
+  check("value_object.not_present", tl::errc::kUnknownField);
+  check("value_i8.value", tl::errc::kUnknownField);
+  check("value_str", tl::errc::kTypeMismatch);
+  check("value_object", tl::errc::kTypeMismatch);
+  check("value_optional", tl::errc::kTypeMismatch);
+}
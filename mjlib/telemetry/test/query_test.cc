@@ -0,0 +1,203 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mjlib/telemetry/query.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/system_error.h"
+#include "mjlib/base/temporary_file.h"
+#include "mjlib/base/test/all_types_struct.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+#include "mjlib/telemetry/error.h"
+#include "mjlib/telemetry/file_writer.h"
+
+using namespace mjlib;
+namespace tl = telemetry;
+namespace pt = boost::posix_time;
+
+BOOST_AUTO_TEST_CASE(QueryExpressionBasic) {
+  tl::BinarySchemaParser parser(
+      tl::BinarySchemaArchive::Write<base::test::AllTypesTest>());
+
+  base::test::AllTypesTest value;
+  value.value_bool = true;
+  value.value_i16 = -1234;
+  value.value_f64 = 2.5;
+  value.value_object.value_u32 = 87;
+  const auto data = tl::BinaryWriteArchive::Write(value);
+
+  struct Test {
+    std::string expression;
+    double expected;
+  };
+
+  const Test tests[] = {
+    { "3", 3.0 },
+    { " value_f64 ", 2.5 },
+    { "value_f64 * 2 + 1", 6.0 },
+    { "1 + value_f64 * 2", 6.0 },
+    { "(1 + value_f64) * 2", 7.0 },
+    { "10 - 4 - 3", 3.0 },
+    { "-value_i16 / 2", 617.0 },
+    { "abs(value_i16)", 1234.0 },
+    { "min(value_f64, value_f32) + max(1, 2)", 4.5 },
+    { "value_object.value_u32 > 80", 1.0 },
+    { "value_object.value_u32 >= 88", 0.0 },
+    { "value_i16 < 0 && value_bool", 1.0 },
+    { "value_i16 <= -1235 || value_f64 == 2.5", 1.0 },
+    { "1 < 2 == 1", 1.0 },
+    { "!value_bool", 0.0 },
+    { "!(value_u8 != 5)", 1.0 },
+    { "value_f64 - -1.5e1", 17.5 },
+  };
+
+  for (const auto& test : tests) {
+    BOOST_TEST_CONTEXT(test.expression) {
+      tl::QueryExpression dut(parser, test.expression);
+      BOOST_TEST(dut.Evaluate(data) == test.expected);
+      BOOST_TEST(dut.Matches(data) == (test.expected != 0.0));
+    }
+  }
+
+  // Each field is resolved only once.
+  tl::QueryExpression dut(parser, "value_f64 > 1 && value_f64 < value_u8");
+  BOOST_TEST(dut.fields().size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(QueryExpressionErrors) {
+  tl::BinarySchemaParser parser(
+      tl::BinarySchemaArchive::Write<base::test::AllTypesTest>());
+
+  const auto check = [&](const std::string& expression, tl::errc expected) {
+    BOOST_TEST_CONTEXT(expression) {
+      BOOST_CHECK_EXCEPTION(
+          tl::QueryExpression(parser, expression),
+          base::system_error,
+          [&](const auto& e) { return e.code() == expected; });
+    }
+  };
+
+  check("", tl::errc::kInvalidExpression);
+  check("1 +", tl::errc::kInvalidExpression);
+  check("(1 + 2", tl::errc::kInvalidExpression);
+  check("1 2", tl::errc::kInvalidExpression);
+  check("sqrt(4)", tl::errc::kInvalidExpression);
+  check("min(1)", tl::errc::kInvalidExpression);
+  check("value_i8 = 1", tl::errc::kInvalidExpression);
+  check("not_a_field > 1", tl::errc::kUnknownField);
+  check("value_str > 1", tl::errc::kTypeMismatch);
+}
+
+namespace {
+struct Sample {
+  int32_t sequence = 0;
+  double temperature = 0.0;
+  bool fault = false;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(sequence));
+    a->Visit(MJ_NVP(temperature));
+    a->Visit(MJ_NVP(fault));
+  }
+};
+
+const pt::ptime kStart = pt::time_from_string("2023-01-02 03:00:00");
+}
+
+BOOST_AUTO_TEST_CASE(QueryLog) {
+  base::TemporaryFile tempfile;
+
+  {
+    tl::FileWriter writer{tempfile.native()};
+    const auto id = writer.AllocateIdentifier("sample");
+    writer.WriteSchema(id, tl::BinarySchemaArchive::Write<Sample>());
+
+    for (int i = 0; i < 100; i++) {
+      Sample sample;
+      sample.sequence = i;
+      sample.temperature = 20.0 + i;
+      sample.fault = (i % 7) == 0;
+      auto buffer = writer.GetBuffer();
+      tl::AppendBinary(sample, buffer.get());
+      writer.WriteData(kStart + pt::seconds(i), id, std::move(buffer));
+    }
+  }
+
+  tl::FileReader reader{tempfile.native()};
+
+  {
+    tl::QueryOptions options;
+    options.record = "sample";
+    options.fields = { "sequence", "temperature" };
+    options.predicate = "temperature > 50 && fault";
+
+    std::vector<tl::QueryMatch> matches;
+    tl::RunQuery(reader, options, [&](const auto& match) {
+        matches.push_back(match);
+      });
+
+    BOOST_TEST_REQUIRE(matches.size() == 10);
+    BOOST_TEST(matches[0].timestamp == kStart + pt::seconds(35));
+    BOOST_TEST(matches[0].values[0] == 35.0);
+    BOOST_TEST(matches[0].values[1] == 55.0);
+    BOOST_TEST(matches[9].values[0] == 98.0);
+
+    // Now restrict the time range.
+    options.start = kStart + pt::seconds(40);
+    options.end = kStart + pt::seconds(70);
+    matches.clear();
+    tl::RunQuery(reader, options, [&](const auto& match) {
+        matches.push_back(match);
+      });
+    BOOST_TEST_REQUIRE(matches.size() == 5);
+    BOOST_TEST(matches.front().values[0] == 42.0);
+    BOOST_TEST(matches.back().values[0] == 70.0);
+  }
+
+  {
+    tl::QueryOptions options;
+    options.record = "sample";
+    options.fields = { "temperature" };
+    options.predicate = "sequence >= 5";
+    options.bucket = pt::seconds(30);
+
+    std::vector<tl::QueryBucket> buckets;
+    tl::RunAggregateQuery(reader, options, [&](const auto& bucket) {
+        buckets.push_back(bucket);
+      });
+
+    BOOST_TEST_REQUIRE(buckets.size() == 4);
+    BOOST_TEST(buckets[0].start == kStart + pt::seconds(5));
+    BOOST_TEST(buckets[0].count == 30);
+    BOOST_TEST(buckets[0].min[0] == 25.0);
+    BOOST_TEST(buckets[0].max[0] == 54.0);
+    BOOST_TEST(buckets[0].mean[0] == 39.5);
+    BOOST_TEST(buckets[3].start == kStart + pt::seconds(95));
+    BOOST_TEST(buckets[3].count == 5);
+    BOOST_TEST(buckets[3].mean[0] == 117.0);
+  }
+
+  {
+    tl::QueryOptions options;
+    options.record = "missing";
+    BOOST_CHECK_EXCEPTION(
+        tl::RunQuery(reader, options, [](const auto&) {}),
+        base::system_error,
+        [&](const auto& e) { return e.code() == tl::errc::kUnknownRecord; });
+  }
+}
@@ -0,0 +1,115 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/read_all.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/temporary_file.h"
+#include "mjlib/base/time_conversions.h"
+#include "mjlib/telemetry/file_writer.h"
+
+using namespace mjlib;
+namespace tl = telemetry;
+
+namespace {
+struct Imu {
+  double accel = 0.0;
+  int32_t sequence = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(accel));
+    a->Visit(MJ_NVP(sequence));
+  }
+};
+
+// A reader which only cares about one of the fields.
+struct ImuSequence {
+  int32_t sequence = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(sequence));
+  }
+};
+}
+
+BOOST_AUTO_TEST_CASE(ReadAllTest) {
+  base::TemporaryFile tempfile;
+
+  const auto start = boost::posix_time::time_from_string("2020-03-10 00:00:00");
+  const int64_t start_us = base::ConvertPtimeToEpochMicroseconds(start);
+
+  for (const bool summary : {false, true}) {
+    BOOST_TEST_CONTEXT("summary " << summary) {
+      {
+        tl::FileWriter::Options options;
+        options.summary_block = summary;
+        tl::FileWriter writer{tempfile.native(), options};
+        auto imu = writer.MakeRecordWriter<Imu>("imu");
+        const auto other = writer.AllocateIdentifier("other");
+        writer.WriteSchema(other, "\x0a");  // string
+
+        Imu value;
+        for (int i = 0; i < 1000; i++) {
+          value.accel = i * 0.5;
+          value.sequence = i;
+          imu.Write(start_us + i * 1000, value);
+          if ((i % 100) == 0) {
+            writer.WriteData(start_us + i * 1000, other, "other");
+          }
+        }
+      }
+
+      {
+        tl::FileReader reader{tempfile.native()};
+        const auto result = tl::ReadAll<Imu>(reader, "imu");
+        BOOST_TEST_REQUIRE(result.values.size() == 1000);
+        BOOST_TEST_REQUIRE(result.timestamps.size() == 1000);
+        for (int i = 0; i < 1000; i++) {
+          BOOST_TEST(result.values[i].accel == i * 0.5);
+          BOOST_TEST(result.values[i].sequence == i);
+          BOOST_TEST(result.timestamps[i] == start_us + i * 1000);
+        }
+
+        BOOST_TEST(reader.count_hint("imu") == (summary ? 1000u : 0u));
+      }
+
+      {
+        // Read just a time range, into a different type, appending to
+        // existing storage.
+        tl::FileReader reader{tempfile.native()};
+        std::vector<ImuSequence> values(1);
+        std::vector<int64_t> timestamps(1);
+        tl::ReadAllOptions options;
+        options.start = start + boost::posix_time::milliseconds(100);
+        options.end = start + boost::posix_time::milliseconds(199);
+        const auto count = tl::ReadAll(
+            reader, "imu", &values, &timestamps, options);
+        BOOST_TEST(count == 100);
+        BOOST_TEST_REQUIRE(values.size() == 101);
+        BOOST_TEST(values[1].sequence == 100);
+        BOOST_TEST(values.back().sequence == 199);
+        BOOST_TEST(timestamps.back() == start_us + 199000);
+      }
+
+      {
+        tl::FileReader reader{tempfile.native()};
+        BOOST_TEST(tl::ReadAll<Imu>(reader, "missing").values.empty());
+      }
+    }
+  }
+}
@@ -0,0 +1,230 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/// @file
+///
+/// Benchmarks for FileReader, EmitJson, and MappedBinaryReader, using
+/// logs synthesized at startup.
+
+#include <memory>
+#include <random>
+#include <sstream>
+
+#include <benchmark/benchmark.h>
+
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/base/temporary_file.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+#include "mjlib/telemetry/emit_json.h"
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/file_writer.h"
+#include "mjlib/telemetry/mapped_binary_reader.h"
+#include "mjlib/telemetry/read_all.h"
+#include "mjlib/telemetry/test/benchmark_types.h"
+
+using namespace mjlib;
+namespace pt = boost::posix_time;
+namespace tl = telemetry;
+namespace tt = telemetry::test;
+
+namespace {
+constexpr int kFrames = 20000;
+constexpr int kServoPerFrame = 4;
+
+const pt::ptime kStart{boost::gregorian::date(2023, 1, 1)};
+
+/// A log with a "frame" record at 1kHz, and a "servo" record at four
+/// times that rate.  One is generated for each compression setting,
+/// and removed at exit.
+class SyntheticLog {
+ public:
+  static const SyntheticLog& Get(bool compressed) {
+    static SyntheticLog uncompressed{false};
+    static SyntheticLog compressed_log{true};
+    return compressed ? compressed_log : uncompressed;
+  }
+
+  std::string filename() const { return file_.native(); }
+
+ private:
+  SyntheticLog(bool compressed) {
+    tl::FileWriter::Options options;
+    options.default_compression = compressed;
+    tl::FileWriter writer{file_.native(), options};
+
+    tl::FileWriter::RecordWriter<tt::BenchmarkFrame> frame_writer{
+      &writer, "frame"};
+    tl::FileWriter::RecordWriter<tt::BenchmarkServo> servo_writer{
+      &writer, "servo"};
+
+    for (int i = 0; i < kFrames; i++) {
+      const auto timestamp = kStart + pt::milliseconds(i);
+      frame_writer.Write(timestamp, tt::MakeBenchmarkFrame(i));
+      for (int j = 0; j < kServoPerFrame; j++) {
+        servo_writer.Write(timestamp, tt::MakeBenchmarkServo(j));
+      }
+    }
+  }
+
+  base::TemporaryFile file_;
+};
+
+/// Argument: whether the log is compressed.
+void BM_ReadSequential(benchmark::State& state) {
+  const auto& log = SyntheticLog::Get(state.range(0) != 0);
+
+  int64_t items = 0;
+  int64_t bytes = 0;
+  for (auto _ : state) {
+    tl::FileReader reader{log.filename()};
+    for (const auto& item : reader.items()) {
+      bytes += item.data.size();
+      items++;
+    }
+  }
+
+  state.SetItemsProcessed(items);
+  state.SetBytesProcessed(bytes);
+}
+
+BENCHMARK(BM_ReadSequential)->ArgName("snappy")->Arg(0)->Arg(1)
+->Unit(benchmark::kMillisecond);
+
+/// Decode every frame into its C++ structure.
+void BM_ReadAll(benchmark::State& state) {
+  const auto& log = SyntheticLog::Get(state.range(0) != 0);
+
+  int64_t items = 0;
+  std::vector<tt::BenchmarkFrame> values;
+  std::vector<int64_t> timestamps;
+  for (auto _ : state) {
+    tl::FileReader reader{log.filename()};
+    values.clear();
+    timestamps.clear();
+    items += tl::ReadAll(reader, "frame", &values, &timestamps);
+  }
+
+  state.SetItemsProcessed(items);
+}
+
+BENCHMARK(BM_ReadAll)->ArgName("snappy")->Arg(0)->Arg(1)
+->Unit(benchmark::kMillisecond);
+
+/// The time to open a log, which is dominated by reading its index
+/// and schemas.
+void BM_Open(benchmark::State& state) {
+  const auto& log = SyntheticLog::Get(false);
+
+  for (auto _ : state) {
+    tl::FileReader reader{log.filename()};
+    benchmark::DoNotOptimize(reader.record("frame"));
+  }
+}
+
+BENCHMARK(BM_Open);
+
+/// Seek to random times, then read the item found.
+void BM_Seek(benchmark::State& state) {
+  const auto& log = SyntheticLog::Get(state.range(0) != 0);
+  tl::FileReader reader{log.filename()};
+  const auto* const frame = reader.record("frame");
+
+  std::mt19937 rng{1234};
+  std::uniform_int_distribution<int> distribution{0, kFrames - 1};
+
+  for (auto _ : state) {
+    const auto seek = reader.Seek(
+        kStart + pt::milliseconds(distribution(rng)));
+    tl::FileReader::ItemsOptions options;
+    options.records = { "frame" };
+    options.start = seek.at(frame);
+    for (const auto& item : reader.items(options)) {
+      benchmark::DoNotOptimize(item.data.data());
+      break;
+    }
+  }
+}
+
+BENCHMARK(BM_Seek)->ArgName("snappy")->Arg(0)->Arg(1)
+->Unit(benchmark::kMicrosecond);
+
+void BM_EmitJson(benchmark::State& state) {
+  const auto data = tl::BinaryWriteArchive::Write(tt::MakeBenchmarkFrame(3));
+  const tl::BinarySchemaParser parser{
+    tl::BinarySchemaArchive::Write<tt::BenchmarkFrame>(), "frame"};
+
+  std::ostringstream ostr;
+  for (auto _ : state) {
+    ostr.str({});
+    base::BufferReadStream stream{data};
+    tl::EmitJson(ostr, parser.root(), stream);
+  }
+
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+BENCHMARK(BM_EmitJson);
+
+/// Read a BenchmarkServo as a T, where T is either identical, or an
+/// evolved version requiring a field level mapping.
+template <typename T>
+void BM_MappedRead(benchmark::State& state) {
+  const auto data = tl::BinaryWriteArchive::Write(tt::MakeBenchmarkServo(3));
+  const tl::BinarySchemaParser parser{
+    tl::BinarySchemaArchive::Write<tt::BenchmarkServo>(), "servo"};
+  const tl::MappedBinaryReader<T> reader{&parser};
+
+  T value;
+  for (auto _ : state) {
+    reader.Read(&value, data);
+    benchmark::DoNotOptimize(value);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_MappedRead, tt::BenchmarkServo);
+BENCHMARK_TEMPLATE(BM_MappedRead, tt::BenchmarkServoEvolved);
+
+/// The same, for the large structure with nested arrays.
+void BM_MappedReadFrame(benchmark::State& state) {
+  const auto data = tl::BinaryWriteArchive::Write(tt::MakeBenchmarkFrame(3));
+  const tl::BinarySchemaParser parser{
+    tl::BinarySchemaArchive::Write<tt::BenchmarkFrame>(), "frame"};
+  const tl::MappedBinaryReader<tt::BenchmarkFrame> reader{&parser};
+
+  tt::BenchmarkFrame value;
+  for (auto _ : state) {
+    reader.Read(&value, data);
+    benchmark::DoNotOptimize(value);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_MappedReadFrame);
+
+void BM_BinarySchemaParser(benchmark::State& state) {
+  const auto schema = tl::BinarySchemaArchive::Write<tt::BenchmarkFrame>();
+  for (auto _ : state) {
+    tl::BinarySchemaParser parser{schema, "frame"};
+    benchmark::DoNotOptimize(parser.root());
+  }
+}
+
+BENCHMARK(BM_BinarySchemaParser);
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,243 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mjlib/telemetry/replay.h"
+
+#include <chrono>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/temporary_file.h"
+#include "mjlib/io/deadline_timer.h"
+#include "mjlib/telemetry/binary_schema_parser.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+#include "mjlib/telemetry/file_writer.h"
+
+using namespace mjlib;
+namespace tl = telemetry;
+namespace pt = boost::posix_time;
+
+namespace {
+struct Sample {
+  int32_t sequence = 0;
+  double value = 0.0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(sequence));
+    a->Visit(MJ_NVP(value));
+  }
+};
+
+/// A different, but compatible, view of Sample.
+struct SampleView {
+  double value = 0.0;
+  int32_t sequence = 0;
+  int32_t missing = 7;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(value));
+    a->Visit(MJ_NVP(sequence));
+    a->Visit(MJ_NVP(missing));
+  }
+};
+
+const pt::ptime kStart = pt::time_from_string("2023-01-02 03:00:00");
+
+/// Write @p count samples, @p period apart.
+void WriteLog(const std::string& filename, int count, pt::time_duration period) {
+  tl::FileWriter writer{filename};
+  const auto sample_id = writer.AllocateIdentifier("sample");
+  writer.WriteSchema(sample_id, tl::BinarySchemaArchive::Write<Sample>());
+  const auto other_id = writer.AllocateIdentifier("other");
+  writer.WriteSchema(other_id, tl::BinarySchemaArchive::Write<Sample>());
+
+  for (int i = 0; i < count; i++) {
+    Sample sample;
+    sample.sequence = i;
+    sample.value = i * 0.5;
+    auto buffer = writer.GetBuffer();
+    tl::AppendBinary(sample, buffer.get());
+    writer.WriteData(kStart + period * i, sample_id, std::move(buffer));
+
+    if (i % 10 == 0) {
+      auto other = writer.GetBuffer();
+      tl::AppendBinary(sample, other.get());
+      writer.WriteData(kStart + period * i, other_id, std::move(other));
+    }
+  }
+}
+
+/// Re-arms itself every @p period, recording the time of each
+/// expiration.
+class Ticker {
+ public:
+  Ticker(boost::asio::io_context& context, pt::time_duration period)
+      : timer_(context), period_(period) {}
+
+  void Start(pt::ptime now) {
+    timer_.expires_at(now + period_);
+    Wait();
+  }
+
+  std::vector<pt::ptime> ticks;
+  std::vector<std::string>* events = nullptr;
+
+ private:
+  void Wait() {
+    timer_.async_wait([this](const base::error_code& ec) {
+        if (ec) { return; }
+        ticks.push_back(timer_.expires_at());
+        if (events) { events->push_back("tick"); }
+        timer_.expires_at(timer_.expires_at() + period_);
+        Wait();
+      });
+  }
+
+  io::DeadlineTimer timer_;
+  const pt::time_duration period_;
+};
+}
+
+BOOST_AUTO_TEST_CASE(ReplayBasic) {
+  base::TemporaryFile tempfile;
+  WriteLog(tempfile.native(), 25, pt::milliseconds(100));
+
+  tl::FileReader reader{tempfile.native()};
+  boost::asio::io_context context;
+  tl::Replay dut{context, &reader};
+  BOOST_TEST(dut.now() == kStart);
+
+  std::vector<std::string> events;
+  Ticker ticker{context, pt::milliseconds(250)};
+  ticker.events = &events;
+  ticker.Start(dut.now());
+
+  std::vector<SampleView> samples;
+  dut.Subscribe<SampleView>("sample", [&](const SampleView& sample) {
+      BOOST_TEST(dut.now() == kStart + pt::milliseconds(100) * sample.sequence);
+      samples.push_back(sample);
+      events.push_back(std::to_string(sample.sequence));
+    });
+
+  BOOST_TEST(dut.Run() == 25);
+
+  BOOST_TEST_REQUIRE(samples.size() == 25);
+  BOOST_TEST(samples[3].sequence == 3);
+  BOOST_TEST(samples[3].value == 1.5);
+  BOOST_TEST(samples[3].missing == 7);
+
+  // Each timer observes exactly its expiration time, and runs before
+  // an item with the same timestamp.
+  BOOST_TEST_REQUIRE(ticker.ticks.size() == 9);
+  for (size_t i = 0; i < ticker.ticks.size(); i++) {
+    BOOST_TEST(ticker.ticks[i] == kStart + pt::milliseconds(250) * (i + 1));
+  }
+  const std::vector<std::string> expected_prefix = {
+    "0", "1", "2", "tick", "3", "4", "tick", "5",
+  };
+  BOOST_TEST(std::vector<std::string>(events.begin(), events.begin() + 8) ==
+             expected_prefix, boost::test_tools::per_element());
+
+  // The timers can continue to be driven after the log ends.
+  dut.AdvanceTo(kStart + pt::seconds(3));
+  BOOST_TEST(ticker.ticks.size() == 12);
+  BOOST_TEST(dut.Run() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(ReplayRangeAndStop) {
+  base::TemporaryFile tempfile;
+  WriteLog(tempfile.native(), 100, pt::milliseconds(10));
+
+  tl::FileReader reader{tempfile.native()};
+  boost::asio::io_context context;
+  tl::Replay::Options options;
+  options.start = kStart + pt::milliseconds(205);
+  options.end = kStart + pt::milliseconds(700);
+  tl::Replay dut{context, &reader, options};
+  BOOST_TEST(dut.now() == options.start);
+
+  std::vector<int> sequences;
+  int others = 0;
+  dut.Subscribe<Sample>("sample", [&](const Sample& sample) {
+      sequences.push_back(sample.sequence);
+      if (sample.sequence == 40) { dut.Stop(); }
+    });
+  dut.SubscribeItem("other", [&](const tl::FileReader::Item& item) {
+      BOOST_TEST(item.record->name == "other");
+      others++;
+    });
+
+  // The "other" item at sequence 40 follows the sample in the log,
+  // so it is left for the next call.
+  BOOST_TEST(dut.Run() == 20 + 1);
+  BOOST_TEST(sequences.front() == 21);
+  BOOST_TEST(sequences.back() == 40);
+  BOOST_TEST(others == 1);
+
+  BOOST_TEST(dut.Run() == 30 + 4);
+  BOOST_TEST(sequences.back() == 70);
+  BOOST_TEST(others == 5);
+  BOOST_TEST(dut.now() == options.end);
+
+  BOOST_CHECK_THROW(dut.SubscribeItem("missing", {}), base::system_error);
+}
+
+BOOST_AUTO_TEST_CASE(ReplayHour) {
+  // An hour of data at 10Hz, with a 100Hz timer, replays as fast as
+  // possible.
+  base::TemporaryFile tempfile;
+  WriteLog(tempfile.native(), 36000, pt::milliseconds(100));
+
+  tl::FileReader reader{tempfile.native()};
+  boost::asio::io_context context;
+  tl::Replay dut{context, &reader};
+
+  Ticker ticker{context, pt::milliseconds(10)};
+  ticker.Start(dut.now());
+
+  int64_t sum = 0;
+  dut.Subscribe<Sample>("sample", [&](const Sample& sample) {
+      sum += sample.sequence;
+    });
+
+  const auto wall_start = std::chrono::steady_clock::now();
+  BOOST_TEST(dut.Run() == 36000);
+  const auto wall_elapsed = std::chrono::steady_clock::now() - wall_start;
+
+  BOOST_TEST(sum == int64_t(36000) * 35999 / 2);
+  BOOST_TEST(ticker.ticks.size() == 359990);
+  BOOST_TEST(wall_elapsed < std::chrono::seconds(30));
+}
+
+BOOST_AUTO_TEST_CASE(ReplaySpeed) {
+  base::TemporaryFile tempfile;
+  WriteLog(tempfile.native(), 21, pt::milliseconds(10));
+
+  tl::FileReader reader{tempfile.native()};
+  boost::asio::io_context context;
+  tl::Replay::Options options;
+  options.speed = 2.0;
+  tl::Replay dut{context, &reader, options};
+  dut.SubscribeItem("sample", [](const auto&) {});
+
+  // 200ms of data at twice real time.
+  const auto wall_start = std::chrono::steady_clock::now();
+  BOOST_TEST(dut.Run() == 21);
+  const auto wall_elapsed = std::chrono::steady_clock::now() - wall_start;
+  BOOST_TEST(wall_elapsed >= std::chrono::milliseconds(100));
+}
@@ -0,0 +1,153 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mjlib/telemetry/schema_cache.h"
+
+#include <thread>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/temporary_file.h"
+#include "mjlib/base/test/all_types_struct.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/file_writer.h"
+
+using namespace mjlib;
+namespace tl = telemetry;
+
+namespace {
+struct Small {
+  int32_t value = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(value));
+  }
+};
+
+struct Other {
+  double value = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(value));
+  }
+};
+}
+
+BOOST_AUTO_TEST_CASE(SchemaCacheBasic) {
+  tl::SchemaCache dut;
+  const auto schema = tl::BinarySchemaArchive::Write<base::test::AllTypesTest>();
+
+  auto first = dut.Parse(schema, "test");
+  auto second = dut.Parse(std::string(schema), "test");
+  BOOST_TEST(first.get() == second.get());
+  BOOST_TEST(first->root()->name == "test");
+
+  // The record name is part of the parsed result.
+  auto renamed = dut.Parse(schema, "renamed");
+  BOOST_TEST(renamed.get() != first.get());
+  BOOST_TEST(renamed->root()->name == "renamed");
+
+  auto reader1 = dut.Reader<base::test::AllTypesTest>(first);
+  auto reader2 = dut.Reader<base::test::AllTypesTest>(first);
+  BOOST_TEST(reader1.get() == reader2.get());
+
+  base::test::AllTypesTest value;
+  value.value_i32 = 1234;
+  const auto data = tl::BinaryWriteArchive::Write(value);
+  BOOST_TEST(reader1->Read(data).value_i32 == 1234);
+
+  const auto stats = dut.stats();
+  BOOST_TEST(stats.parse_hits == 1);
+  BOOST_TEST(stats.parse_misses == 2);
+  BOOST_TEST(stats.reader_hits == 1);
+  BOOST_TEST(stats.reader_misses == 1);
+  BOOST_TEST(stats.parsers == 2);
+  BOOST_TEST(stats.readers == 1);
+
+  // Readers remain usable after the cache lets go of everything.
+  first.reset();
+  dut.Clear();
+  BOOST_TEST(dut.stats().parsers == 0);
+  BOOST_TEST(reader1->Read(data).value_i32 == 1234);
+}
+
+BOOST_AUTO_TEST_CASE(SchemaCacheEviction) {
+  tl::SchemaCache::Options options;
+  options.max_entries = 4;
+  tl::SchemaCache dut{options};
+
+  const auto small = tl::BinarySchemaArchive::Write<Small>();
+  auto held = dut.Parse(small, "held");
+  auto held_reader = dut.Reader<Small>(held);
+
+  for (int i = 0; i < 10; i++) {
+    dut.Parse(small, "name" + std::to_string(i));
+  }
+
+  // Only entries referenced elsewhere are retained past the limit.
+  const auto stats = dut.stats();
+  BOOST_TEST(stats.parsers + stats.readers <= 4);
+  BOOST_TEST(dut.Parse(small, "held").get() == held.get());
+  BOOST_TEST(dut.Reader<Small>(held).get() == held_reader.get());
+}
+
+BOOST_AUTO_TEST_CASE(SchemaCacheThreaded) {
+  tl::SchemaCache dut;
+  const auto schema = tl::BinarySchemaArchive::Write<base::test::AllTypesTest>();
+
+  constexpr int kThreads = 8;
+  std::vector<const void*> parsers(kThreads);
+  std::vector<const void*> readers(kThreads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&, i]() {
+        for (int j = 0; j < 100; j++) {
+          auto parser = dut.Parse(schema, "test");
+          auto reader = dut.Reader<base::test::AllTypesTest>(parser);
+          parsers[i] = parser.get();
+          readers[i] = reader.get();
+        }
+      });
+  }
+  for (auto& thread : threads) { thread.join(); }
+
+  for (int i = 1; i < kThreads; i++) {
+    BOOST_TEST(parsers[i] == parsers[0]);
+    BOOST_TEST(readers[i] == readers[0]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(SchemaCacheFileReader) {
+  base::TemporaryFile tempfile;
+  {
+    tl::FileWriter writer{tempfile.native()};
+    writer.AddRecord("small", tl::BinarySchemaArchive::Write<Small>());
+    writer.AddRecord("other", tl::BinarySchemaArchive::Write<Other>());
+  }
+
+  tl::FileReader reader1{tempfile.native()};
+  tl::FileReader reader2{tempfile.native()};
+
+  // Each distinct schema is parsed only once among all readers.
+  BOOST_TEST(reader1.record("small")->schema.get() ==
+             reader2.record("small")->schema.get());
+  BOOST_TEST(reader1.record("other")->schema.get() ==
+             reader2.record("other")->schema.get());
+  BOOST_TEST(reader1.record("small")->schema.get() !=
+             reader1.record("other")->schema.get());
+}
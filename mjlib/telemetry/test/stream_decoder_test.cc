@@ -0,0 +1,169 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/stream_decoder.h"
+
+#include <fstream>
+#include <iterator>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/system_error.h"
+#include "mjlib/base/temporary_file.h"
+#include "mjlib/telemetry/error.h"
+#include "mjlib/telemetry/file_writer.h"
+
+using namespace mjlib;
+using DUT = telemetry::StreamDecoder;
+
+namespace {
+struct Result {
+  std::vector<std::string> schemas;
+  std::vector<std::pair<std::string, std::string>> data;
+  std::vector<boost::posix_time::ptime> timestamps;
+  std::vector<int64_t> indices;
+};
+
+std::string MakeLog(bool compression) {
+  base::TemporaryFile tempfile;
+
+  const boost::posix_time::ptime start =
+      boost::posix_time::time_from_string("2020-03-10 00:00:00");
+
+  {
+    telemetry::FileWriter::Options options;
+    options.default_compression = compression;
+    telemetry::FileWriter writer{tempfile.native(), options};
+
+    const auto id1 = writer.AllocateIdentifier("test1");
+    const auto id2 = writer.AllocateIdentifier("test2");
+    writer.WriteSchema(id1, "\x0a");  // string
+    for (int i = 0; i < 20; i++) {
+      writer.WriteData(start + boost::posix_time::seconds(i), id1,
+                       "id1: " + std::to_string(i) + std::string(i * 10, 'x'));
+      if (i == 10) {
+        writer.WriteSchema(id2, "\x0a");  // string
+      }
+      if (i >= 10) {
+        writer.WriteData(start + boost::posix_time::seconds(i), id2,
+                         "id2: " + std::to_string(i));
+      }
+    }
+  }
+
+  std::ifstream inf(tempfile.native(), std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(inf), {});
+}
+
+Result Decode(std::string_view log, std::size_t chunk_size) {
+  Result result;
+  DUT dut{
+    [&](const DUT::Record& record) {
+      result.schemas.push_back(record.name);
+    },
+    [&](const DUT::Item& item) {
+      result.data.push_back(
+          std::make_pair(item.record->name, std::string(item.data())));
+      result.timestamps.push_back(item.timestamp);
+      result.indices.push_back(item.index);
+    }};
+
+  for (std::size_t offset = 0; offset < log.size(); offset += chunk_size) {
+    dut.Push(log.substr(offset, chunk_size));
+  }
+
+  BOOST_TEST(dut.buffered() == 0);
+  BOOST_TEST(dut.position() == static_cast<int64_t>(log.size()));
+  BOOST_TEST(dut.record("test1") != nullptr);
+  BOOST_TEST(dut.record("test2") != nullptr);
+  BOOST_TEST(dut.record("test3") == nullptr);
+
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(StreamDecoderBasic) {
+  for (const bool compression : {false, true}) {
+    BOOST_TEST_CONTEXT("compression " << compression) {
+      const auto log = MakeLog(compression);
+
+      const auto expected = Decode(log, log.size());
+      BOOST_TEST_REQUIRE(expected.schemas.size() == 2);
+      BOOST_TEST(expected.schemas[0] == "test1");
+      BOOST_TEST(expected.schemas[1] == "test2");
+      BOOST_TEST_REQUIRE(expected.data.size() == 30);
+      BOOST_TEST(expected.data[0].first == "test1");
+      BOOST_TEST(expected.data[0].second == "id1: 0");
+      BOOST_TEST(expected.data.back().first == "test2");
+      BOOST_TEST(expected.data.back().second == "id2: 19");
+      BOOST_TEST(expected.timestamps.back() ==
+                 boost::posix_time::time_from_string("2020-03-10 00:00:19"));
+
+      // Feeding the same stream in arbitrary pieces should produce
+      // identical results.
+      for (const std::size_t chunk_size : {1, 2, 3, 7, 64, 1000}) {
+        BOOST_TEST_CONTEXT("chunk_size " << chunk_size) {
+          const auto actual = Decode(log, chunk_size);
+          BOOST_TEST(actual.schemas == expected.schemas,
+                     boost::test_tools::per_element());
+          BOOST_TEST((actual.data == expected.data));
+          BOOST_TEST(actual.indices == expected.indices,
+                     boost::test_tools::per_element());
+        }
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(StreamDecoderErrors) {
+  const auto log = MakeLog(false);
+
+  {
+    DUT dut{{}, {}};
+    BOOST_CHECK_EXCEPTION(
+        dut.Push("TLOG0002"),
+        base::system_error,
+        [](const auto& e) {
+          return e.code() == telemetry::errc::kInvalidHeader;
+        });
+  }
+
+  {
+    // A corrupted checksum should be detected.
+    auto corrupted = log;
+    const auto position = corrupted.find("id2: 19");
+    BOOST_TEST_REQUIRE(position != std::string::npos);
+    corrupted[position] ^= 0x01;
+    DUT dut{{}, {}};
+    BOOST_CHECK_EXCEPTION(
+        dut.Push(corrupted),
+        base::system_error,
+        [](const auto& e) {
+          return e.code() == telemetry::errc::kDataChecksumMismatch;
+        });
+  }
+
+  {
+    // Streams which do not begin with the file header can be decoded
+    // as well.
+    const std::size_t header_size = 9;
+    int count = 0;
+    DUT::Options options;
+    options.expect_header = false;
+    DUT dut{{}, [&](const DUT::Item&) { count++; }, options};
+    dut.Push(std::string_view(log).substr(header_size));
+    BOOST_TEST(count == 30);
+  }
+}
@@ -0,0 +1,145 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mjlib/telemetry/text_log.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/temporary_file.h"
+
+using namespace mjlib;
+namespace tl = telemetry;
+
+namespace {
+enum class Mode {
+  kFirst = 1,
+  kSecond = 7,
+};
+
+std::vector<tl::TextLogMessage> ReadMessages(const std::string& filename) {
+  tl::FileReader reader{filename};
+  std::vector<tl::TextLogMessage> result;
+  tl::ReadTextLog(reader, [&](const auto& message) {
+      result.push_back(message);
+    });
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(TextLogBasic) {
+  base::TemporaryFile tempfile;
+
+  int expected_line = 0;
+  {
+    tl::FileWriter writer{tempfile.native()};
+    tl::TextLog dut{&writer};
+
+    const std::string name = "motor";
+    for (int i = 0; i < 3; i++) {
+      expected_line = __LINE__ + 1;
+      MJ_TEXT_LOG(dut, kInfo, "{} {} temperature {:.1f} ok={} mode={} {}",
+                  name, i, 20.25 + i, i == 1, Mode::kSecond, 'c');
+    }
+    MJ_TEXT_LOG(dut, kError, "no arguments");
+    MJ_TEXT_LOG(dut, kDebug, "unsigned {} negative {}",
+                static_cast<uint64_t>(1) << 63, int16_t(-5));
+  }
+
+  const auto messages = ReadMessages(tempfile.native());
+  BOOST_TEST_REQUIRE(messages.size() == 5);
+  BOOST_TEST(messages[0].text == "motor 0 temperature 20.2 ok=false mode=7 c");
+  BOOST_TEST(messages[1].text == "motor 1 temperature 21.2 ok=true mode=7 c");
+  BOOST_TEST(messages[2].text == "motor 2 temperature 22.2 ok=false mode=7 c");
+  BOOST_TEST((messages[0].severity == tl::TextLog::Severity::kInfo));
+  BOOST_TEST(messages[0].line == expected_line);
+  BOOST_TEST(messages[0].file.find("text_log_test.cc") != std::string::npos);
+  BOOST_TEST(!messages[0].timestamp.is_not_a_date_time());
+
+  BOOST_TEST(messages[3].text == "no arguments");
+  BOOST_TEST((messages[3].severity == tl::TextLog::Severity::kError));
+  BOOST_TEST(messages[4].text ==
+             "unsigned 9223372036854775808 negative -5");
+}
+
+BOOST_AUTO_TEST_CASE(TextLogSeverityFilter) {
+  base::TemporaryFile tempfile;
+
+  {
+    tl::FileWriter writer{tempfile.native()};
+    tl::TextLog::Options options;
+    options.min_severity = tl::TextLog::Severity::kWarning;
+    tl::TextLog dut{&writer, options};
+
+    BOOST_TEST(!dut.enabled(tl::TextLog::Severity::kInfo));
+    MJ_TEXT_LOG(dut, kInfo, "dropped {}", 1);
+    MJ_TEXT_LOG(dut, kWarning, "kept {}", 2);
+
+    dut.set_min_severity(tl::TextLog::Severity::kDebug);
+    MJ_TEXT_LOG(dut, kDebug, "kept {}", 3);
+  }
+
+  const auto messages = ReadMessages(tempfile.native());
+  BOOST_TEST_REQUIRE(messages.size() == 2);
+  BOOST_TEST(messages[0].text == "kept 2");
+  BOOST_TEST(messages[1].text == "kept 3");
+}
+
+BOOST_AUTO_TEST_CASE(TextLogFormatErrors) {
+  std::string args;
+  {
+    base::FastOStringStream ostr;
+    tl::WriteStream stream{ostr};
+    tl::TextLog::WriteArgument(stream, 5);
+    args = ostr.str();
+  }
+
+  BOOST_TEST(tl::FormatTextLog("value {}", args) == "value 5");
+  BOOST_TEST(tl::FormatTextLog("value {:d}", args) == "value 5");
+  BOOST_TEST(tl::FormatTextLog("value {} {}", args).find("format error") !=
+             std::string::npos);
+  BOOST_TEST(tl::FormatTextLog("value {}", "\xff").find("invalid") !=
+             std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(TextLogTruncatedArgs) {
+  std::string args;
+  {
+    base::FastOStringStream ostr;
+    tl::WriteStream stream{ostr};
+    tl::TextLog::WriteArgument(stream, 1.5);
+    tl::TextLog::WriteArgument(stream, std::string("hello"));
+    args = ostr.str();
+  }
+  BOOST_TEST(tl::FormatTextLog("{} {}", args) == "1.5 hello");
+
+  // Every truncation is reported rather than thrown or asserted.
+  // One falling between arguments leaves too few for the format.
+  for (std::size_t size = 1; size < args.size(); size++) {
+    BOOST_TEST_CONTEXT(size) {
+      const auto text = tl::FormatTextLog("{} {}", args.substr(0, size));
+      BOOST_TEST(text.find(size == 9 ? "<format error" : "<invalid argument") !=
+                 std::string::npos);
+    }
+  }
+
+  // As is a string length which is larger than what remains, even
+  // when it exceeds the maximum string size.
+  const std::string string_tag = args.substr(9, 1);
+  BOOST_TEST(tl::FormatTextLog("{}", string_tag + "\x7f" + "abc") ==
+             "{} <invalid argument 0: truncated>");
+  BOOST_TEST(tl::FormatTextLog("{}", string_tag + "\xff\xff\xff\xff\x0f") ==
+             "{} <invalid argument 0: truncated>");
+}
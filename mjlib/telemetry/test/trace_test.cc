@@ -0,0 +1,142 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mjlib/telemetry/trace.h"
+
+#include <sstream>
+#include <thread>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/temporary_file.h"
+#include "mjlib/telemetry/binary_read_archive.h"
+
+using namespace mjlib;
+namespace tl = telemetry;
+
+namespace {
+int Count(const std::string& haystack, const std::string& needle) {
+  int result = 0;
+  for (auto pos = haystack.find(needle);
+       pos != std::string::npos;
+       pos = haystack.find(needle, pos + 1)) {
+    result++;
+  }
+  return result;
+}
+
+void Work(int iterations) {
+  for (int i = 0; i < iterations; i++) {
+    MJ_TRACE_SPAN("outer");
+    {
+      MJ_TRACE_SPAN("inner");
+      MJ_TRACE_COUNTER("iteration", i);
+    }
+    MJ_TRACE_INSTANT("mark");
+  }
+}
+}
+
+BOOST_AUTO_TEST_CASE(TraceBasic) {
+  base::TemporaryFile tempfile;
+
+  {
+    tl::FileWriter writer{tempfile.native()};
+
+    // Nothing is recorded without a Tracer.
+    Work(3);
+
+    tl::Tracer dut{&writer};
+    tl::Tracer::SetThreadName("main \"thread\"");
+    Work(2);
+
+    std::thread thread([]() {
+        tl::Tracer::SetThreadName("worker");
+        Work(5);
+      });
+    thread.join();
+    dut.Flush();
+
+    Work(1);
+    dut.Flush();
+  }
+
+  tl::FileReader reader{tempfile.native()};
+
+  int events = 0;
+  for (const auto& item : reader.items()) {
+    if (item.record->name != "trace") { continue; }
+    const auto batch = tl::BinaryReadArchive::Read<tl::Tracer::Batch>(
+        item.data);
+    BOOST_TEST(batch.dropped == 0);
+    for (size_t i = 1; i < batch.events.size(); i++) {
+      BOOST_TEST(batch.events[i].timestamp_ns >=
+                 batch.events[i - 1].timestamp_ns);
+    }
+    events += batch.events.size();
+  }
+  BOOST_TEST(events == 6 * 5 + 6 * 3);
+
+  std::ostringstream ostr;
+  tl::WriteChromeTrace(reader, ostr);
+  const auto json = ostr.str();
+
+  BOOST_TEST(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") == 0);
+  BOOST_TEST(Count(json, "\"name\":\"thread_name\"") == 2);
+  BOOST_TEST(Count(json, "\"name\":\"main \\\"thread\\\"\"") == 1);
+  BOOST_TEST(Count(json, "\"name\":\"worker\"") == 1);
+  BOOST_TEST(Count(json, "\"name\":\"outer\",\"ph\":\"B\"") == 8);
+  BOOST_TEST(Count(json, "\"name\":\"outer\",\"ph\":\"E\"") == 8);
+  BOOST_TEST(Count(json, "\"name\":\"inner\",\"ph\":\"B\"") == 8);
+  BOOST_TEST(Count(json, "\"name\":\"iteration\",\"ph\":\"C\"") == 8);
+  BOOST_TEST(Count(json, "\"args\":{\"value\":4}") == 1);
+  BOOST_TEST(Count(json, "\"name\":\"mark\",\"ph\":\"i\"") == 8);
+  BOOST_TEST(Count(json, "\"tid\":2,") == 6 * 5 + 1);
+}
+
+BOOST_AUTO_TEST_CASE(TraceOverflow) {
+  base::TemporaryFile tempfile;
+
+  {
+    tl::FileWriter writer{tempfile.native()};
+    tl::Tracer::Options options;
+    options.thread_capacity = 16;
+    tl::Tracer dut{&writer, options};
+
+    // 10 iterations produce 60 events.
+    Work(10);
+    dut.Flush();
+    Work(1);
+    dut.Flush();
+  }
+
+  tl::FileReader reader{tempfile.native()};
+  std::vector<tl::Tracer::Batch> batches;
+  for (const auto& item : reader.items()) {
+    if (item.record->name != "trace") { continue; }
+    batches.push_back(
+        tl::BinaryReadArchive::Read<tl::Tracer::Batch>(item.data));
+  }
+
+  BOOST_TEST_REQUIRE(batches.size() == 2);
+  BOOST_TEST(batches[0].events.size() == 16);
+  BOOST_TEST(batches[0].dropped == 44);
+  BOOST_TEST(batches[1].events.size() == 6);
+  BOOST_TEST(batches[1].dropped == 0);
+
+  std::ostringstream ostr;
+  tl::WriteChromeTrace(reader, ostr);
+  BOOST_TEST(Count(ostr.str(), "dropped 44 events") == 1);
+}
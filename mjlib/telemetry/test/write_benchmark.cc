@@ -0,0 +1,118 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/// @file
+///
+/// Benchmarks for serialization and FileWriter throughput.
+
+#include <fcntl.h>
+
+#include <benchmark/benchmark.h>
+
+#include "mjlib/base/fast_stream.h"
+#include "mjlib/base/system_error.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+#include "mjlib/telemetry/file_writer.h"
+#include "mjlib/telemetry/test/benchmark_types.h"
+
+using namespace mjlib;
+namespace tl = telemetry;
+namespace tt = telemetry::test;
+
+namespace {
+template <typename T>
+T MakeValue();
+
+template <>
+tt::BenchmarkServo MakeValue() { return tt::MakeBenchmarkServo(3); }
+
+template <>
+tt::BenchmarkFrame MakeValue() { return tt::MakeBenchmarkFrame(3); }
+
+template <typename T>
+void BM_BinaryWriteArchive(benchmark::State& state) {
+  const T value = MakeValue<T>();
+  base::FastOStringStream stream;
+
+  for (auto _ : state) {
+    stream.clear();
+    tl::BinaryWriteArchive(stream).Accept(&value);
+    benchmark::DoNotOptimize(stream.view().data());
+  }
+
+  state.SetBytesProcessed(state.iterations() * stream.view().size());
+}
+
+BENCHMARK_TEMPLATE(BM_BinaryWriteArchive, tt::BenchmarkServo);
+BENCHMARK_TEMPLATE(BM_BinaryWriteArchive, tt::BenchmarkFrame);
+
+template <typename T>
+void BM_BinarySchemaArchive(benchmark::State& state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(tl::BinarySchemaArchive::Write<T>());
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_BinarySchemaArchive, tt::BenchmarkFrame);
+
+/// Arguments are whether to compress and whether to checksum each
+/// block.  Output goes to /dev/null so that only the cost of
+/// encoding and handing off to the writer thread is measured.
+template <typename T>
+void BM_WriteData(benchmark::State& state) {
+  const bool compress = state.range(0) != 0;
+  const bool checksum = state.range(1) != 0;
+
+  tl::FileWriter::Options options;
+  options.default_compression = compress;
+  options.default_checksum_data = checksum;
+  tl::FileWriter writer{options};
+
+  const int fd = ::open("/dev/null", O_WRONLY);
+  if (fd < 0) { throw base::system_error::syserrno("opening /dev/null"); }
+  writer.Open(fd);
+
+  auto* const record = writer.AddRecord(
+      "value", tl::BinarySchemaArchive::Write<T>());
+
+  const T value = MakeValue<T>();
+  const auto start = boost::posix_time::ptime(
+      boost::gregorian::date(2023, 1, 1));
+  int64_t count = 0;
+  int64_t bytes = 0;
+
+  for (auto _ : state) {
+    auto buffer = writer.GetBuffer();
+    bytes += tl::AppendBinary(value, buffer.get());
+    writer.WriteData(start + boost::posix_time::microseconds(count),
+                     record, std::move(buffer));
+    count++;
+  }
+
+  writer.Close();
+
+  state.SetItemsProcessed(count);
+  state.SetBytesProcessed(bytes);
+}
+
+BENCHMARK_TEMPLATE(BM_WriteData, tt::BenchmarkServo)
+->ArgNames({"snappy", "crc"})
+->ArgsProduct({{0, 1}, {0, 1}});
+BENCHMARK_TEMPLATE(BM_WriteData, tt::BenchmarkFrame)
+->ArgNames({"snappy", "crc"})
+->ArgsProduct({{0, 1}, {0, 1}});
+}
+
+BENCHMARK_MAIN();
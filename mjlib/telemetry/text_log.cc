@@ -0,0 +1,207 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/text_log.h"
+
+#include <atomic>
+#include <map>
+
+#include <fmt/format.h>
+#if FMT_VERSION >= 80000
+#include <fmt/args.h>
+#endif
+
+#include "mjlib/base/buffer_stream.h"
+#include "mjlib/telemetry/binary_read_archive.h"
+#include "mjlib/telemetry/binary_schema_parser.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+
+namespace mjlib {
+namespace telemetry {
+
+namespace {
+std::atomic<uint32_t> g_next_site_id{0};
+}
+
+TextLog::Site::Site(Severity severity_in,
+                    const char* format_in,
+                    const char* file_in,
+                    int line_in)
+    : severity(severity_in),
+      format(format_in),
+      file(file_in),
+      line(line_in),
+      id(g_next_site_id.fetch_add(1)) {}
+
+TextLog::TextLog(FileWriter* writer, const Options& options)
+    : writer_(writer),
+      options_(options),
+      min_severity_(options.min_severity),
+      record_(writer->AddRecord(
+                  options.record_name, BinarySchemaArchive::Write<Entry>())),
+      site_record_(writer->AddRecord(
+                       options.record_name + ".site",
+                       BinarySchemaArchive::Write<SiteRecord>())) {}
+
+TextLog::~TextLog() {}
+
+void TextLog::WriteSite(const Site& site) {
+  if (site.id >= sites_written_.size()) {
+    sites_written_.resize(site.id + 1);
+  }
+  sites_written_[site.id] = true;
+
+  SiteRecord record;
+  record.id = site.id;
+  record.severity = static_cast<int8_t>(site.severity);
+  record.format = site.format;
+  record.file = site.file;
+  record.line = site.line;
+
+  auto buffer = writer_->GetBuffer();
+  AppendBinary(record, buffer.get());
+  writer_->WriteData(boost::posix_time::ptime(), site_record_,
+                     std::move(buffer));
+}
+
+std::string FormatTextLog(std::string_view format, std::string_view args) {
+  fmt::dynamic_format_arg_store<fmt::format_context> store;
+
+  base::BufferReadStream base_stream{args};
+  ReadStream stream{base_stream};
+
+  // The argument bytes come from the log, and so may have been
+  // truncated or damaged.
+  int index = 0;
+  const auto truncated = [&]() {
+    return fmt::format("{} <invalid argument {}: truncated>", format, index);
+  };
+
+  for (; base_stream.remaining() > 0; index++) {
+    const auto type = static_cast<TextLog::ArgumentType>(
+        stream.Read<uint8_t>().value());
+    switch (type) {
+      case TextLog::ArgumentType::kBool: {
+        const auto value = stream.Read<uint8_t>();
+        if (!value) { return truncated(); }
+        store.push_back(*value != 0);
+        break;
+      }
+      case TextLog::ArgumentType::kChar: {
+        const auto value = stream.Read<int8_t>();
+        if (!value) { return truncated(); }
+        store.push_back(static_cast<char>(*value));
+        break;
+      }
+      case TextLog::ArgumentType::kSigned: {
+        const auto value = stream.ReadVarint();
+        if (!value) { return truncated(); }
+        store.push_back(*value);
+        break;
+      }
+      case TextLog::ArgumentType::kUnsigned: {
+        const auto value = stream.ReadVaruint();
+        if (!value) { return truncated(); }
+        store.push_back(*value);
+        break;
+      }
+      case TextLog::ArgumentType::kDouble: {
+        const auto value = stream.Read<double>();
+        if (!value) { return truncated(); }
+        store.push_back(*value);
+        break;
+      }
+      case TextLog::ArgumentType::kString: {
+        // The length is checked before anything is allocated.
+        const auto size = stream.ReadVaruint();
+        if (!size ||
+            *size > static_cast<uint64_t>(base_stream.remaining())) {
+          return truncated();
+        }
+        std::string value(*size, '\0');
+        stream.RawRead(value.data(), value.size());
+        store.push_back(std::move(value));
+        break;
+      }
+      default: {
+        return fmt::format("{} <invalid argument type {}>",
+                           format, static_cast<int>(type));
+      }
+    }
+  }
+
+  try {
+    return fmt::vformat(format, store);
+  } catch (fmt::format_error& e) {
+    return fmt::format("{} <format error: {}>", format, e.what());
+  }
+}
+
+void ReadTextLog(FileReader& reader,
+                 const std::function<void (const TextLogMessage&)>& callback,
+                 std::string_view record_name) {
+  const std::string site_name = std::string(record_name) + ".site";
+  if (reader.record(record_name) == nullptr) { return; }
+
+  std::map<uint32_t, TextLog::SiteRecord> sites;
+
+  FileReader::ItemsOptions options;
+  options.records = { std::string(record_name), site_name };
+
+  TextLogMessage message;
+  for (const auto& item : reader.items(options)) {
+    if (item.record->name == site_name) {
+      const auto site =
+          BinaryReadArchive::Read<TextLog::SiteRecord>(item.data);
+      sites[site.id] = site;
+      continue;
+    }
+
+    const auto entry = BinaryReadArchive::Read<TextLog::Entry>(item.data);
+    const std::string_view args(
+        reinterpret_cast<const char*>(entry.args.data()), entry.args.size());
+
+    message.timestamp = item.timestamp;
+    const auto it = sites.find(entry.site);
+    if (it == sites.end()) {
+      // The site record may have been lost, for instance if this is
+      // the tail of a flight recorder.
+      message.severity = TextLog::Severity::kInfo;
+      message.file.clear();
+      message.line = 0;
+      message.text = fmt::format("<unknown site {}>", entry.site);
+    } else {
+      const auto& site = it->second;
+      message.severity = static_cast<TextLog::Severity>(site.severity);
+      message.file = site.file;
+      message.line = site.line;
+      message.text = FormatTextLog(site.format, args);
+    }
+
+    callback(message);
+  }
+}
+
+const char* TextLogSeverityName(TextLog::Severity severity) {
+  switch (severity) {
+    case TextLog::Severity::kDebug: { return "DEBUG"; }
+    case TextLog::Severity::kInfo: { return "INFO"; }
+    case TextLog::Severity::kWarning: { return "WARNING"; }
+    case TextLog::Severity::kError: { return "ERROR"; }
+  }
+  return "UNKNOWN";
+}
+
+}
+}
@@ -0,0 +1,246 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/base/bytes.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/file_writer.h"
+#include "mjlib/telemetry/format.h"
+
+/// Messages with a severity below this, as an integer, are removed at
+/// compile time.  See TextLog::Severity.
+#ifndef MJ_TEXT_LOG_MIN_SEVERITY
+#define MJ_TEXT_LOG_MIN_SEVERITY 0
+#endif
+
+/// Record a message to a TextLog, for instance:
+///
+///   MJ_TEXT_LOG(log, kWarning, "motor {} temperature {:.1f}", id, temp);
+///
+/// The format string must be a literal, and is only used when the
+/// log is later decoded.
+#define MJ_TEXT_LOG(text_log, severity, format, ...)                    \
+  do {                                                                  \
+    if constexpr (static_cast<int>(                                     \
+                      ::mjlib::telemetry::TextLog::Severity::severity) >= \
+                  MJ_TEXT_LOG_MIN_SEVERITY) {                           \
+      static const ::mjlib::telemetry::TextLog::Site mj_text_log_site{  \
+        ::mjlib::telemetry::TextLog::Severity::severity,                \
+            format, __FILE__, __LINE__};                                \
+      (text_log).Log(mj_text_log_site __VA_OPT__(,) __VA_ARGS__);       \
+    }                                                                   \
+  } while (0)
+
+namespace mjlib {
+namespace telemetry {
+
+/// Records text diagnostics into a log without formatting them.  Each
+/// message consists of only an identifier for its call site and the
+/// raw bytes of its arguments.  The format string and location of
+/// each call site are recorded once, the first time it is used.
+///
+/// Formatting, with the usual fmt syntax, takes place when the log is
+/// read, see ReadTextLog.
+///
+/// Supported argument types are bool, char, integers, enumerations,
+/// floating point, and anything convertible to std::string_view.
+///
+/// Like FileWriter, this is not thread safe.
+class TextLog {
+ public:
+  enum class Severity : int8_t {
+    kDebug,
+    kInfo,
+    kWarning,
+    kError,
+  };
+
+  /// A single call site, normally created by MJ_TEXT_LOG.  The
+  /// strings must remain valid for the life of the program.
+  struct Site {
+    Site(Severity, const char* format, const char* file, int line);
+
+    const Severity severity;
+    const char* const format;
+    const char* const file;
+    const int line;
+
+    /// Unique within this process.
+    const uint32_t id;
+  };
+
+  struct Options {
+    /// Messages are written to this record, and call sites to one
+    /// with ".site" appended.
+    std::string record_name = "text_log";
+
+    /// Messages less severe than this are discarded at run time.
+    Severity min_severity = Severity::kDebug;
+
+    /// Messages are short, so by default they are not compressed.
+    FileWriter::WriteFlags write_flags{
+      FileWriter::Override::disabled(), {}};
+
+    Options() {}
+  };
+
+  /// The @p writer must outlive this object.
+  TextLog(FileWriter* writer, const Options& = {});
+  ~TextLog();
+
+  void set_min_severity(Severity severity) { min_severity_ = severity; }
+
+  bool enabled(Severity severity) const {
+    return severity >= min_severity_;
+  }
+
+  template <typename... Args>
+  void Log(const Site& site, const Args&... args) {
+    if (!enabled(site.severity)) { return; }
+    if (site.id >= sites_written_.size() || !sites_written_[site.id]) {
+      WriteSite(site);
+    }
+
+    SizeSink size_sink;
+    BasicWriteStream<SizeSink> size_stream{size_sink};
+    (WriteArgument(size_stream, args), ...);
+
+    auto buffer = writer_->GetBuffer();
+    WriteStream stream{*buffer};
+    stream.Write(site.id);
+    stream.WriteVaruint(size_sink.size());
+    (WriteArgument(stream, args), ...);
+
+    writer_->WriteData(
+        boost::posix_time::ptime(), record_, std::move(buffer),
+        options_.write_flags);
+  }
+
+  /// The serialized form of each message.
+  struct Entry {
+    uint32_t site = 0;
+    base::Bytes args;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(site));
+      a->Visit(MJ_NVP(args));
+    }
+  };
+
+  /// The serialized form of each call site.
+  struct SiteRecord {
+    uint32_t id = 0;
+    int8_t severity = 0;
+    std::string format;
+    std::string file;
+    int32_t line = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(id));
+      a->Visit(MJ_NVP(severity));
+      a->Visit(MJ_NVP(format));
+      a->Visit(MJ_NVP(file));
+      a->Visit(MJ_NVP(line));
+    }
+  };
+
+  /// The type tag which precedes each argument.
+  enum class ArgumentType : uint8_t {
+    kBool,
+    kChar,
+    kSigned,    // varint
+    kUnsigned,  // varuint
+    kDouble,
+    kString,
+  };
+
+  template <typename Stream, typename T>
+  static void WriteArgument(Stream& stream, const T& value) {
+    using U = std::decay_t<T>;
+    auto tag = [&](ArgumentType type) {
+      stream.Write(static_cast<uint8_t>(type));
+    };
+
+    if constexpr (std::is_same_v<U, bool>) {
+      tag(ArgumentType::kBool);
+      stream.Write(value);
+    } else if constexpr (std::is_same_v<U, char>) {
+      tag(ArgumentType::kChar);
+      stream.Write(static_cast<int8_t>(value));
+    } else if constexpr (std::is_enum_v<U>) {
+      WriteArgument(stream, static_cast<std::underlying_type_t<U>>(value));
+    } else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+      tag(ArgumentType::kSigned);
+      stream.WriteVarint(static_cast<int64_t>(value));
+    } else if constexpr (std::is_integral_v<U>) {
+      tag(ArgumentType::kUnsigned);
+      stream.WriteVaruint(static_cast<uint64_t>(value));
+    } else if constexpr (std::is_floating_point_v<U>) {
+      tag(ArgumentType::kDouble);
+      stream.Write(static_cast<double>(value));
+    } else {
+      static_assert(std::is_convertible_v<const T&, std::string_view>,
+                    "unsupported TextLog argument type");
+      tag(ArgumentType::kString);
+      stream.WriteString(std::string_view(value));
+    }
+  }
+
+ private:
+  void WriteSite(const Site&);
+
+  FileWriter* const writer_;
+  const Options options_;
+  Severity min_severity_;
+  FileWriter::Record* const record_;
+  FileWriter::Record* const site_record_;
+  std::vector<bool> sites_written_;
+};
+
+/// Format a single message from its format string and the argument
+/// bytes recorded by TextLog.  An invalid format or argument results
+/// in a description of the problem being included in the text.
+std::string FormatTextLog(std::string_view format, std::string_view args);
+
+struct TextLogMessage {
+  boost::posix_time::ptime timestamp;
+  TextLog::Severity severity = TextLog::Severity::kInfo;
+  std::string file;
+  int line = 0;
+  std::string text;
+};
+
+/// Decode and format every message recorded by a TextLog, in order.
+void ReadTextLog(FileReader&,
+                 const std::function<void (const TextLogMessage&)>&,
+                 std::string_view record_name = "text_log");
+
+/// @return "DEBUG", "INFO", "WARNING", or "ERROR"
+const char* TextLogSeverityName(TextLog::Severity);
+
+}
+}
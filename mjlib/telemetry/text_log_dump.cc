@@ -0,0 +1,63 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/// @file
+///
+/// Print the messages recorded by a TextLog in human readable form.
+
+#include <iostream>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/clipp.h"
+
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/text_log.h"
+
+namespace tl = mjlib::telemetry;
+
+int main(int argc, char**argv) {
+  std::string log_filename;
+  std::string record_name = "text_log";
+  int min_severity = 0;
+
+  auto group = clipp::group(
+      (clipp::option("r", "record") & clipp::value("", record_name))
+      % "the TextLog record name",
+      (clipp::option("s", "severity") & clipp::integer("", min_severity))
+      % "the minimum severity to print, 0=debug 3=error",
+      clipp::value("LOG", log_filename)
+  );
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  tl::FileReader file_reader(log_filename);
+
+  tl::ReadTextLog(
+      file_reader,
+      [&](const tl::TextLogMessage& message) {
+        if (static_cast<int>(message.severity) < min_severity) { return; }
+        std::cout << fmt::format(
+            "{} {:7} {}:{} {}\n",
+            boost::posix_time::to_iso_extended_string(message.timestamp),
+            tl::TextLogSeverityName(message.severity),
+            message.file, message.line, message.text);
+      },
+      record_name);
+
+  return 0;
+}
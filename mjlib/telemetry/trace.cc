@@ -0,0 +1,305 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mjlib/telemetry/trace.h"
+
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+
+#include <boost/assert.hpp>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/escape_json_string.h"
+#include "mjlib/telemetry/binary_read_archive.h"
+#include "mjlib/telemetry/binary_schema_parser.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+
+namespace mjlib {
+namespace telemetry {
+
+namespace {
+std::atomic<uint64_t> g_next_generation{1};
+
+/// The names of all sites, indexed by their identifier.
+class SiteRegistry {
+ public:
+  static SiteRegistry& Get() {
+    static SiteRegistry registry;
+    return registry;
+  }
+
+  uint32_t Add(const char* name) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    names_.push_back(name);
+    return names_.size() - 1;
+  }
+
+  const char* name(uint32_t id) const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return id < names_.size() ? names_[id] : "";
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<const char*> names_;
+};
+}
+
+std::atomic<Tracer*> Tracer::current_{nullptr};
+
+Tracer::Site::Site(const char* name_in)
+    : name(name_in),
+      id(SiteRegistry::Get().Add(name_in)) {}
+
+void Tracer::ThreadBuffer::Drain(Batch* batch) {
+  const uint64_t head = head_.load(std::memory_order_acquire);
+  uint64_t tail = tail_.load(std::memory_order_relaxed);
+
+  batch->thread = id_;
+  batch->events.clear();
+  for (; tail != head; tail++) {
+    batch->events.push_back(events_[tail % events_.size()]);
+  }
+  tail_.store(tail, std::memory_order_release);
+
+  const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+  batch->dropped = dropped - dropped_reported_;
+  dropped_reported_ = dropped;
+}
+
+class Tracer::Impl {
+ public:
+  Impl(FileWriter* writer, const Options& options)
+      : writer_(writer),
+        options_(options),
+        record_(writer->AddRecord(
+                    options.record_name, BinarySchemaArchive::Write<Batch>())),
+        name_record_(writer->AddRecord(
+                         options.record_name + ".name",
+                         BinarySchemaArchive::Write<Name>())),
+        thread_record_(writer->AddRecord(
+                           options.record_name + ".thread",
+                           BinarySchemaArchive::Write<Name>())) {}
+
+  ThreadBuffer* RegisterThread() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    buffers_.push_back(std::make_unique<ThreadBuffer>(
+                           buffers_.size() + 1, options_.thread_capacity));
+    return buffers_.back().get();
+  }
+
+  void SetThreadName(uint32_t id, std::string_view name) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    thread_names_.push_back({id, std::string(name)});
+  }
+
+  void Flush() {
+    std::vector<ThreadBuffer*> buffers;
+    std::vector<Name> thread_names;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      for (const auto& buffer : buffers_) { buffers.push_back(buffer.get()); }
+      thread_names.swap(thread_names_);
+    }
+
+    for (const auto& name : thread_names) {
+      Write(thread_record_, name);
+    }
+
+    for (auto* buffer : buffers) {
+      buffer->Drain(&batch_);
+      if (batch_.events.empty() && batch_.dropped == 0) { continue; }
+
+      for (const auto& event : batch_.events) {
+        if (event.name >= names_written_.size()) {
+          names_written_.resize(event.name + 1);
+        }
+        if (names_written_[event.name]) { continue; }
+        names_written_[event.name] = true;
+
+        Name name;
+        name.id = event.name;
+        name.name = SiteRegistry::Get().name(event.name);
+        Write(name_record_, name);
+      }
+
+      Write(record_, batch_);
+    }
+  }
+
+ private:
+  template <typename T>
+  void Write(FileWriter::Record* record, const T& value) {
+    auto buffer = writer_->GetBuffer();
+    AppendBinary(value, buffer.get());
+    writer_->WriteData(boost::posix_time::ptime(), record, std::move(buffer));
+  }
+
+  FileWriter* const writer_;
+  const Options options_;
+  FileWriter::Record* const record_;
+  FileWriter::Record* const name_record_;
+  FileWriter::Record* const thread_record_;
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+  std::vector<Name> thread_names_;
+
+  // Only accessed from Flush.
+  std::vector<bool> names_written_;
+  Batch batch_;
+};
+
+Tracer::Tracer(FileWriter* writer, const Options& options)
+    : generation_(g_next_generation.fetch_add(1)),
+      impl_(std::make_unique<Impl>(writer, options)) {
+  Tracer* expected = nullptr;
+  const bool installed = current_.compare_exchange_strong(expected, this);
+  BOOST_ASSERT(installed);
+  (void)installed;
+}
+
+Tracer::~Tracer() {
+  current_.store(nullptr);
+}
+
+void Tracer::Flush() {
+  impl_->Flush();
+}
+
+void Tracer::SetThreadName(std::string_view name) {
+  Tracer* const tracer = current_.load(std::memory_order_acquire);
+  if (tracer == nullptr) { return; }
+  ThreadState& state = thread_state_;
+  if (state.generation != tracer->generation_) {
+    state.buffer = tracer->RegisterThread();
+    state.generation = tracer->generation_;
+  }
+  tracer->impl_->SetThreadName(state.buffer->id(), name);
+}
+
+Tracer::ThreadBuffer* Tracer::RegisterThread() {
+  return impl_->RegisterThread();
+}
+
+void WriteChromeTrace(FileReader& reader, std::ostream& out,
+                      std::string_view record_name) {
+  const std::string name_record = std::string(record_name) + ".name";
+  const std::string thread_record = std::string(record_name) + ".thread";
+
+  auto escape = [](std::string_view value) {
+    return base::EscapeJsonString(std::string(value));
+  };
+
+  FileReader::ItemsOptions options;
+  options.records = {
+    std::string(record_name), name_record, thread_record };
+
+  // The first pass collects names and the starting time, so that
+  // every event can be written in the second regardless of the order
+  // in which threads were flushed.
+  std::map<uint32_t, std::string> names;
+  std::map<uint32_t, std::string> threads;
+  int64_t start_ns = std::numeric_limits<int64_t>::max();
+  if (reader.record(record_name) != nullptr) {
+    for (const auto& item : reader.items(options)) {
+      if (item.record->name == name_record) {
+        auto name = BinaryReadArchive::Read<Tracer::Name>(item.data);
+        names[name.id] = std::move(name.name);
+      } else if (item.record->name == thread_record) {
+        auto name = BinaryReadArchive::Read<Tracer::Name>(item.data);
+        threads[name.id] = std::move(name.name);
+      } else {
+        const auto batch = BinaryReadArchive::Read<Tracer::Batch>(item.data);
+        for (const auto& event : batch.events) {
+          start_ns = std::min(start_ns, event.timestamp_ns);
+        }
+      }
+    }
+  }
+
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  const char* separator = "\n";
+
+  for (const auto& [id, name] : threads) {
+    out << separator << fmt::format(
+        "{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},"
+        "\"args\":{{\"name\":\"{}\"}}}}", id, escape(name));
+    separator = ",\n";
+  }
+
+  if (start_ns != std::numeric_limits<int64_t>::max()) {
+    for (const auto& item : reader.items(options)) {
+      if (item.record->name != record_name) { continue; }
+
+      const auto batch = BinaryReadArchive::Read<Tracer::Batch>(item.data);
+      if (batch.dropped) {
+        out << separator << fmt::format(
+            "{{\"name\":\"dropped {} events\",\"ph\":\"i\",\"s\":\"t\","
+            "\"pid\":1,\"tid\":{},\"ts\":{:.3f}}}",
+            batch.dropped, batch.thread,
+            batch.events.empty() ? 0.0 :
+            (batch.events.front().timestamp_ns - start_ns) / 1000.0);
+        separator = ",\n";
+      }
+
+      for (const auto& event : batch.events) {
+        const auto it = names.find(event.name);
+        const std::string name =
+            (it == names.end()) ?
+            fmt::format("<unknown {}>", event.name) :
+            escape(it->second);
+        const double ts = (event.timestamp_ns - start_ns) / 1000.0;
+
+        std::string fields;
+        switch (static_cast<Tracer::EventType>(event.type)) {
+          case Tracer::EventType::kBegin: {
+            fields = "\"ph\":\"B\"";
+            break;
+          }
+          case Tracer::EventType::kEnd: {
+            fields = "\"ph\":\"E\"";
+            break;
+          }
+          case Tracer::EventType::kCounter: {
+            fields = fmt::format(
+                "\"ph\":\"C\",\"args\":{{\"value\":{}}}",
+                std::isfinite(event.value) ? event.value : 0.0);
+            break;
+          }
+          case Tracer::EventType::kInstant: {
+            fields = "\"ph\":\"i\",\"s\":\"t\"";
+            break;
+          }
+          default: {
+            continue;
+          }
+        }
+
+        out << separator << fmt::format(
+            "{{\"name\":\"{}\",{},\"pid\":1,\"tid\":{},\"ts\":{:.3f}}}",
+            name, fields, batch.thread, ts);
+        separator = ",\n";
+      }
+    }
+  }
+
+  out << "\n]}\n";
+}
+
+}
+}
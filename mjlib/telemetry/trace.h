@@ -0,0 +1,277 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "mjlib/base/visitor.h"
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/file_writer.h"
+
+/// If zero, the MJ_TRACE macros expand to nothing.
+#ifndef MJ_TRACE_ENABLED
+#define MJ_TRACE_ENABLED 1
+#endif
+
+#define MJ_TRACE_CAT2(a, b) a##b
+#define MJ_TRACE_CAT(a, b) MJ_TRACE_CAT2(a, b)
+
+#if MJ_TRACE_ENABLED
+
+/// Record a span which lasts until the end of the enclosing scope.
+/// The name must be a literal.
+///
+///   void Controller::Cycle() {
+///     MJ_TRACE_SPAN("cycle");
+///     ...
+///   }
+#define MJ_TRACE_SPAN(name)                                             \
+  static const ::mjlib::telemetry::Tracer::Site                         \
+  MJ_TRACE_CAT(mj_trace_site_, __LINE__){name};                         \
+  const ::mjlib::telemetry::Tracer::Span                                \
+  MJ_TRACE_CAT(mj_trace_span_, __LINE__){                               \
+    MJ_TRACE_CAT(mj_trace_site_, __LINE__)}
+
+/// Record the current value of a named counter.
+#define MJ_TRACE_COUNTER(name, value)                                   \
+  do {                                                                  \
+    static const ::mjlib::telemetry::Tracer::Site mj_trace_site{name};  \
+    ::mjlib::telemetry::Tracer::Record(                                 \
+        mj_trace_site, ::mjlib::telemetry::Tracer::EventType::kCounter, \
+        (value));                                                       \
+  } while (0)
+
+/// Record a single point in time.
+#define MJ_TRACE_INSTANT(name)                                          \
+  do {                                                                  \
+    static const ::mjlib::telemetry::Tracer::Site mj_trace_site{name};  \
+    ::mjlib::telemetry::Tracer::Record(                                 \
+        mj_trace_site, ::mjlib::telemetry::Tracer::EventType::kInstant); \
+  } while (0)
+
+#else
+
+#define MJ_TRACE_SPAN(name) do {} while (0)
+#define MJ_TRACE_COUNTER(name, value) do {} while (0)
+#define MJ_TRACE_INSTANT(name) do {} while (0)
+
+#endif
+
+namespace mjlib {
+namespace telemetry {
+
+/// Records timing spans and counters from any number of threads into
+/// a log.
+///
+/// Each thread appends fixed size events to its own lock free ring
+/// buffer, which costs a clock read and a few stores.  The rings are
+/// drained into the FileWriter by Flush, which must be called
+/// periodically from the thread that owns the FileWriter, for
+/// instance once per control cycle.  If a ring fills before it is
+/// flushed, further events from that thread are counted and
+/// discarded.
+///
+/// At most one Tracer may exist at a time, and events are only
+/// recorded while it does.  All threads must have stopped recording
+/// before it is destroyed.
+///
+/// See WriteChromeTrace to view the result.
+class Tracer : boost::noncopyable {
+ public:
+  enum class EventType : uint8_t {
+    kBegin,
+    kEnd,
+    kCounter,
+    kInstant,
+  };
+
+  /// A single name, normally created by one of the MJ_TRACE macros.
+  /// The string must remain valid for the life of the program.
+  struct Site {
+    explicit Site(const char* name);
+
+    const char* const name;
+
+    /// Unique within this process.
+    const uint32_t id;
+  };
+
+  struct Event {
+    int64_t timestamp_ns = 0;
+    uint32_t name = 0;
+    uint8_t type = 0;
+    double value = 0.0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(timestamp_ns));
+      a->Visit(MJ_NVP(name));
+      a->Visit(MJ_NVP(type));
+      a->Visit(MJ_NVP(value));
+    }
+  };
+
+  /// The serialized form of the events from one thread.
+  struct Batch {
+    uint32_t thread = 0;
+    /// The number of events discarded since the previous batch.
+    uint64_t dropped = 0;
+    std::vector<Event> events;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(thread));
+      a->Visit(MJ_NVP(dropped));
+      a->Visit(MJ_NVP(events));
+    }
+  };
+
+  /// Associates a site or thread identifier with its name.
+  struct Name {
+    uint32_t id = 0;
+    std::string name;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(id));
+      a->Visit(MJ_NVP(name));
+    }
+  };
+
+  struct Options {
+    /// Events are written to this record, and site and thread names
+    /// to ones with ".name" and ".thread" appended.
+    std::string record_name = "trace";
+
+    /// The number of events each thread can buffer between calls to
+    /// Flush.
+    std::size_t thread_capacity = 16384;
+
+    Options() {}
+  };
+
+  /// The @p writer must outlive this object.
+  Tracer(FileWriter* writer, const Options& = {});
+  ~Tracer();
+
+  /// Write all events recorded so far.
+  void Flush();
+
+  /// Name the calling thread in the output.
+  static void SetThreadName(std::string_view);
+
+  static int64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  static void Record(const Site& site, EventType type, double value = 0.0) {
+    Tracer* const tracer = current_.load(std::memory_order_acquire);
+    if (tracer == nullptr) { return; }
+    ThreadState& state = thread_state_;
+    if (state.generation != tracer->generation_) {
+      state.buffer = tracer->RegisterThread();
+      state.generation = tracer->generation_;
+    }
+    state.buffer->Push(Now(), site.id, type, value);
+  }
+
+  class Span : boost::noncopyable {
+   public:
+    explicit Span(const Site& site) : site_(site) {
+      Record(site_, EventType::kBegin);
+    }
+
+    ~Span() {
+      Record(site_, EventType::kEnd);
+    }
+
+   private:
+    const Site& site_;
+  };
+
+  /// A single producer, single consumer ring of events.
+  class ThreadBuffer {
+   public:
+    ThreadBuffer(uint32_t id, std::size_t capacity)
+        : id_(id), events_(capacity) {}
+
+    uint32_t id() const { return id_; }
+
+    void Push(int64_t timestamp_ns, uint32_t name, EventType type,
+              double value) {
+      const uint64_t head = head_.load(std::memory_order_relaxed);
+      if (head - tail_.load(std::memory_order_acquire) >= events_.size()) {
+        dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
+        return;
+      }
+      Event& event = events_[head % events_.size()];
+      event.timestamp_ns = timestamp_ns;
+      event.name = name;
+      event.type = static_cast<uint8_t>(type);
+      event.value = value;
+      head_.store(head + 1, std::memory_order_release);
+    }
+
+    /// Move everything pushed so far into @p batch.  May only be
+    /// called from one thread at a time.
+    void Drain(Batch* batch);
+
+   private:
+    const uint32_t id_;
+    std::vector<Event> events_;
+    std::atomic<uint64_t> head_{0};
+    std::atomic<uint64_t> tail_{0};
+    std::atomic<uint64_t> dropped_{0};
+    uint64_t dropped_reported_ = 0;
+  };
+
+ private:
+  struct ThreadState {
+    uint64_t generation = 0;
+    ThreadBuffer* buffer = nullptr;
+  };
+
+  ThreadBuffer* RegisterThread();
+
+  static std::atomic<Tracer*> current_;
+  static thread_local ThreadState thread_state_;
+
+  const uint64_t generation_;
+
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+inline thread_local Tracer::ThreadState Tracer::thread_state_;
+
+/// Write the events recorded by a Tracer as Chrome trace event JSON,
+/// which can be viewed in Perfetto or chrome://tracing.  Timestamps
+/// are relative to the first event.
+void WriteChromeTrace(FileReader&, std::ostream&,
+                      std::string_view record_name = "trace");
+
+}
+}
@@ -0,0 +1,61 @@
+// Copyright 2023 mjbots Robotic Systems, LLC.  info@mjbots.com
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/// @file
+///
+/// Convert the events recorded by a Tracer into Chrome trace event
+/// JSON, suitable for Perfetto or chrome://tracing.
+
+#include <fstream>
+#include <iostream>
+
+#include "mjlib/base/clipp.h"
+#include "mjlib/base/system_error.h"
+
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/trace.h"
+
+namespace tl = mjlib::telemetry;
+
+int main(int argc, char**argv) {
+  std::string log_filename;
+  std::string output_filename;
+  std::string record_name = "trace";
+
+  auto group = clipp::group(
+      (clipp::option("r", "record") & clipp::value("", record_name))
+      % "the Tracer record name",
+      (clipp::option("o", "output") & clipp::value("", output_filename))
+      % "write to this file instead of stdout",
+      clipp::value("LOG", log_filename)
+  );
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  tl::FileReader file_reader(log_filename);
+
+  if (output_filename.empty()) {
+    tl::WriteChromeTrace(file_reader, std::cout, record_name);
+  } else {
+    std::ofstream out(output_filename);
+    if (!out.is_open()) {
+      throw mjlib::base::system_error::syserrno(
+          "opening: " + output_filename);
+    }
+    tl::WriteChromeTrace(file_reader, out, record_name);
+  }
+
+  return 0;
+}
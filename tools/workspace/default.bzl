@@ -21,6 +21,7 @@ load("//tools/workspace/clipp:repository.bzl", "clipp_repository")
 load("//tools/workspace/function2:repository.bzl", "function2_repository")
 load("//tools/workspace/gl3w:repository.bzl", "gl3w_repository")
 load("//tools/workspace/glfw:repository.bzl", "glfw_repository")
+load("//tools/workspace/google_benchmark:repository.bzl", "google_benchmark_repository")
 load("//tools/workspace/imgui:repository.bzl", "imgui_repository")
 load("//tools/workspace/implot:repository.bzl", "implot_repository")
 load("//tools/workspace/rules_mbed:repository.bzl", "rules_mbed_repository")
@@ -42,6 +43,8 @@ def add_default_repositories():
         gl3w_repository(name = "gl3w")
     if not native.existing_rule("glfw"):
         glfw_repository(name = "glfw")
+    if not native.existing_rule("com_github_google_benchmark"):
+        google_benchmark_repository(name = "com_github_google_benchmark")
     if not native.existing_rule("imgui"):
         imgui_repository(name = "imgui")
     if not native.existing_rule("implot"):